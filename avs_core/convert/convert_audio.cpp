@@ -39,6 +39,7 @@
 #include <avisynth.h>
 #include "convert_audio.h"
 #include <malloc.h>
+#include <tmmintrin.h>
 
 // There are two type parameters. Acceptable sample types and a prefered sample type.
 // If the current clip is already one of the defined types in sampletype, this will be returned.
@@ -270,6 +271,195 @@ c8_loop:
 
 /*******************************************/
 
+// Intrinsic kernels for builds without the inline assembly above (x64).
+// Each one converts as many whole vectors as fit and returns the number of
+// samples done; the C routines finish the tail, so results are identical.
+
+static int convert24To16_SSSE3(const char* inbuf, void* outbuf, int count) {
+  const unsigned char* in = (const unsigned char*)inbuf;
+  short* out = (short*)outbuf;
+
+  const __m128i lo_shuf = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11, 13, 14, -1, -1, -1, -1, -1, -1);
+  const __m128i hi_shuf = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, 9, 11, 12, 14, 15);
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(in + i*3));     // samples 0..4
+    __m128i b = _mm_loadu_si128((const __m128i*)(in + i*3 + 8)); // samples 5..7
+    __m128i r = _mm_or_si128(_mm_shuffle_epi8(a, lo_shuf), _mm_shuffle_epi8(b, hi_shuf));
+    _mm_storeu_si128((__m128i*)(out + i), r);
+  }
+  return i;
+}
+
+static int convert16To8_SSE2(const char* inbuf, void* outbuf, int count) {
+  const short* in = (const short*)inbuf;
+  unsigned char* out = (unsigned char*)outbuf;
+
+  const __m128i bias = _mm_set1_epi8(-128);
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_srai_epi16(_mm_loadu_si128((const __m128i*)(in + i)), 8);
+    __m128i b = _mm_srai_epi16(_mm_loadu_si128((const __m128i*)(in + i + 8)), 8);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(_mm_packs_epi16(a, b), bias));
+  }
+  return i;
+}
+
+static int convert8To16_SSE2(const char* inbuf, void* outbuf, int count) {
+  const unsigned char* in = (const unsigned char*)inbuf;
+  short* out = (short*)outbuf;
+
+  // ((in-128) << 8) | in  ==  (in << 8 | in) ^ 0x8000
+  const __m128i bias = _mm_set1_epi16(-32768);
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i src = _mm_loadu_si128((const __m128i*)(in + i));
+    _mm_storeu_si128((__m128i*)(out + i),     _mm_xor_si128(_mm_unpacklo_epi8(src, src), bias));
+    _mm_storeu_si128((__m128i*)(out + i + 8), _mm_xor_si128(_mm_unpackhi_epi8(src, src), bias));
+  }
+  return i;
+}
+
+// Sign extends the low/high four words to dwords and scales them to float.
+static __forceinline __m128 words_to_float_lo(__m128i w, __m128 scale) {
+  return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16)), scale);
+}
+
+static __forceinline __m128 words_to_float_hi(__m128i w, __m128 scale) {
+  return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16)), scale);
+}
+
+static int convertToFloat_SIMD(const char* inbuf, float* outbuf, char sample_type, int count, int cpuflags) {
+  int i = 0;
+  switch (sample_type) {
+    case SAMPLE_INT8: {
+      const __m128 scale = _mm_set1_ps(float(1.0 / 128));
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i bias = _mm_set1_epi16(128);
+      const unsigned char* samples = (const unsigned char*)inbuf;
+      for (; i + 16 <= count; i += 16) {
+        __m128i src = _mm_loadu_si128((const __m128i*)(samples + i));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(src, zero), bias);
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(src, zero), bias);
+        _mm_storeu_ps(outbuf + i,      words_to_float_lo(lo, scale));
+        _mm_storeu_ps(outbuf + i + 4,  words_to_float_hi(lo, scale));
+        _mm_storeu_ps(outbuf + i + 8,  words_to_float_lo(hi, scale));
+        _mm_storeu_ps(outbuf + i + 12, words_to_float_hi(hi, scale));
+      }
+      break;
+    }
+    case SAMPLE_INT16: {
+      const __m128 scale = _mm_set1_ps(float(1.0 / 32768));
+      const short* samples = (const short*)inbuf;
+      for (; i + 8 <= count; i += 8) {
+        __m128i src = _mm_loadu_si128((const __m128i*)(samples + i));
+        _mm_storeu_ps(outbuf + i,     words_to_float_lo(src, scale));
+        _mm_storeu_ps(outbuf + i + 4, words_to_float_hi(src, scale));
+      }
+      break;
+    }
+    case SAMPLE_INT24: {
+      if (!(cpuflags & CPUF_SSSE3))
+        break;
+      // Place the three bytes of each sample in the top of a dword, as the C code does.
+      const __m128 scale = _mm_set1_ps(float(1.0 / (unsigned)(1<<31)));
+      const __m128i shuf = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+      const unsigned char* samples = (const unsigned char*)inbuf;
+      for (; i + 6 <= count; i += 4) {  // 16 byte load covers 5.33 samples
+        __m128i src = _mm_loadu_si128((const __m128i*)(samples + i*3));
+        _mm_storeu_ps(outbuf + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(src, shuf)), scale));
+      }
+      break;
+    }
+    case SAMPLE_INT32: {
+      const __m128 scale = _mm_set1_ps(float(1.0 / (unsigned)(1<<31)));
+      const int* samples = (const int*)inbuf;
+      for (; i + 4 <= count; i += 4) {
+        __m128i src = _mm_loadu_si128((const __m128i*)(samples + i));
+        _mm_storeu_ps(outbuf + i, _mm_mul_ps(_mm_cvtepi32_ps(src), scale));
+      }
+      break;
+    }
+  }
+  return i;
+}
+
+// Vector form of the Saturate_intN helpers: values at or beyond the limits
+// are pinned to them, anything in between is converted as (int)(n+0.5f).
+static __forceinline __m128i saturate_round(__m128 n, __m128 lo, __m128 hi, __m128i lo_i, __m128i hi_i) {
+  __m128i t = _mm_cvttps_epi32(_mm_add_ps(n, _mm_set1_ps(0.5f)));
+  __m128i at_lo = _mm_castps_si128(_mm_cmple_ps(n, lo));
+  __m128i at_hi = _mm_castps_si128(_mm_cmpge_ps(n, hi));
+  t = _mm_or_si128(_mm_andnot_si128(at_lo, t), _mm_and_si128(at_lo, lo_i));
+  return _mm_or_si128(_mm_andnot_si128(at_hi, t), _mm_and_si128(at_hi, hi_i));
+}
+
+static int convertFromFloat_SIMD(const float* inbuf, void* outbuf, char sample_type, int count, int cpuflags) {
+  int i = 0;
+  switch (sample_type) {
+    case SAMPLE_INT8: {
+      const __m128 mult = _mm_set1_ps(128.0f);
+      const __m128 lo = _mm_set1_ps(-128.0f), hi = _mm_set1_ps(127.0f);
+      const __m128i lo_i = _mm_set1_epi32(-128), hi_i = _mm_set1_epi32(127);
+      const __m128i bias = _mm_set1_epi8(-128);
+      unsigned char* samples = (unsigned char*)outbuf;
+      for (; i + 16 <= count; i += 16) {
+        __m128i a = saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i),      mult), lo, hi, lo_i, hi_i);
+        __m128i b = saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i + 4),  mult), lo, hi, lo_i, hi_i);
+        __m128i c = saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i + 8),  mult), lo, hi, lo_i, hi_i);
+        __m128i d = saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i + 12), mult), lo, hi, lo_i, hi_i);
+        __m128i r = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128((__m128i*)(samples + i), _mm_xor_si128(r, bias));
+      }
+      break;
+    }
+    case SAMPLE_INT16: {
+      const __m128 mult = _mm_set1_ps(32768.0f);
+      const __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+      const __m128i lo_i = _mm_set1_epi32(-32768), hi_i = _mm_set1_epi32(32767);
+      short* samples = (short*)outbuf;
+      for (; i + 8 <= count; i += 8) {
+        __m128i a = saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i),     mult), lo, hi, lo_i, hi_i);
+        __m128i b = saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i + 4), mult), lo, hi, lo_i, hi_i);
+        _mm_storeu_si128((__m128i*)(samples + i), _mm_packs_epi32(a, b));
+      }
+      break;
+    }
+    case SAMPLE_INT24: {
+      if (!(cpuflags & CPUF_SSSE3))
+        break;
+      const __m128 mult = _mm_set1_ps((float)(1<<23));
+      const __m128 lo = _mm_set1_ps((float)-(1<<23)), hi = _mm_set1_ps((float)((1<<23)-1));
+      const __m128i lo_i = _mm_set1_epi32(-(1<<23)), hi_i = _mm_set1_epi32((1<<23)-1);
+      const __m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+      unsigned char* samples = (unsigned char*)outbuf;
+      for (; i + 4 <= count; i += 4) {
+        __m128i r = _mm_shuffle_epi8(saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i), mult), lo, hi, lo_i, hi_i), shuf);
+        _mm_storel_epi64((__m128i*)(samples + i*3), r);
+        *(int*)(samples + i*3 + 8) = _mm_cvtsi128_si32(_mm_srli_si128(r, 8));
+      }
+      break;
+    }
+    case SAMPLE_INT32: {
+      const __m128 mult = _mm_set1_ps((float)((unsigned)(1<<31)));
+      const __m128 lo = _mm_set1_ps(-2147483648.0f), hi = _mm_set1_ps(2147483647.0f);
+      const __m128i lo_i = _mm_set1_epi32((int)0x80000000), hi_i = _mm_set1_epi32(0x7fffffff);
+      int* samples = (int*)outbuf;
+      for (; i + 4 <= count; i += 4) {
+        __m128i r = saturate_round(_mm_mul_ps(_mm_loadu_ps(inbuf + i), mult), lo, hi, lo_i, hi_i);
+        _mm_storeu_si128((__m128i*)(samples + i), r);
+      }
+      break;
+    }
+  }
+  return i;
+}
+
+/*******************************************/
+
 void __stdcall ConvertAudio::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) 
 {
   int channels=vi.AudioChannels();
@@ -292,8 +482,10 @@ void __stdcall ConvertAudio::GetAudio(void* buf, __int64 start, __int64 count, I
     else
 #endif
     {
-      convert24To16(tempbuffer, buf, (int)count*channels);
-	  }
+      const int total = (int)count*channels;
+      const int done = (env->GetCPUFlags() & CPUF_SSSE3) ? convert24To16_SSSE3(tempbuffer, buf, total) : 0;
+      convert24To16(tempbuffer + done*3, (short*)buf + done, total - done);
+    }
 	  return;
   }
   if (src_format == SAMPLE_INT8 && dst_format == SAMPLE_INT16) {
@@ -305,7 +497,9 @@ void __stdcall ConvertAudio::GetAudio(void* buf, __int64 start, __int64 count, I
     else
 #endif
     {
-      convert8To16(tempbuffer, buf, (int)count*channels);
+      const int total = (int)count*channels;
+      const int done = (env->GetCPUFlags() & CPUF_SSE2) ? convert8To16_SSE2(tempbuffer, buf, total) : 0;
+      convert8To16(tempbuffer + done*1, (short*)buf + done, total - done);
     }
 	  return;
   }
@@ -318,7 +512,9 @@ void __stdcall ConvertAudio::GetAudio(void* buf, __int64 start, __int64 count, I
     else
 #endif
     {
-      convert16To8(tempbuffer, buf, (int)count*channels);
+      const int total = (int)count*channels;
+      const int done = (env->GetCPUFlags() & CPUF_SSE2) ? convert16To8_SSE2(tempbuffer, buf, total) : 0;
+      convert16To8(tempbuffer + done*2, (unsigned char*)buf + done, total - done);
     }
 	  return;
   }
@@ -354,7 +550,9 @@ void __stdcall ConvertAudio::GetAudio(void* buf, __int64 start, __int64 count, I
     else
 #endif
     {
-      convertToFloat(tempbuffer, tmp_fb, src_format, (int)count*channels);
+      const int total = (int)count*channels;
+      const int done = (env->GetCPUFlags() & CPUF_SSE2) ? convertToFloat_SIMD(tempbuffer, tmp_fb, src_format, total, env->GetCPUFlags()) : 0;
+      convertToFloat(tempbuffer + done*src_bps, tmp_fb + done, src_format, total - done);
     }
   } else {
     tmp_fb = (float*)tempbuffer;
@@ -379,8 +577,10 @@ void __stdcall ConvertAudio::GetAudio(void* buf, __int64 start, __int64 count, I
     else 
 #endif
     {
-	    convertFromFloat(tmp_fb, buf, dst_format, (int)count*channels);
-	  }
+      const int total = (int)count*channels;
+      const int done = (env->GetCPUFlags() & CPUF_SSE2) ? convertFromFloat_SIMD(tmp_fb, buf, dst_format, total, env->GetCPUFlags()) : 0;
+      convertFromFloat(tmp_fb + done, (char*)buf + done*vi.BytesPerChannelSample(), dst_format, total - done);
+    }
   }
 }
 
@@ -204,7 +204,16 @@ bool __stdcall MTGuard::GetParity(int n)
 
 int __stdcall MTGuard::SetCacheHints(int cachehints, int frame_range)
 {
-  return 0;
+  switch (cachehints)
+  {
+  case CACHE_IS_MTGUARD_REQ:
+    return CACHE_IS_MTGUARD_ANS;
+  case CACHE_DONT_CACHE_ME:
+    // A guarded filter that needs no cache doesn't need one just because it is guarded.
+    return Cache::WantsNoCache(ChildFilters[0]) ? 1 : 0;
+  default:
+    return 0;
+  }
 }
 
 bool __stdcall MTGuard::IsMTGuard(const PClip& p)
@@ -229,6 +238,16 @@ AVSValue MTGuard::Create(std::unique_ptr<const FilterConstructor> funcCtor, IScr
       mode = (MtMode)filter_instance->SetCacheHints(CACHE_GET_MTMODE, 0);
     }*/
 
+    // Filters declaring that they need no caching only re-index or re-label frames
+    // of their child. They are stateless by that contract, so unless the user forced
+    // a mode, don't serialize them behind an MTGuard.
+    if ( !mode_forced
+      && Cache::WantsNoCache(filter_instance)
+      && (filter_instance->SetCacheHints(CACHE_GET_MTMODE, 0) == MT_NICE_FILTER) )
+    {
+      mode = MT_NICE_FILTER;
+    }
+
     switch (mode)
     {
     case MT_NICE_FILTER:
@@ -4,6 +4,9 @@
 #include <avisynth_c.h>
 #include "strings.h"
 #include <cassert>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 typedef const char* (__stdcall *AvisynthPluginInit3Func)(IScriptEnvironment* env, const AVS_Linkage* const vectors);
 typedef const char* (__stdcall *AvisynthPluginInit2Func)(IScriptEnvironment* env);
@@ -335,17 +338,30 @@ bool AVSFunction::ArgNameMatch(const char* param_types, size_t args_names_count,
 */
 
 #include <avs/win.h>
+struct PluginExport
+{
+  std::string Name;
+  std::string Params;
+  std::string ExportVar;            // Empty if the default $PluginFunctions$ was used
+};
+
 struct PluginFile
 {
   std::string FilePath;             // Fully qualified, canonical file path
   std::string BaseName;             // Only file name, without extension
   HMODULE Library;                  // LoadLibrary handle
+  unsigned __int64 WriteTime;       // Last write time, as reported by FindFirstFile
+  unsigned __int64 FileSize;
+  std::vector<PluginExport> Exports;  // Functions registered by the plugin's init function
+  bool InitSideEffects;             // The init function did more than register functions
+  bool ExportsPublished;            // Exports were already announced from the manifest
 
   PluginFile(const std::string &filePath);
 };
 
 PluginFile::PluginFile(const std::string &filePath) : 
-  FilePath(GetFullPathNameWrap(filePath)), BaseName(), Library(NULL)
+  FilePath(GetFullPathNameWrap(filePath)), BaseName(), Library(NULL),
+  WriteTime(0), FileSize(0), InitSideEffects(false), ExportsPublished(false)
 {
   // Turn all '\' into '/'
   replace(FilePath, '\\', '/');
@@ -378,6 +394,150 @@ PluginFile::PluginFile(const std::string &filePath) :
   }
 }
 
+template<typename PluginContainer>
+static const PluginFile* FindPluginFile(const PluginContainer &plugins, const std::string &filePath)
+{
+  for (const PluginFile &plugin : plugins)
+  {
+    if (streqi(plugin.FilePath.c_str(), filePath.c_str()))
+      return &plugin;
+  }
+  return NULL;
+}
+
+/*
+---------------------------------------------------------------------------------
+---------------------------------------------------------------------------------
+                                 PluginManifest
+---------------------------------------------------------------------------------
+---------------------------------------------------------------------------------
+*/
+
+/* The manifest remembers which functions each autoloaded plugin registered, keyed on
+ * the plugin's path, last write time and size. Plugins with a valid manifest entry
+ * are not loaded during autoload. Their functions are announced from the manifest
+ * instead, and the DLL is only loaded once one of them is actually looked up.
+ * Plugins whose init function did anything besides registering functions, such as
+ * setting variables or MT modes, are always loaded, so that these effects happen
+ * at autoload time as before.
+ *
+ * It is a plain text file with tab-separated fields:
+ *   P <path> <write time> <size> <init side effects> <number of functions>
+ *   F <name> <params> <export variable>
+ */
+
+static const char ManifestSignature[] = "AvisynthPluginManifest 2";
+
+struct ManifestEntry
+{
+  unsigned __int64 WriteTime;
+  unsigned __int64 FileSize;
+  bool InitSideEffects;
+  std::vector<PluginExport> Exports;
+};
+
+typedef std::map<std::string,ManifestEntry,StdStriComparer> PluginManifest;
+
+static std::string GetManifestPath()
+{
+  return GetUserDataPath("plugin_manifest.txt");
+}
+
+static void SplitTabs(const std::string &line, std::vector<std::string> *fields)
+{
+  fields->clear();
+  size_t start = 0;
+  for (;;)
+  {
+    size_t tab = line.find('\t', start);
+    fields->push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+    if (tab == std::string::npos)
+      break;
+    start = tab + 1;
+  }
+}
+
+static void ReadManifest(const std::string &path, PluginManifest *manifest)
+{
+  manifest->clear();
+  if (path.empty())
+    return;
+
+  std::ifstream in(path.c_str());
+  std::string line;
+  if (!std::getline(in, line) || (line != ManifestSignature))
+    return;
+
+  std::vector<std::string> fields;
+  while (std::getline(in, line))
+  {
+    SplitTabs(line, &fields);
+    if ((fields.size() != 6) || (fields[0] != "P"))
+      break;
+
+    ManifestEntry entry;
+    entry.WriteTime = _strtoui64(fields[2].c_str(), NULL, 10);
+    entry.FileSize = _strtoui64(fields[3].c_str(), NULL, 10);
+    entry.InitSideEffects = (fields[4] != "0");
+    const size_t nExports = strtoul(fields[5].c_str(), NULL, 10);
+    const std::string filePath = fields[1];
+
+    for (size_t i = 0; i < nExports; ++i)
+    {
+      if (!std::getline(in, line))
+        return;   // Truncated, drop the incomplete entry
+      SplitTabs(line, &fields);
+      if ((fields.size() != 4) || (fields[0] != "F"))
+        return;
+
+      PluginExport exp;
+      exp.Name = fields[1];
+      exp.Params = fields[2];
+      exp.ExportVar = fields[3];
+      entry.Exports.push_back(exp);
+    }
+
+    (*manifest)[filePath] = entry;
+  }
+}
+
+static void WriteManifest(const std::string &path, const PluginManifest &manifest)
+{
+  if (path.empty())
+    return;
+
+  // Many processes may autoload at the same time. Write to a private file
+  // first and move it over the old manifest, so readers never see a partial one.
+  std::ostringstream tmpPath;
+  tmpPath << path << "." << GetCurrentProcessId() << ".tmp";
+
+  {
+    std::ofstream out(tmpPath.str().c_str(), std::ios::out | std::ios::trunc);
+    if (!out)
+      return;
+
+    out << ManifestSignature << "\n";
+    for (const auto& it : manifest)
+    {
+      const ManifestEntry &entry = it.second;
+      out << "P\t" << it.first << "\t" << entry.WriteTime << "\t" << entry.FileSize << "\t"
+          << (entry.InitSideEffects ? 1 : 0) << "\t" << entry.Exports.size() << "\n";
+      for (const PluginExport &exp : entry.Exports)
+        out << "F\t" << exp.Name << "\t" << exp.Params << "\t" << exp.ExportVar << "\n";
+    }
+
+    if (!out)
+    {
+      out.close();
+      DeleteFile(tmpPath.str().c_str());
+      return;
+    }
+  }
+
+  if (!MoveFileEx(tmpPath.str().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    DeleteFile(tmpPath.str().c_str());
+}
+
 /*
 ---------------------------------------------------------------------------------
 ---------------------------------------------------------------------------------
@@ -387,7 +547,7 @@ PluginFile::PluginFile(const std::string &filePath) :
 */
 
 PluginManager::PluginManager(IScriptEnvironment2* env) :
-  Env(env), PluginInLoad(NULL), AutoloadExecuted(false), Autoloading(false)
+  Env(env), PluginInLoad(NULL), AutoloadExecuted(false), Autoloading(false), PublishingExports(false)
 {
   env->SetGlobalVar("$PluginFunctions$", AVSValue(""));
 }
@@ -457,6 +617,24 @@ void PluginManager::AutoloadPlugins()
   const char *binaryFilter = "*.dll";
   const char *scriptFilter = "*.avsi";
 
+  const std::string manifestPath = GetManifestPath();
+  PluginManifest manifest;
+  ReadManifest(manifestPath, &manifest);
+  bool manifestChanged = false;
+
+  // Entries of plugins outside our autoload directories belong to other
+  // configurations, keep them. Entries inside are rebuilt below.
+  PluginManifest newManifest;
+  for (const auto& it : manifest)
+  {
+    const std::string entryDir = it.first.substr(0, it.first.rfind('/') + 1);
+    bool inAutoloadDir = false;
+    for (const std::string& dir : AutoloadDirs)
+      inAutoloadDir |= streqi(entryDir.c_str(), dir.c_str());
+    if (!inAutoloadDir)
+      newManifest.insert(it);
+  }
+
   // Load binary plugins
   for (const std::string& dir : AutoloadDirs)
   {
@@ -486,14 +664,65 @@ void PluginManager::AutoloadPlugins()
           }
         }
 
+        p.WriteTime = ((unsigned __int64)fileData.ftLastWriteTime.dwHighDateTime << 32) | fileData.ftLastWriteTime.dwLowDateTime;
+        p.FileSize = ((unsigned __int64)fileData.nFileSizeHigh << 32) | fileData.nFileSizeLow;
+
+        // After ResetScriptState the plugins of the previous autoload
+        // are still loaded or deferred, don't register them twice.
+        const PluginFile *known = FindPluginFile(AutoLoadedPlugins, p.FilePath);
+        if (known == NULL)
+          known = FindPluginFile(DeferredPlugins, p.FilePath);
+        if (known != NULL)
+        {
+          ManifestEntry entry;
+          entry.WriteTime = known->WriteTime;
+          entry.FileSize = known->FileSize;
+          entry.InitSideEffects = known->InitSideEffects;
+          entry.Exports = known->Exports;
+          newManifest[p.FilePath] = entry;
+          continue;
+        }
+
+        PluginManifest::const_iterator cached = manifest.find(p.FilePath);
+        const bool upToDate = (cached != manifest.end())
+          && (cached->second.WriteTime == p.WriteTime)
+          && (cached->second.FileSize == p.FileSize);
+
+        // Plugins that registered no functions or did more than that in
+        // their init function are loaded every time, for the init's effects.
+        if (upToDate && !cached->second.Exports.empty() && !cached->second.InitSideEffects)
+        {
+          p.Exports = cached->second.Exports;
+          DeferPlugin(p);
+          newManifest.insert(*cached);
+          continue;
+        }
+
         // Try to load plugin
         AVSValue dummy;
-        LoadPlugin(p, false, &dummy);
+        if (LoadPlugin(p, false, &dummy))
+        {
+          ManifestEntry entry;
+          entry.WriteTime = p.WriteTime;
+          entry.FileSize = p.FileSize;
+          entry.InitSideEffects = p.InitSideEffects;
+          entry.Exports = p.Exports;
+          newManifest[p.FilePath] = entry;
+          manifestChanged |= !upToDate || (cached->second.InitSideEffects != p.InitSideEffects);
+        }
       }
     } // for bContinue
     FindClose(hFind);
   }
 
+  // Plugins that were removed or failed to load also invalidate the manifest
+  size_t nOwnEntries = 0;
+  for (const auto& it : manifest)
+    nOwnEntries += (newManifest.find(it.first) != newManifest.end()) ? 1 : 0;
+  manifestChanged |= (nOwnEntries != manifest.size());
+  if (manifestChanged)
+    WriteManifest(manifestPath, newManifest);
+
   // Load script imports
   for (const std::string& dir : AutoloadDirs)
   {
@@ -581,6 +810,10 @@ void PluginManager::UpdateFunctionExports(const char* funcName, const char* func
   if (exportVar == NULL)
     exportVar = "$PluginFunctions$";
 
+  // These are our own variables, not side effects of a plugin's init function
+  const bool wasPublishing = PublishingExports;
+  PublishingExports = true;
+
   // Update $PluginFunctions$
   const char *oldFnList = Env->GetVar(exportVar, "");
   std::string FnList(oldFnList);
@@ -596,6 +829,8 @@ void PluginManager::UpdateFunctionExports(const char* funcName, const char* func
   param_id.append(funcName);
   param_id.append("!Param$");
   Env->SetGlobalVar(Env->SaveString(param_id.c_str(), param_id.size()), AVSValue(Env->SaveString(funcParams)));
+
+  PublishingExports = wasPublishing;
 }
 
 bool PluginManager::LoadPlugin(const char* path, bool throwOnError, AVSValue *result)
@@ -681,28 +916,185 @@ const AVSFunction* PluginManager::Lookup(const FunctionMap& map, const char* sea
 }
 
 const AVSFunction* PluginManager::Lookup(const char* search_name, const AVSValue* args, size_t num_args,
-                    bool strict, size_t args_names_count, const char* const* arg_names) const
+                    bool strict, size_t args_names_count, const char* const* arg_names)
 {
+  // Runtime Invokes look up from prefetch threads, and may load a deferred plugin
+  std::lock_guard<std::recursive_mutex> lock(FunctionsMutex);
+
   /* Lookup in non-autoloaded functions first, so that they take priority */
   const AVSFunction* func = Lookup(ExternalFunctions, search_name, args, num_args, strict, args_names_count, arg_names);
   if (func != NULL)
     return func;
 
-  /* If not found, look amongst the autoloaded */
-  return Lookup(AutoloadedFunctions, search_name, args, num_args, strict, args_names_count, arg_names);
+  /* If not found, look amongst the autoloaded. Should a placeholder of a deferred
+     plugin win, the plugin is loaded and its functions take the placeholders' places. */
+  for (;;)
+  {
+    func = Lookup(AutoloadedFunctions, search_name, args, num_args, strict, args_names_count, arg_names);
+    if ((func == NULL) || (func->apply != NULL))
+      return func;
+    LoadDeferredPlugin(static_cast<PluginFile*>(func->user_data));
+  }
 }
 
 bool PluginManager::FunctionExists(const char* name) const
 {
+    std::lock_guard<std::recursive_mutex> lock(FunctionsMutex);
     bool autoloaded = (AutoloadedFunctions.find(name) != AutoloadedFunctions.end());
     return autoloaded || (ExternalFunctions.find(name) != ExternalFunctions.end());
 }
 
+void PluginManager::PluginInitSideEffect()
+{
+  if ((PluginInLoad != NULL) && !PublishingExports)
+    PluginInLoad->InitSideEffects = true;
+}
+
+void PluginManager::PublishExports(const PluginFile &plugin)
+{
+  for (const PluginExport &exp : plugin.Exports)
+  {
+    const char *exportVar = exp.ExportVar.empty() ? NULL : exp.ExportVar.c_str();
+    const std::string canon_name = concat(plugin.BaseName, "_") + exp.Name;
+    UpdateFunctionExports(exp.Name.c_str(), exp.Params.c_str(), exportVar);
+    UpdateFunctionExports(canon_name.c_str(), exp.Params.c_str(), exportVar);
+  }
+}
+
+static void RemoveScriptFunctions(FunctionMap &map, std::unordered_set<const AVSFunction*> *removed)
+{
+  for (FunctionMap::iterator list_it = map.begin(); list_it != map.end(); )
+  {
+    FunctionList &funcList = list_it->second;
+    for (FunctionList::iterator func_it = funcList.begin(); func_it != funcList.end(); )
+    {
+      if ((*func_it)->IsScriptFunction())
+      {
+        removed->insert(*func_it);
+        func_it = funcList.erase(func_it);
+      }
+      else
+        ++func_it;
+    }
+
+    if (funcList.empty())
+      list_it = map.erase(list_it);
+    else
+      ++list_it;
+  }
+}
+
+void PluginManager::ResetScriptState()
+{
+  // Script functions belong to the script that defined them. Their ScriptFunction
+  // objects were already released by the environment's AtExit handlers.
+  std::unordered_set<const AVSFunction*> script_functions;
+  RemoveScriptFunctions(ExternalFunctions, &script_functions);
+  RemoveScriptFunctions(AutoloadedFunctions, &script_functions);
+  for (const auto& func : script_functions)
+    delete func;
+
+  // Functions of autoloaded .avsi files are script functions too,
+  // so the next autoload must import them again.
+  AutoLoadedImports.clear();
+  AutoloadExecuted = false;
+
+  // The environment rebuilt its global variables, announce the plugin functions again
+  Env->SetGlobalVar("$PluginFunctions$", AVSValue(""));
+  for (const PluginFile &plugin : LoadedPlugins)
+    PublishExports(plugin);
+  for (const PluginFile &plugin : AutoLoadedPlugins)
+    PublishExports(plugin);
+  for (const PluginFile &plugin : DeferredPlugins)
+    PublishExports(plugin);
+}
+
+void PluginManager::DeferPlugin(const PluginFile &plugin)
+{
+  DeferredPlugins.push_back(plugin);
+  PluginFile *deferred = &DeferredPlugins.back();
+  deferred->ExportsPublished = true;
+
+  // Announce the functions just like the plugin would when loaded, but with
+  // placeholders that point back to the plugin instead of an apply function.
+  // They sit among the autoloaded functions where the real ones would have
+  // been registered, so overload priority is the same as when loading eagerly.
+  for (const PluginExport &exp : deferred->Exports)
+  {
+    const char *exportVar = exp.ExportVar.empty() ? NULL : exp.ExportVar.c_str();
+    AVSFunction *placeholder = new AVSFunction(exp.Name.c_str(), deferred->BaseName.c_str(), exp.Params.c_str(), NULL, deferred);
+
+    AutoloadedFunctions[placeholder->name].push_back(placeholder);
+    UpdateFunctionExports(placeholder->name, placeholder->param_types, exportVar);
+    AutoloadedFunctions[placeholder->canon_name].push_back(placeholder);
+    UpdateFunctionExports(placeholder->canon_name, placeholder->param_types, exportVar);
+  }
+}
+
+static bool IsPlaceholderOf(const AVSFunction *func, const PluginFile *plugin)
+{
+  return (func->apply == NULL) && (func->user_data == plugin);
+}
+
+void PluginManager::LoadDeferredPlugin(PluginFile *plugin)
+{
+  std::unordered_set<const AVSFunction*> placeholders;
+  for (const auto& lists : AutoloadedFunctions)
+  {
+    for (const AVSFunction *func : lists.second)
+    {
+      if (IsPlaceholderOf(func, plugin))
+        placeholders.insert(func);
+    }
+  }
+
+  // Load it as if we were still autoloading, so that it ends up among the
+  // autoloaded plugins. AddFunction puts its functions in place of the placeholders.
+  const bool wasAutoloading = Autoloading;
+  Autoloading = true;
+  plugin->Exports.clear();
+  try
+  {
+    AVSValue dummy;
+    LoadPlugin(*plugin, false, &dummy);
+  }
+  catch (...)
+  {
+    Autoloading = wasAutoloading;
+    RemovePlaceholders(plugin, placeholders);
+    throw;
+  }
+  Autoloading = wasAutoloading;
+  RemovePlaceholders(plugin, placeholders);
+}
+
+void PluginManager::RemovePlaceholders(PluginFile *plugin, const std::unordered_set<const AVSFunction*> &placeholders)
+{
+  // Those the plugin did not register again (or all, if it failed to load)
+  for (FunctionMap::iterator list_it = AutoloadedFunctions.begin(); list_it != AutoloadedFunctions.end(); )
+  {
+    FunctionList &funcList = list_it->second;
+    funcList.erase(std::remove_if(funcList.begin(), funcList.end(),
+                     [plugin](const AVSFunction *func) { return IsPlaceholderOf(func, plugin); }),
+                   funcList.end());
+
+    if (funcList.empty())
+      list_it = AutoloadedFunctions.erase(list_it);
+    else
+      ++list_it;
+  }
+  for (const auto& func : placeholders)
+    delete func;
+
+  DeferredPlugins.remove_if([plugin](const PluginFile &p) { return &p == plugin; });
+}
+
 void PluginManager::AddFunction(const char* name, const char* params, IScriptEnvironment::ApplyFunc apply, void* user_data, const char *exportVar)
 {
   if (!IsValidParameterString(params))
     Env->ThrowError("%s has an invalid parameter string (bug in filter)", name);
 
+  std::lock_guard<std::recursive_mutex> lock(FunctionsMutex);
   FunctionMap& functions = Autoloading ? AutoloadedFunctions : ExternalFunctions;
 
   AVSFunction *newFunc = NULL;
@@ -715,14 +1107,47 @@ void PluginManager::AddFunction(const char* name, const char* params, IScriptEnv
       newFunc = new AVSFunction(name, NULL, params, apply, user_data);
       assert(newFunc->IsScriptFunction());
   }
-  functions[newFunc->name].push_back(newFunc);
-  UpdateFunctionExports(newFunc->name, newFunc->param_types, exportVar);
+  // Remember the registration for the plugin manifest
+  if (PluginInLoad != NULL)
+  {
+      PluginExport exp;
+      exp.Name = newFunc->name;
+      exp.Params = newFunc->param_types;
+      exp.ExportVar = (exportVar != NULL) ? exportVar : "";
+      PluginInLoad->Exports.push_back(exp);
+  }
+
+  // Deferred plugins had their functions announced from the manifest already
+  const bool publish = (PluginInLoad == NULL) || !PluginInLoad->ExportsPublished;
+
+  AddToFunctionList(functions[newFunc->name], newFunc);
+  if (publish)
+    UpdateFunctionExports(newFunc->name, newFunc->param_types, exportVar);
 
   if (NULL != newFunc->canon_name)
   {
-      functions[newFunc->canon_name].push_back(newFunc);
-      UpdateFunctionExports(newFunc->canon_name, newFunc->param_types, exportVar);
+      AddToFunctionList(functions[newFunc->canon_name], newFunc);
+      if (publish)
+        UpdateFunctionExports(newFunc->canon_name, newFunc->param_types, exportVar);
+  }
+}
+
+void PluginManager::AddToFunctionList(FunctionList &funcList, const AVSFunction *func)
+{
+  // A deferred plugin being loaded takes the place of its first matching placeholder
+  if ((PluginInLoad != NULL) && PluginInLoad->ExportsPublished)
+  {
+    for (const AVSFunction *&entry : funcList)
+    {
+      if (IsPlaceholderOf(entry, PluginInLoad) && (strcmp(entry->param_types, func->param_types) == 0))
+      {
+        entry = func;
+        return;
+      }
+    }
   }
+
+  funcList.push_back(func);
 }
 
 std::string PluginManager::PluginLoading() const
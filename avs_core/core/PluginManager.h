@@ -4,6 +4,9 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <list>
+#include <mutex>
+#include <unordered_set>
 #include "internal.h"
 
 class IScriptEnvironment2;
@@ -28,15 +31,23 @@ private:
   std::vector<PluginFile> AutoLoadedImports;
   std::vector<PluginFile> AutoLoadedPlugins;
   std::vector<PluginFile> LoadedPlugins;
+  std::list<PluginFile> DeferredPlugins;    // Autoload plugins known from the manifest, not loaded yet
   FunctionMap ExternalFunctions;
-  FunctionMap AutoloadedFunctions;
+  FunctionMap AutoloadedFunctions;          // Also holds placeholders for the functions of DeferredPlugins
   bool AutoloadExecuted;
   bool Autoloading;
+  bool PublishingExports;
+  mutable std::recursive_mutex FunctionsMutex;  // Guards the function maps and the deferred plugins, see Lookup
 
   bool TryAsAvs26(PluginFile &plugin, AVSValue *result);
   bool TryAsAvs25(PluginFile &plugin, AVSValue *result);
   bool TryAsAvsC(PluginFile &plugin, AVSValue *result);
   void UpdateFunctionExports(const char* funcName, const char* funcParams, const char *exportVar);
+  void PublishExports(const PluginFile &plugin);
+  void DeferPlugin(const PluginFile &plugin);
+  void LoadDeferredPlugin(PluginFile *plugin);
+  void RemovePlaceholders(PluginFile *plugin, const std::unordered_set<const AVSFunction*> &placeholders);
+  void AddToFunctionList(FunctionList &funcList, const AVSFunction *func);
   
   const AVSFunction* Lookup(const FunctionMap& map,
     const char* search_name,
@@ -58,6 +69,9 @@ public:
   bool LoadPlugin(const char* path, bool throwOnError, AVSValue *result);
 
   bool HasAutoloadExecuted() const { return AutoloadExecuted; }
+  bool IsLoadingPlugin() const { return PluginInLoad != NULL; }
+  void PluginInitSideEffect();    // Called by the environment when a plugin's init function does more than AddFunction
+  void ResetScriptState();    // Forgets script functions and imports, see ScriptEnvironment::ResetEnvironment
 
   bool FunctionExists(const char* name) const;
   std::string PluginLoading() const;    // Returns the basename of the plugin DLL that is currently being loaded, or NULL if no plugin is being loaded
@@ -68,7 +82,7 @@ public:
     size_t num_args,
     bool strict,
     size_t args_names_count,
-    const char* const* arg_names) const;
+    const char* const* arg_names);
 };
 
 #endif  // AVSCORE_PLUGINS_H
@@ -42,6 +42,19 @@ public:
     core = _core;
   }
 
+  // Forgets the variables of the previous script, see ScriptEnvironment::ResetEnvironment
+  void ResetVars()
+  {
+    while (var_table)
+      PopContext();
+
+    while (global_var_table)
+      PopContextGlobal();
+
+    global_var_table = new VarTable(0, 0);
+    var_table = new VarTable(0, global_var_table);
+  }
+
   /* ---------------------------------------------------------------------------------
    *             T  L  S
    * ---------------------------------------------------------------------------------
@@ -347,6 +360,28 @@ public:
     core->SetPrefetcher(p);
   }
 
+  virtual void __stdcall ResetEnvironment()
+  {
+    core->ResetEnvironment();
+  }
+
+  virtual PVideoFrame __stdcall NewExternalVideoFrame(BYTE* data, int data_size, int pitch, int row_size, int height,
+                                                      int offsetU, int offsetV, int pitchUV, int row_sizeUV, int heightUV,
+                                                      ShutdownFunc release, void* user_data)
+  {
+    return core->NewExternalVideoFrame(data, data_size, pitch, row_size, height, offsetU, offsetV, pitchUV, row_sizeUV, heightUV, release, user_data);
+  }
+
+  virtual PVideoFrame __stdcall InternFrame(const PVideoFrame& frame)
+  {
+    return core->InternFrame(frame);
+  }
+
+  virtual bool __stdcall MakePlanesWritable(PVideoFrame* pvf, int keep_planes)
+  {
+    return core->MakePlanesWritable(pvf, keep_planes);
+  }
+
 
 };
 
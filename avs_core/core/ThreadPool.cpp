@@ -2,6 +2,7 @@
 #include "ScriptEnvironmentTLS.h"
 #include <cassert>
 #include <thread>
+#include <atomic>
 
 struct ThreadPoolGenericItemData
 {
@@ -36,9 +37,10 @@ struct ThreadMessage
 #include "mpmc_bounded_queue.h"
 typedef mpmc_bounded_queue<ThreadMessage> MessageQueue;
 
-static void ThreadFunc(size_t thread_id, MessageQueue *msgQueue)
+static void ThreadFunc(size_t thread_id, MessageQueue *msgQueue, const std::atomic<size_t> *generation)
 {
   ScriptEnvironmentTLS EnvTLS(thread_id);
+  size_t tls_generation = *generation;
 
   bool runThread = true;
   while(runThread)
@@ -56,6 +58,11 @@ static void ThreadFunc(size_t thread_id, MessageQueue *msgQueue)
     case QUEUE_GENERIC_ITEM:
       {
         ThreadPoolGenericItemData &data = msg.GenericWorkItemData;
+        if (tls_generation != *generation)
+        {
+          tls_generation = *generation;
+          EnvTLS.ResetVars();
+        }
         EnvTLS.Specialize(data.Environment);
         if (data.Promise != NULL)
         {
@@ -100,10 +107,12 @@ class ThreadPoolPimpl
 public:
   std::vector<std::thread> Threads;
   MessageQueue MsgQueue;
+  std::atomic<size_t> Generation;   // bumped by ResetThreadState
 
   ThreadPoolPimpl(size_t nThreads) :
     Threads(),
-    MsgQueue(nThreads * 6)
+    MsgQueue(nThreads * 6),
+    Generation(0)
   {}
 };
 
@@ -114,7 +123,7 @@ ThreadPool::ThreadPool(size_t nThreads) :
 
   // i is used as the thread id. Skip id zero because that is reserved for the main thread.
   for (size_t i = 1; i <= nThreads; ++i)
-    _pimpl->Threads.emplace_back(ThreadFunc, i, &(_pimpl->MsgQueue));
+    _pimpl->Threads.emplace_back(ThreadFunc, i, &(_pimpl->MsgQueue), &(_pimpl->Generation));
 }
 
 void ThreadPool::QueueJob(ThreadWorkerFuncPtr clb, void* params, IScriptEnvironment2 *env, JobCompletion *tc)
@@ -132,6 +141,11 @@ void ThreadPool::QueueJob(ThreadWorkerFuncPtr clb, void* params, IScriptEnvironm
   _pimpl->MsgQueue.push_front(ThreadMessage(QUEUE_GENERIC_ITEM, itemData));
 }
 
+void ThreadPool::ResetThreadState()
+{
+  ++(_pimpl->Generation);
+}
+
 size_t ThreadPool::NumThreads() const
 {
   return _pimpl->Threads.size();
@@ -89,6 +89,9 @@ public:
 
   void QueueJob(ThreadWorkerFuncPtr clb, void* params, IScriptEnvironment2 *env, JobCompletion *tc);
   size_t NumThreads() const;
+
+  // Makes every worker drop its thread-local variables before its next job
+  void ResetThreadState();
 };
 
 #endif  // _AVS_THREADPOOL_H
@@ -41,6 +41,12 @@
 #include "../convert/convert_audio.h"
 #include <cstdio>
 #include <new>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <emmintrin.h>
 
 #define BIGBUFFSIZE (2048*1024) // Use a 2Mb buffer for EnsureVBRMP3Sync seeking & Normalize scanning
 
@@ -85,7 +91,7 @@ extern const AVSFunction Audio_filters[] = {
                                 { "AmplifydB", BUILTIN_FUNC_PREFIX, "cf+", Amplify::Create_dB },
                                 { "Amplify", BUILTIN_FUNC_PREFIX, "cf+", Amplify::Create },
                                 { "AssumeSampleRate", BUILTIN_FUNC_PREFIX, "ci", AssumeRate::Create },
-                                { "Normalize", BUILTIN_FUNC_PREFIX, "c[volume]f[show]b", Normalize::Create },
+                                { "Normalize", BUILTIN_FUNC_PREFIX, "c[volume]f[show]b[cache]b", Normalize::Create },
                                 { "MixAudio", BUILTIN_FUNC_PREFIX, "cc[clip1_factor]f[clip2_factor]f", MixAudio::Create },
                                 { "ResampleAudio", BUILTIN_FUNC_PREFIX, "ci[]i", ResampleAudio::Create },
                                 { "ConvertToMono", BUILTIN_FUNC_PREFIX, "c", ConvertToMono::Create },
@@ -830,144 +836,378 @@ AVSValue __cdecl Amplify::Create_dB(AVSValue args, void*, IScriptEnvironment* en
  ***** Supports int16,float******
  ******************************/
 
-Normalize::Normalize(PClip _child, float _max_factor, bool _showvalues) :
+Normalize::Normalize(PClip _child, float _max_factor, bool _showvalues, const std::string& _script_key) :
   GenericVideoFilter(ConvertAudio::Create(_child, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
   max_factor(_max_factor),
   showvalues(_showvalues),
+  script_key(_script_key),
   frameno(0),
   max_volume(-1.0f)
 {
 }
 
 
+// Min and max of int16 samples, start values in *pmin and *pmax
+static void minmax_int16_c(const short* samples, size_t n, int* pmin, int* pmax) {
+  int mn = *pmin, mx = *pmax;
+  for (size_t i = 0; i < n; i++) {
+    mn = min<int>(mn, samples[i]);
+    mx = max<int>(mx, samples[i]);
+  }
+  *pmin = mn;
+  *pmax = mx;
+}
 
-void __stdcall Normalize::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
-  if (max_volume < 0.0f) {
-    // Read samples into buffer and test them
-    if (vi.SampleType() == SAMPLE_INT16) {
-      __int64 bcount = count;
-      short* samples = (short*)buf;
-      bool bigbuff=false;
-
-	  if (vi.BytesFromAudioSamples(count) < BIGBUFFSIZE) {
-	    samples = new(std::nothrow) short[BIGBUFFSIZE/sizeof(short)];
-	    if (samples) {
-	      bigbuff=true;
-	      bcount = vi.AudioSamplesFromBytes(BIGBUFFSIZE);
-	    }
-	    else {
-	      samples = (short*)buf; // malloc failed just reuse clients buffer
-	    }
-	  }
+static void minmax_int16_sse2(const short* samples, size_t n, int* pmin, int* pmax) {
+  __m128i vmin = _mm_set1_epi16((short)*pmin);
+  __m128i vmax = _mm_set1_epi16((short)*pmax);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+    vmin = _mm_min_epi16(vmin, src);
+    vmax = _mm_max_epi16(vmax, src);
+  }
+  short mins[8], maxs[8];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), vmin);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+  minmax_int16_c(mins, 8, pmin, pmax);
+  minmax_int16_c(maxs, 8, pmin, pmax);
+  minmax_int16_c(samples + i, n - i, pmin, pmax);
+}
 
-      const __int64 passes = vi.num_audio_samples / bcount;
-	  __int64 negpeaksampleno=-1, pospeaksampleno=-1;
-      int i_pos_volume = 0;
-      int i_neg_volume = 0;
-      const int chanXbcount = (int)bcount * vi.AudioChannels();
-
-      for (__int64 i = 0; i < passes; i++) {
-        child->GetAudio(samples, bcount*i, bcount, env);
-        for (int j = 0; j < chanXbcount; j++) {
-		  const int sample=samples[j];
-          if (sample < i_neg_volume) {	// Cope with MIN_SHORT
-		    i_neg_volume = sample;
-		    negpeaksampleno = chanXbcount*i+j;
-			if (sample <= -32767) {
-			  i = passes;
-			  break;
-			}
-		  }
-		  else if (sample > i_pos_volume) {
-			i_pos_volume = sample;
-			pospeaksampleno = chanXbcount*i+j;
-			if (sample == 32767) {
-			  i = passes;
-			  break;
-			}
-		  }
-        }
+// Largest absolute value of float samples, at least peak
+static float peak_float_c(const SFLOAT* samples, size_t n, float peak) {
+  for (size_t i = 0; i < n; i++) {
+    const SFLOAT sample = fabsf(samples[i]);
+    if (sample > peak)
+      peak = sample;
+  }
+  return peak;
+}
+
+static float peak_float_sse2(const SFLOAT* samples, size_t n, float peak) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 vpeak = _mm_set1_ps(peak);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    // Source first, so a NaN sample leaves the peak alone
+    vpeak = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i), abs_mask), vpeak);
+  }
+  float peaks[4];
+  _mm_storeu_ps(peaks, vpeak);
+  peak = peak_float_c(peaks, 4, peak);
+  return peak_float_c(samples + i, n - i, peak);
+}
+
+
+// The peak scan reads the clip in blocks of BIGBUFFSIZE bytes. Only the
+// calling thread reads from the child, one batch of blocks after the other,
+// since neither the audio chain below nor its MT guards can take requests
+// from pool threads. The blocks of a batch are then scanned in parallel.
+struct PeakScan {
+  VideoInfo vi;
+  __int64 block_samples;
+  int blocks;
+  bool sse2;
+  std::vector<std::vector<char> > buffers; // One per block of a batch
+  std::vector<int> block_min, block_max;   // SAMPLE_INT16
+  std::vector<float> block_peak;           // SAMPLE_FLOAT
+  std::vector<char> block_done;
+  int first_block, end_block;              // The batch in buffers
+  std::atomic<int> next_block;
+  std::atomic<bool> stop;                  // Full scale was hit
+};
+
+static void ScanPeakBlocks(PeakScan* scan) {
+  const int ch = scan->vi.AudioChannels();
+
+  for (;;) {
+    const int b = scan->next_block++;
+    if (b >= scan->end_block)
+      break;
+
+    const std::vector<char>& buffer = scan->buffers[b - scan->first_block];
+    const __int64 start = b * scan->block_samples;
+    const __int64 count = min(scan->block_samples, scan->vi.num_audio_samples - start);
+
+    const size_t n = (size_t)count * ch;
+    if (scan->vi.SampleType() == SAMPLE_INT16) {
+      int mn = 0, mx = 0;
+      if (scan->sse2)
+        minmax_int16_sse2((const short*)&buffer[0], n, &mn, &mx);
+      else
+        minmax_int16_c((const short*)&buffer[0], n, &mn, &mx);
+      scan->block_min[b] = mn;
+      scan->block_max[b] = mx;
+      if (mn <= -32767 || mx == 32767)   // Can't get any louder
+        scan->stop = true;
+    }
+    else {
+      if (scan->sse2)
+        scan->block_peak[b] = peak_float_sse2((const SFLOAT*)&buffer[0], n, 0.0f);
+      else
+        scan->block_peak[b] = peak_float_c((const SFLOAT*)&buffer[0], n, 0.0f);
+    }
+    scan->block_done[b] = 1;
+  }
+}
+
+static AVSValue ScanPeakJob(IScriptEnvironment2* env, void* data) {
+  ScanPeakBlocks(static_cast<PeakScan*>(data));
+  return AVSValue();
+}
+
+
+// Optional cache of scan results in the user data directory, so the
+// same source does not have to be scanned again each time it is opened.
+static const char* const PEAK_CACHE_HEADER = "AvisynthNormalizePeaks 2";
+enum { PEAK_CACHE_ENTRIES = 1000 };
+
+static void ReadPeakCache(std::vector<std::string>* lines) {
+  const std::string path = GetUserDataPath("normalize_peaks.txt");
+  if (path.empty())
+    return;
+
+  std::ifstream in(path.c_str());
+  std::string line;
+  if (!std::getline(in, line) || (line != PEAK_CACHE_HEADER))
+    return;
+  while (std::getline(in, line)) {
+    if (!line.empty())
+      lines->push_back(line);
+  }
+}
+
+static bool FindPeak(const std::string& fingerprint, float* peak, int* frameno) {
+  std::vector<std::string> lines;
+  ReadPeakCache(&lines);
+
+  const std::string prefix = fingerprint + "\t";
+  for (size_t i = lines.size(); i-- > 0; ) {
+    if (lines[i].compare(0, prefix.size(), prefix) == 0) {
+      std::istringstream fields(lines[i].substr(prefix.size()));
+      if (fields >> *peak >> *frameno)
+        return true;
+    }
+  }
+  return false;
+}
+
+static void StorePeak(const std::string& fingerprint, float peak, int frameno) {
+  const std::string path = GetUserDataPath("normalize_peaks.txt");
+  if (path.empty())
+    return;
+
+  std::vector<std::string> lines;
+  ReadPeakCache(&lines);
+
+  std::ostringstream entry;
+  entry.precision(9);
+  entry << fingerprint << "\t" << peak << "\t" << frameno;
+  lines.push_back(entry.str());
+
+  std::ostringstream tmpPath;
+  tmpPath << path << "." << GetCurrentProcessId() << ".tmp";
+  {
+    std::ofstream out(tmpPath.str().c_str(), std::ios::trunc);
+    if (!out)
+      return;
+    out << PEAK_CACHE_HEADER << "\n";
+    const size_t first = lines.size() > PEAK_CACHE_ENTRIES ? lines.size() - PEAK_CACHE_ENTRIES : 0;
+    for (size_t i = first; i < lines.size(); ++i)
+      out << lines[i] << "\n";
+    if (!out) {
+      out.close();
+      DeleteFile(tmpPath.str().c_str());
+      return;
+    }
+  }
+
+  if (!MoveFileEx(tmpPath.str().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    DeleteFile(tmpPath.str().c_str());
+}
+
+// Identifies the Normalize call for the peak cache: the script file it is
+// in, with its size and modification time, and the position of the call
+// among the cached Normalize calls of that script. Empty if the call is
+// not made from a script file, as nothing then identifies it.
+static std::string PeakScriptKey(IScriptEnvironment* env) {
+  IScriptEnvironment2 *env2 = static_cast<IScriptEnvironment2*>(env);
+
+  AVSValue script;
+  if (!env2->GetVar("$ScriptName$", &script) || !script.IsString())
+    return std::string();
+
+  WIN32_FILE_ATTRIBUTE_DATA attr;
+  if (!GetFileAttributesEx(script.AsString(), GetFileExInfoStandard, &attr))
+    return std::string();
+
+  // The calls are counted per script, so an edit to an imported script
+  // does not shift the positions in the importing one
+  const std::string counter = std::string("$NormalizeCache$") + script.AsString();
+  AVSValue count;
+  const int index = env2->GetVar(counter.c_str(), &count) ? count.AsInt() : 0;
+  env->SetGlobalVar(env->SaveString(counter.c_str()), AVSValue(index + 1));
+
+  const unsigned __int64 size = ((unsigned __int64)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+  const unsigned __int64 mtime = ((unsigned __int64)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+
+  std::ostringstream key;
+  key << script.AsString() << "|" << size << "|" << mtime << "|" << index;
+  return key.str();
+}
+
+// Identifies the audio of the clip for the peak cache: format and length,
+// plus a hash of a few short stretches spread over the clip. Only checked
+// after the script key, it catches a source that changed under the script.
+std::string Normalize::PeakFingerprint(IScriptEnvironment* env) {
+  const int probes = 5;
+  const __int64 probe_samples = min<__int64>(4096, vi.num_audio_samples);
+
+  unsigned __int64 hash = 14695981039346656037ull;   // FNV-1a
+  if (probe_samples > 0) {
+    std::vector<unsigned char> buffer((size_t)vi.BytesFromAudioSamples(probe_samples));
+    for (int i = 0; i < probes; ++i) {
+      const __int64 start = (vi.num_audio_samples - probe_samples) * i / (probes - 1);
+      child->GetAudio(&buffer[0], start, probe_samples, env);
+      for (size_t j = 0; j < buffer.size(); ++j) {
+        hash ^= buffer[j];
+        hash *= 1099511628211ull;
       }
-	  // Remaining samples
-	  if ((i_pos_volume != 32767) && (i_neg_volume > -32767)) {
-		const __int64 rem_samples = vi.num_audio_samples % bcount;
-		const int chanXremcount = (int)rem_samples * vi.AudioChannels();
-
-		child->GetAudio(samples, bcount*passes, rem_samples, env);
-		for (int j = 0; j < chanXremcount; j++) {
-		  const int sample=samples[j];
-		  if (sample < i_neg_volume) {	// Cope with MIN_SHORT
-			i_neg_volume = sample;
-			negpeaksampleno = chanXbcount*passes+j;
-		  }
-		  else if (sample > i_pos_volume) {
-			i_pos_volume = sample;
-			pospeaksampleno = chanXbcount*passes+j;
-		  }
-		}
-	  }
-	  if (bigbuff) delete[] samples;
+    }
+  }
 
-	  i_pos_volume = -i_pos_volume; // Remember -ve has 1 more range than +ve, i.e. -32768
-	  if (i_neg_volume < i_pos_volume) {
-	    i_pos_volume = i_neg_volume;
-	    frameno = vi.FramesFromAudioSamples(negpeaksampleno / vi.AudioChannels());
-	  }
-	  else {
-	    frameno = vi.FramesFromAudioSamples(pospeaksampleno / vi.AudioChannels());
-	  }
-      max_volume = float(i_pos_volume * (-1.0/32768.0));
+  std::ostringstream key;
+  key << vi.SampleType() << " " << vi.AudioChannels() << " " << vi.SamplesPerSecond() << " "
+      << vi.num_audio_samples << " " << std::hex << hash;
+  return key.str();
+}
+
+void Normalize::ScanPeak(IScriptEnvironment* env) {
+  IScriptEnvironment2 *env2 = static_cast<IScriptEnvironment2*>(env);
+
+  std::string fingerprint;
+  if (!script_key.empty()) {
+    fingerprint = script_key + "|" + PeakFingerprint(env);
+    if (FindPeak(fingerprint, &max_volume, &frameno)) {
       max_factor = max_factor / max_volume;
+      return;
+    }
+  }
 
-    } else if (vi.SampleType() == SAMPLE_FLOAT) {  // Float
-      __int64 bcount = count;
-      SFLOAT* samples = (SFLOAT*)buf;
-      bool bigbuff=false;
-
-	  if (vi.BytesFromAudioSamples(count) < BIGBUFFSIZE) {
-	    samples = new(std::nothrow) SFLOAT[BIGBUFFSIZE/sizeof(SFLOAT)];
-	    if (samples) {
-	      bigbuff=true;
-	      bcount = vi.AudioSamplesFromBytes(BIGBUFFSIZE);
-	    }
-	    else {
-	      samples = (SFLOAT*)buf; // malloc failed just reuse clients buffer
-	    }
-	  }
+  PeakScan scan;
+  scan.vi = vi;
+  scan.block_samples = max<__int64>(1, vi.AudioSamplesFromBytes(BIGBUFFSIZE));
+  scan.blocks = (int)((vi.num_audio_samples + scan.block_samples - 1) / scan.block_samples);
+  scan.sse2 = !!(env->GetCPUFlags() & CPUF_SSE2);
+  scan.block_min.resize(scan.blocks);
+  scan.block_max.resize(scan.blocks);
+  scan.block_peak.resize(scan.blocks);
+  scan.block_done.resize(scan.blocks);
+  scan.stop = false;
+
+  // Pool threads help only when called from the main thread, a pool
+  // or prefetch thread waiting for the pool could starve it.
+  size_t helpers = 0;
+  if (env2->GetProperty(AEP_THREAD_ID) == 0)
+    helpers = min<size_t>(env2->GetProperty(AEP_THREADPOOL_THREADS), scan.blocks > 1 ? scan.blocks - 1 : 0);
+
+  const int batch = (int)helpers + 1;
+  scan.buffers.resize(min(batch, scan.blocks));
+  for (size_t i = 0; i < scan.buffers.size(); ++i)
+    scan.buffers[i].resize((size_t)vi.BytesFromAudioSamples(scan.block_samples));
+
+  for (int first = 0; first < scan.blocks && !scan.stop; first += batch) {
+    scan.first_block = first;
+    scan.end_block = min(first + batch, scan.blocks);
+    for (int b = first; b < scan.end_block; ++b) {
+      const __int64 start = b * scan.block_samples;
+      const __int64 count = min(scan.block_samples, vi.num_audio_samples - start);
+      child->GetAudio(&scan.buffers[b - first][0], start, count, env);
+    }
+    scan.next_block = first;
+
+    const size_t jobs = min<size_t>(helpers, scan.end_block - first - 1);
+    IJobCompletion* completion = NULL;
+    if (jobs > 0) {
+      completion = env2->NewCompletion(jobs);
+      for (size_t i = 0; i < jobs; ++i)
+        env2->ParallelJob(ScanPeakJob, &scan, completion);
+    }
+    ScanPeakBlocks(&scan);
+    if (completion != NULL) {
+      completion->Wait();
+      completion->Destroy();
+    }
+  }
 
-      const int chanXbcount = (int)bcount * vi.AudioChannels();
-      const __int64 passes = vi.num_audio_samples / bcount;
-	  __int64 peaksampleno=-1;
-	  
-      for (__int64 i = 0;i < passes;i++) {
-        child->GetAudio(samples, bcount*i, bcount, env);
-        for (int j = 0;j < chanXbcount;j++) {
-		  const SFLOAT sample = fabsf(samples[j]);
-          if (sample > max_volume) {
-		    max_volume = sample;
-			peaksampleno = chanXbcount*i+j;
-		  }
-        }
+  // Combine the blocks, then look up the first sample at the peak for the frame number
+  int peak_block = -1;
+  int peak_value = 0;
+  if (vi.SampleType() == SAMPLE_INT16) {
+    int i_neg_volume = 0, i_pos_volume = 0;
+    for (int b = 0; b < scan.blocks; ++b) {
+      if (scan.block_done[b]) {
+        i_neg_volume = min(i_neg_volume, scan.block_min[b]);
+        i_pos_volume = max(i_pos_volume, scan.block_max[b]);
       }
-      // Remaining samples
-      const __int64 rem_samples = vi.num_audio_samples % bcount;
-      const int chanXremcount = (int)rem_samples * vi.AudioChannels();
-
-      child->GetAudio(samples, bcount*passes, rem_samples, env);
-      for (int j = 0;j < chanXremcount;j++) {
-		const SFLOAT sample = fabsf(samples[j]);
-        if (sample > max_volume) {
-		  max_volume = sample;
-		  peaksampleno = chanXbcount*passes+j;
-		}
+    }
+    // Remember -ve has 1 more range than +ve, i.e. -32768
+    peak_value = (i_neg_volume < -i_pos_volume) ? i_neg_volume : i_pos_volume;
+    max_volume = float(abs(peak_value) * (1.0/32768.0));
+    for (int b = 0; b < scan.blocks && peak_value != 0; ++b) {
+      if (scan.block_done[b] && (scan.block_min[b] == peak_value || scan.block_max[b] == peak_value)) {
+        peak_block = b;
+        break;
+      }
+    }
+  }
+  else {
+    max_volume = 0.0f;
+    for (int b = 0; b < scan.blocks; ++b)
+      max_volume = max(max_volume, scan.block_peak[b]);
+    for (int b = 0; b < scan.blocks && max_volume > 0.0f; ++b) {
+      if (scan.block_peak[b] == max_volume) {
+        peak_block = b;
+        break;
       }
-	  if (bigbuff) delete[] samples;
+    }
+  }
 
-	  frameno = vi.FramesFromAudioSamples(peaksampleno / vi.AudioChannels());
-      max_factor = max_factor / max_volume;
+  frameno = 0;
+  if (peak_block >= 0) {
+    const int ch = vi.AudioChannels();
+    const __int64 start = peak_block * scan.block_samples;
+    const __int64 count = min(scan.block_samples, vi.num_audio_samples - start);
+    std::vector<char> buffer((size_t)vi.BytesFromAudioSamples(count));
+    child->GetAudio(&buffer[0], start, count, env);
+
+    const int n = (int)count * ch;
+    int j = 0;
+    if (vi.SampleType() == SAMPLE_INT16) {
+      const short* samples = (const short*)&buffer[0];
+      while (j < n - 1 && samples[j] != peak_value)
+        j++;
     }
+    else {
+      const SFLOAT* samples = (const SFLOAT*)&buffer[0];
+      while (j < n - 1 && fabsf(samples[j]) != max_volume)
+        j++;
+    }
+    frameno = vi.FramesFromAudioSamples((start * ch + j) / ch);
   }
 
+  max_factor = max_factor / max_volume;
+
+  if (!script_key.empty())
+    StorePeak(fingerprint, max_volume, frameno);
+}
+
+
+void __stdcall Normalize::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
+  if (max_volume < 0.0f)
+    ScanPeak(env);
+
   const int chanXcount = (int)count * vi.AudioChannels();
 
   if (vi.SampleType() == SAMPLE_INT16) {
@@ -1047,7 +1287,8 @@ PVideoFrame __stdcall Normalize::GetFrame(int n, IScriptEnvironment* env) {
 
 AVSValue __cdecl Normalize::Create(AVSValue args, void*, IScriptEnvironment* env) {
 
-  return new Normalize(args[0].AsClip(), (float)args[1].AsFloat(1.0f), args[2].AsBool(false));
+  const std::string script_key = args[3].AsBool(false) ? PeakScriptKey(env) : std::string();
+  return new Normalize(args[0].AsClip(), (float)args[1].AsFloat(1.0f), args[2].AsBool(false), script_key);
 }
 
 
@@ -1174,9 +1415,6 @@ ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_
     : GenericVideoFilter(ConvertAudio::Create(_child, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
       factor(_target_rate_n / (double(_target_rate_d) * vi.audio_samples_per_second))
 {
-  srcbuffer  = 0;
-  fsrcbuffer = 0;
-
   if (vi.audio_samples_per_second == 0) {
     skip_conversion = true;
     return ;
@@ -1250,6 +1488,70 @@ ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_
 
   double dh = min(double(Npc), factor * Npc);  /* Filter sampling period */
   dhb = int(dh * (1 << Na) + 0.5);
+
+  /* Coefficients of both wings for one output sample */
+  max_taps = 2 * ((Nwing << Na) / dhb + 2);
+}
+
+
+// Inner product of the filter coefficients with the source samples of each channel
+static void resample_dot_c(const SFLOAT* coeffs, int taps, const SFLOAT* Xp, int ch, SFLOAT* dst) {
+  for (int q = 0; q < ch; q++) {
+    SFLOAT v = 0;
+    for (int j = 0; j < taps; j++)
+      v += coeffs[j] * Xp[j*ch + q];
+    dst[q] = v;
+  }
+}
+
+static void resample_dot_sse2(const SFLOAT* coeffs, int taps, const SFLOAT* Xp, int ch, SFLOAT* dst) {
+  if (ch == 1) {
+    // 4 taps at once
+    __m128 acc = _mm_setzero_ps();
+    int j = 0;
+    for (; j + 4 <= taps; j += 4)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(coeffs + j), _mm_loadu_ps(Xp + j)));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+    SFLOAT v = _mm_cvtss_f32(acc);
+    for (; j < taps; j++)
+      v += coeffs[j] * Xp[j];
+    dst[0] = v;
+  }
+  else if (ch == 2) {
+    // 2 taps of both channels at once: c0 c0 c1 c1 * L0 R0 L1 R1
+    __m128 acc = _mm_setzero_ps();
+    int j = 0;
+    for (; j + 2 <= taps; j += 2) {
+      __m128 c = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(coeffs + j)));
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_unpacklo_ps(c, c), _mm_loadu_ps(Xp + j*2)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    SFLOAT v[4];
+    _mm_storeu_ps(v, acc);
+    for (; j < taps; j++) {
+      v[0] += coeffs[j] * Xp[j*2];
+      v[1] += coeffs[j] * Xp[j*2 + 1];
+    }
+    dst[0] = v[0];
+    dst[1] = v[1];
+  }
+  else {
+    // 4 channels at once, the rest one by one
+    int q = 0;
+    for (; q + 4 <= ch; q += 4) {
+      __m128 acc = _mm_setzero_ps();
+      for (int j = 0; j < taps; j++)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(coeffs[j]), _mm_loadu_ps(Xp + j*ch + q)));
+      _mm_storeu_ps(dst + q, acc);
+    }
+    for (; q < ch; q++) {
+      SFLOAT v = 0;
+      for (int j = 0; j < taps; j++)
+        v += coeffs[j] * Xp[j*ch + q];
+      dst[q] = v;
+    }
+  }
 }
 
 
@@ -1261,37 +1563,20 @@ void __stdcall ResampleAudio::GetAudio(void* buf, __int64 start, __int64 count,
   __int64 src_start = __int64(((long double)start           / factor) * (1 << Np) + 0.5);
   __int64 src_end   = __int64(((long double)(start + count) / factor) * (1 << Np) + 0.5);
   const __int64 source_samples = ((src_end - src_start) >> Np) + 2 * Xoff + 1;
-  const int source_bytes = (int)vi.BytesFromAudioSamples(source_samples);
 
   __int64 pos = (int(src_start & Pmask)) + (Xoff << Np);
   int ch = vi.AudioChannels();
   unsigned dtberror = 0;
 
-  if (vi.IsSampleType(SAMPLE_INT16)) {
-
-	if (!srcbuffer || source_bytes > srcbuffer_size) {
-		delete[] srcbuffer;
-	  srcbuffer = new short[source_bytes >> 1];
-	  srcbuffer_size = source_bytes;
-	  last_samples= 0;
-	  last_start = 0;
-	}
-
-	const int offset = int((src_start >> Np) - Xoff - last_start);  // Difference from last time
-	last_start = (src_start >> Np) - Xoff;                          // Start for next time
-	
-	int overlap = int(last_samples - offset);                       // How many samples already fetched
-	if ((offset < 0) || (overlap <= 0))                             // Is there any overlap?
-	  overlap = 0;
-	else if (offset*ch >= 2)  // Assume 32bit separation is okay    // Yes, copy to start of buffer
-	  memcpy(srcbuffer, srcbuffer+offset*ch, overlap*ch<<1);  // fast
-	else if (offset > 0)
-	  memmove(srcbuffer, srcbuffer+offset*ch, overlap*ch<<1); // slow
+  // Everything lives on this call, no history is kept in the instance. Several
+  // threads can render different ranges at once, the price is fetching the
+  // 2*Xoff samples of filter reach again on sequential requests.
+  const __int64 src_first = (src_start >> Np) - Xoff;
 
-	last_samples= max<__int64>(overlap, source_samples);                     // Samples for next time
+  if (vi.IsSampleType(SAMPLE_INT16)) {
 
-    if (source_samples-overlap > 0)                                 // Get the rest of the source samples
-	  child->GetAudio(&srcbuffer[overlap*ch], last_start+overlap, source_samples-overlap, env);
+	std::vector<short> srcbuffer((size_t)(source_samples * ch));
+	child->GetAudio(&srcbuffer[0], src_first, source_samples, env);
 
 	short* dst = (short*)buf;
 
@@ -1386,23 +1671,21 @@ nofix:
 	else
 #endif // X86_32
   {
+	  std::vector<int> coeffs(max_taps);
+
 	  while (dst < dst_end) {
+		int first;
+		const int taps = MakeCoeffs(&coeffs[0], pos, &first);        /* Shared by all channels */
+		const short* Xp = &srcbuffer[((pos >> Np) - first) * ch];
+
 		for (int q = 0; q < ch; q++) {
-		  short* Xp = &srcbuffer[(pos >> Np) * ch];
-#if 1
-		  __int64 v64 = FilterUD(Xp + q, (short)(pos & Pmask), - ch);  /* Perform left-wing inner product  */
-		  v64 += FilterUD(Xp + ch + q, (short)(( -pos) & Pmask), ch);  /* Perform right-wing inner product */
-          v64 += 1 << (Nh - 1);                                        /* Round only once!                 */
+		  __int64 v64 = 0;
+		  for (int j = 0; j < taps; j++)                             /* Inner product of both wings      */
+			v64 += coeffs[j] * Xp[j*ch + q];
+		  v64 += 1 << (Nh - 1);                                        /* Round only once!                 */
 		  int v32 = int(v64 >> Nh);                                    /* Make guard bits once!            */
 		  v32 *= LpScl;                                                /* Normalize for unity filter gain  */
 		  *dst++ = IntToShort(v32, NLpScl);                            /* strip guard bits, deposit output */
-#else
-		  int v = FilterUD(Xp + q, (short)(pos & Pmask), - ch);  /* Perform left-wing inner product */
-		  v += FilterUD(Xp + ch + q, (short)(( -pos) & Pmask), ch);  /* Perform right-wing inner product */
-		  v >>= Nhg;      /* Make guard bits */
-		  v *= LpScl;     /* Normalize for unity filter gain */
-		  *dst++ = IntToShort(v, NLpScl);   /* strip guard bits, deposit output */
-#endif
 		}
 		if ((dtberror += dtbe) >= (1 << 31)) { // Don't be a creep ;-)
 		  dtberror -= (1 << 31);
@@ -1416,38 +1699,25 @@ nofix:
   }
   else { // SAMPLE_FLOAT
 
-	if (!fsrcbuffer || source_bytes > srcbuffer_size) {
-		delete[] fsrcbuffer;
-	  fsrcbuffer = new SFLOAT[source_bytes >> 2];
-	  srcbuffer_size = source_bytes;
-	  last_samples= 0;
-	  last_start = 0;
-	}
-
-	const int offset = int((src_start >> Np) - Xoff - last_start);
-	last_start = (src_start >> Np) - Xoff;
-	
-	int overlap = int(last_samples - offset);
-	if ((offset < 0) || (overlap <= 0))
-	  overlap = 0;
-	else if (offset > 0)
-	  memcpy(fsrcbuffer, fsrcbuffer+offset*ch, overlap*ch<<2);
-	last_samples= max<__int64>(overlap, source_samples);
+	std::vector<SFLOAT> fsrcbuffer((size_t)(source_samples * ch));
+	child->GetAudio(&fsrcbuffer[0], src_first, source_samples, env);
 
-    if (source_samples-overlap > 0)
-	  child->GetAudio(&fsrcbuffer[overlap*ch], last_start+overlap, source_samples-overlap, env);
+	std::vector<SFLOAT> coeffs(max_taps);
+	const bool sse2 = !!(env->GetCPUFlags() & CPUF_SSE2);
 
 	SFLOAT* dst = (SFLOAT*)buf;
 
 	SFLOAT* dst_end = &dst[count * ch];
 
 	while (dst < dst_end) {
-	  for (int q = 0; q < ch; q++) {
-		SFLOAT* Xp = &fsrcbuffer[(pos >> Np) * ch];
-		SFLOAT v = FilterUD(Xp +      q, (short)(   pos  & Pmask), - ch);  /* Perform left-wing inner product */
-		v       += FilterUD(Xp + ch + q, (short)(( -pos) & Pmask),   ch);  /* Perform right-wing inner product */
-		*dst++ = v;     /* deposit output */
-	  }
+	  int first;
+	  const int taps = MakeCoeffs(&coeffs[0], pos, &first);   /* Shared by all channels */
+	  const SFLOAT* Xp = &fsrcbuffer[((pos >> Np) - first) * ch];
+	  if (sse2)
+		resample_dot_sse2(&coeffs[0], taps, Xp, ch, dst);
+	  else
+		resample_dot_c(&coeffs[0], taps, Xp, ch, dst);
+	  dst += ch;     /* deposit output */
 	  if ((dtberror += dtbe) >= (1 << 31)) { // Don't be a creep ;-)
 		dtberror -= (1 << 31);
 		pos += dtb + 1;   /* Move to next sample by time increment + error adjustment */
@@ -1531,64 +1801,68 @@ donone:
 #endif // X86_32
 
 
-// FilterUD SAMPLE_INT16 Version
-__int64 ResampleAudio::FilterUD(short *Xp, short Ph, short Inc) {
-  __int64 v = 0;
+// Interpolated filter coefficients for the output sample at pos, SAMPLE_INT16 Version.
+// They are stored in the order of the source samples they apply to, starting
+// with sample (pos >> Np) - *first. Returns the number of coefficients.
+int ResampleAudio::MakeCoeffs(int *coeffs, __int64 pos, int *first) const {
+  int n = 0;
+
+  /* Left wing, walks backwards from sample (pos >> Np) */
+  unsigned Ph = unsigned(pos & Pmask);
   unsigned Ho = (Ph * (unsigned)dhb) >> Np;
-  unsigned End = Nwing;
-
-  if (Inc > 0)          /* If doing right wing...              */
-  {                     /* ...drop extra coeff, so when Ph is  */
-    End--;              /*    0.5, we don't do too many mult's */
-    if (Ph == 0)        /* If the phase is zero...             */
-      Ho += dhb;        /* ...then we've already skipped the   */
-  }                     /*    first sample, so we must also    */
-                        /*    skip ahead in Imp[] and ImpD[]   */
-  while ((Ho >> Na) < End) {
+  while ((Ho >> Na) < Nwing) {
     int t = Imp[Ho >> Na];                              /* Get IR sample */
-#if 1
-	// It's 37% faster and more accurate to accumulate 64 bits
-	// than stuffing around testing, rounding and shifting
     const int a = Ho & Amask;                           /* a is logically between 0 and 1 */
     const int r = 1 << (Na-1);                          /* Round */
     t += ((int(Imp[(Ho>>Na)+1]) - t) * a + r) >> Na;    /* t is now interp'd filter coeff */
-    t *= *Xp;                                           /* Mult coeff by input sample */
-#else
-    int a = Ho & Amask;   /* a is logically between 0 and 1 */
-    t += ((int(Imp[(Ho >> Na) + 1]) - t) * a) >> Na; /* t is now interp'd filter coeff */
-    t *= *Xp;     /* Mult coeff by input sample */
-    if (t & 1 << (Nhxn - 1))  /* Round, if needed */
-      t += 1 << (Nhxn - 1);
-    t >>= Nhxn;       /* Leave some guard bits, but come back some */
-#endif
-    v += t;           /* The filter output */
-    Ho += dhb;        /* IR step */
-    Xp += Inc;        /* Input signal step. NO CHECK ON BOUNDS */
+    coeffs[n++] = t;
+    Ho += dhb;                                          /* IR step */
   }
-  return (v);
+  std::reverse(coeffs, coeffs + n);
+  *first = n - 1;
+
+  /* Right wing, starts at sample (pos >> Np) + 1 */
+  Ph = unsigned(-pos) & Pmask;
+  Ho = (Ph * (unsigned)dhb) >> Np;
+  if (Ph == 0)          /* If the phase is zero we've already skipped the */
+    Ho += dhb;          /* first sample, so we must also skip ahead in Imp[] */
+  while ((Ho >> Na) < Nwing - 1) {  /* Drop extra coeff, so when Ph is 0.5 we don't do too many mult's */
+    int t = Imp[Ho >> Na];
+    const int a = Ho & Amask;
+    const int r = 1 << (Na-1);
+    t += ((int(Imp[(Ho>>Na)+1]) - t) * a + r) >> Na;
+    coeffs[n++] = t;
+    Ho += dhb;
+  }
+  return n;
 }
 
-// FilterUD SAMPLE_FLOAT Version  -- Approx same speed as new int16 and SSRC on P4 (40% on P2)
-SFLOAT ResampleAudio::FilterUD(SFLOAT *Xp, short Ph, short Inc) {
-  SFLOAT v = 0;
+// SAMPLE_FLOAT Version
+int ResampleAudio::MakeCoeffs(SFLOAT *coeffs, __int64 pos, int *first) const {
+  int n = 0;
+
+  unsigned Ph = unsigned(pos & Pmask);
   unsigned Ho = (Ph * (unsigned)dhb) >> Np;
-  unsigned End = Nwing;
-  if (Inc > 0)        /* If doing right wing...              */
-  {                   /* ...drop extra coeff, so when Ph is  */
-    End--;            /*    0.5, we don't do too many mult's */
-    if (Ph == 0)      /* If the phase is zero...             */
-      Ho += dhb;      /* ...then we've already skipped the   */
-  }                   /*    first sample, so we must also    */
-                      /*    skip ahead in fImp[]             */
-  while ((Ho >> Na) < End) {
+  while ((Ho >> Na) < Nwing) {
     SFLOAT t = fImp[Ho >> Na];      /* Get IR sample */
     t += (fImp[(Ho >> Na) + 1] - t) * fAmasktab[Ho & Amask]; /* t is now interpolated filter coeff */
-    t *= *Xp;         /* Mult coeff by input sample */
-    v += t;           /* The filter output */
-    Ho += dhb;        /* IR step */
-    Xp += Inc;        /* Input signal step. NO CHECK ON BOUNDS */
+    coeffs[n++] = t;
+    Ho += dhb;
+  }
+  std::reverse(coeffs, coeffs + n);
+  *first = n - 1;
+
+  Ph = unsigned(-pos) & Pmask;
+  Ho = (Ph * (unsigned)dhb) >> Np;
+  if (Ph == 0)
+    Ho += dhb;
+  while ((Ho >> Na) < Nwing - 1) {
+    SFLOAT t = fImp[Ho >> Na];
+    t += (fImp[(Ho >> Na) + 1] - t) * fAmasktab[Ho & Amask];
+    coeffs[n++] = t;
+    Ho += dhb;
   }
-  return (v);
+  return n;
 }
 
 
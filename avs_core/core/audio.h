@@ -36,6 +36,7 @@
 
 #include <avisynth.h>
 #include <cmath>
+#include <string>
 
 
 
@@ -258,7 +259,7 @@ class Normalize : public GenericVideoFilter
  **/
 {
 public:
-  Normalize(PClip _child, float _max_factor, bool _showvalues);
+  Normalize(PClip _child, float _max_factor, bool _showvalues, const std::string& _script_key);
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
 
@@ -266,10 +267,14 @@ public:
 
 
 private:
+  void ScanPeak(IScriptEnvironment* env);
+  std::string PeakFingerprint(IScriptEnvironment* env);
+
   float max_factor;
   float max_volume;
   int   frameno;
   bool showvalues;
+  std::string script_key;   // Empty if the peak is not cached
 };
 
 class MixAudio : public GenericVideoFilter
@@ -301,9 +306,6 @@ class ResampleAudio : public GenericVideoFilter
 {
 public:
   ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_d, IScriptEnvironment* env);
-  virtual ~ResampleAudio()
-    { delete[]  srcbuffer;
-      delete[] fsrcbuffer; }
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
 
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
@@ -311,23 +313,18 @@ public:
   enum { Nwing = 8192, Nmult = 65 };   // Number of filter points, (Nwing>>Nhc)*2+1
 
 private:
-  __int64 FilterUD(short  *Xp, short Ph, short Inc);
-  SFLOAT  FilterUD(SFLOAT *Xp, short Ph, short Inc);
+  int MakeCoeffs(int    *coeffs, __int64 pos, int *first) const;
+  int MakeCoeffs(SFLOAT *coeffs, __int64 pos, int *first) const;
 
   const double factor;
   int Xoff, dtb, dhb;
   unsigned dtbe;
+  int max_taps;
 
   int LpScl, mLpScl, mNhg;
 
-  short*   srcbuffer;
-  SFLOAT* fsrcbuffer;
-
-  int srcbuffer_size;
   bool skip_conversion;
 
-  __int64 last_start, last_samples;
-
   union { // Share storage
 	SFLOAT fImp[Nwing+1];
 	short Imp[Nwing+1];
@@ -261,7 +261,8 @@ void* VideoFrame::operator new(size_t size) {
 
 VideoFrame::VideoFrame(VideoFrameBuffer* _vfb, int _offset, int _pitch, int _row_size, int _height)
   : refcount(0), vfb(_vfb), offset(_offset), pitch(_pitch), row_size(_row_size), height(_height),
-    offsetU(_offset),offsetV(_offset),pitchUV(0), row_sizeUV(0), heightUV(0)  // PitchUV=0 so this doesn't take up additional space
+    offsetU(_offset),offsetV(_offset),pitchUV(0), row_sizeUV(0), heightUV(0),  // PitchUV=0 so this doesn't take up additional space
+    constant_period(0), constant_sequence(0)
 {
   InterlockedIncrement(&vfb->refcount);
 }
@@ -269,7 +270,8 @@ VideoFrame::VideoFrame(VideoFrameBuffer* _vfb, int _offset, int _pitch, int _row
 VideoFrame::VideoFrame(VideoFrameBuffer* _vfb, int _offset, int _pitch, int _row_size, int _height,
                        int _offsetU, int _offsetV, int _pitchUV, int _row_sizeUV, int _heightUV)
   : refcount(0), vfb(_vfb), offset(_offset), pitch(_pitch), row_size(_row_size), height(_height),
-    offsetU(_offsetU),offsetV(_offsetV),pitchUV(_pitchUV), row_sizeUV(_row_sizeUV), heightUV(_heightUV)
+    offsetU(_offsetU),offsetV(_offsetV),pitchUV(_pitchUV), row_sizeUV(_row_sizeUV), heightUV(_heightUV),
+    constant_period(0), constant_sequence(0)
 {
   InterlockedIncrement(&vfb->refcount);
 }
@@ -329,6 +331,15 @@ VideoFrameBuffer::VideoFrameBuffer(int size) :
 #endif
 }
 
+VideoFrameBuffer::VideoFrameBuffer(BYTE* external_data, int size) :
+  refcount(0),
+  data(external_data),
+  data_size(size),
+  sequence_number(0)
+{
+  InterlockedIncrement(&sequence_number);
+}
+
 VideoFrameBuffer::~VideoFrameBuffer() {
 //  _ASSERTE(refcount == 0);
   InterlockedIncrement(&sequence_number); // HACK : Notify any children with a pointer, this buffer has changed!!!
@@ -350,9 +361,14 @@ public:
   StringDump() : current_block(0), block_pos(BLOCK_SIZE), block_size(BLOCK_SIZE) {}
   ~StringDump();
   char* SaveString(const char* s, int len = -1);
+  void Clear();
 };
 
 StringDump::~StringDump() {
+  Clear();
+}
+
+void StringDump::Clear() {
   _RPT0(0,"StringDump: DeAllocating all stringblocks.\r\n");
   char* p = current_block;
   while (p) {
@@ -360,6 +376,8 @@ StringDump::~StringDump() {
     delete[] p;
     p = next;
   }
+  current_block = 0;
+  block_pos = block_size = BLOCK_SIZE;
 }
 
 char* StringDump::SaveString(const char* s, int len) {
@@ -561,6 +579,12 @@ public:
   virtual size_t  __stdcall GetProperty(AvsEnvProperty prop);
   virtual void* __stdcall Allocate(size_t nBytes, size_t alignment, AvsAllocType type);
   virtual void __stdcall Free(void* ptr);
+  virtual void __stdcall ResetEnvironment();
+  virtual PVideoFrame __stdcall NewExternalVideoFrame(BYTE* data, int data_size, int pitch, int row_size, int height,
+                                                      int offsetU, int offsetV, int pitchUV, int row_sizeUV, int heightUV,
+                                                      ShutdownFunc release, void* user_data);
+  virtual PVideoFrame __stdcall InternFrame(const PVideoFrame& frame);
+  virtual bool __stdcall MakePlanesWritable(PVideoFrame* pvf, int keep_planes);
 
 private:
 
@@ -568,12 +592,17 @@ private:
   // Note order here!!
   // AtExiter has functions which
   // rely on StringDump elements.
+  // The script_ variants hold what the current script created,
+  // they are dropped by ResetEnvironment. The others hold what
+  // plugins created while being loaded.
   StringDump string_dump;
+  StringDump script_string_dump;
   std::mutex string_mutex;
   char * vsprintf_buf;
   size_t vsprintf_len;
 
   AtExiter at_exit;
+  AtExiter script_at_exit;
   ThreadPool * thread_pool;
 
   PluginManager *plugin_manager;
@@ -586,10 +615,15 @@ private:
   const AVSFunction* Lookup(const char* search_name, const AVSValue* args, size_t num_args,
                       bool &pstrict, size_t args_names_count, const char* const* arg_names);
   void EnsureMemoryLimit(size_t request);
+  void AddDefaultAutoloadDirs();
   unsigned __int64 memory_max;
+  unsigned __int64 base_memory_max;  // memory_max of a new environment, restored by ResetEnvironment
+  std::string saved_working_dir;     // Working directory before the script's first SetWorkingDir, restored by ResetEnvironment
   std::atomic<unsigned __int64> memory_used;
 
   void ExportBuiltinFilters();
+  void InitGlobalVars();
+  StringDump& CurrentStringDump();
 
   IScriptEnvironment2* This() { return this; }
   bool PlanarChromaAlignmentState;
@@ -608,9 +642,33 @@ private:
   VideoFrame* AllocateFrame(size_t vfb_size);
   std::mutex memory_mutex;
 
+  // Frames over memory owned by someone else, see NewExternalVideoFrame.
+  // The registry holds one reference on each buffer, so none is ever writable.
+  // Subframes of such a buffer are kept here as views rather than in FrameRegistry,
+  // they must go away together with the buffer.
+  struct ExternalFrame {
+    VideoFrame* frame;
+    std::vector<VideoFrame*> views;
+    ShutdownFunc release;
+    void* user_data;
+  };
+  std::vector<ExternalFrame> ExternalFrameRegistry;
+  void ReleaseExternalFrames(bool all);
+  void RegisterSubframe(VideoFrame* subframe);
+
+  // Frames handed out by InternFrame. The registry holds one reference on each,
+  // an entry goes away once it holds the only one.
+  struct InternedFrame {
+    unsigned hash;
+    PVideoFrame frame;
+  };
+  std::vector<InternedFrame> InternedFrameRegistry;
+  std::mutex intern_mutex;
+
   BufferPool BufferPool;
 
   MTMapState MTMap;
+  MTMapState BaseMTMap;         // MTMap without the modes scripts set, restored by ResetEnvironment
   typedef std::vector<MTGuard*> MTGuardRegistryType;
   MTGuardRegistryType MTGuardRegistry;
   Prefetcher *prefetcher;
@@ -686,27 +744,16 @@ ScriptEnvironment::ScriptEnvironment()
     GlobalMemoryStatusEx(&memstatus);
     memory_max = ConstrainMemoryRequest(memstatus.ullTotalPhys / 4);
     memory_max = min(memory_max, 1024*1024*1024ull);  // at start, cap memory usage to 1GB
+    base_memory_max = memory_max;
     memory_used = 0ull;
 
-    global_var_table = new VarTable(0, 0);
-    var_table = new VarTable(0, global_var_table);
-    global_var_table->Set("true", true);
-    global_var_table->Set("false", false);
-    global_var_table->Set("yes", true);
-    global_var_table->Set("no", false);
-    global_var_table->Set("last", AVSValue());
-
-    global_var_table->Set("$ScriptName$", AVSValue());
-    global_var_table->Set("$ScriptFile$", AVSValue());
-    global_var_table->Set("$ScriptDir$",  AVSValue());
+    InitGlobalVars();
 
     plugin_manager = new PluginManager(this);
-    plugin_manager->AddAutoloadDir("USER_PLUS_PLUGINS", false);
-    plugin_manager->AddAutoloadDir("MACHINE_PLUS_PLUGINS", false);
-    plugin_manager->AddAutoloadDir("USER_CLASSIC_PLUGINS", false);
-    plugin_manager->AddAutoloadDir("MACHINE_CLASSIC_PLUGINS", false);
+    AddDefaultAutoloadDirs();
 
     InitMT();
+    BaseMTMap = MTMap;
     thread_pool = new ThreadPool(std::thread::hardware_concurrency());
 
     ExportBuiltinFilters();
@@ -722,17 +769,32 @@ ScriptEnvironment::ScriptEnvironment()
   }
 }
 
-void ScriptEnvironment::InitMT()
+void ScriptEnvironment::InitGlobalVars()
 {
+    global_var_table = new VarTable(0, 0);
+    var_table = new VarTable(0, global_var_table);
+    global_var_table->Set("true", true);
+    global_var_table->Set("false", false);
+    global_var_table->Set("yes", true);
+    global_var_table->Set("no", false);
+    global_var_table->Set("last", AVSValue());
+
+    global_var_table->Set("$ScriptName$", AVSValue());
+    global_var_table->Set("$ScriptFile$", AVSValue());
+    global_var_table->Set("$ScriptDir$",  AVSValue());
+
     global_var_table->Set("MT_NICE_FILTER", (int)MT_NICE_FILTER);
     global_var_table->Set("MT_MULTI_INSTANCE", (int)MT_MULTI_INSTANCE);
     global_var_table->Set("MT_SERIALIZED", (int)MT_SERIALIZED);
+}
 
-    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AVISource", MtMode::MT_SERIALIZED, true);
-    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AVIFileSource", MtMode::MT_SERIALIZED, true);
-    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_WAVSource", MtMode::MT_SERIALIZED, true);
-    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_OpenDMLSource", MtMode::MT_SERIALIZED, true);
-    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AVISource", MtMode::MT_SERIALIZED, true);
+void ScriptEnvironment::InitMT()
+{
+    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AVISource", MtMode::MT_NICE_FILTER, true);
+    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AVIFileSource", MtMode::MT_NICE_FILTER, true);
+    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_WAVSource", MtMode::MT_NICE_FILTER, true);
+    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_OpenDMLSource", MtMode::MT_NICE_FILTER, true);
+    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AVISource", MtMode::MT_NICE_FILTER, true);
 
     this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_ChangeFPS", MtMode::MT_SERIALIZED, true);
     this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_ConvertFPS", MtMode::MT_NICE_FILTER, true);
@@ -756,6 +818,7 @@ void ScriptEnvironment::InitMT()
     this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_UnalignedSplice", MtMode::MT_NICE_FILTER, true);
     this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AlignedSplice", MtMode::MT_NICE_FILTER, true);
     this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AudioDub", MtMode::MT_NICE_FILTER, true);
+    this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_ResampleAudio", MtMode::MT_NICE_FILTER, true);
 
     this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_Trim", MtMode::MT_NICE_FILTER, true);
     this->SetFilterMTMode(BUILTIN_FUNC_PREFIX "_AudioTrim", MtMode::MT_NICE_FILTER, true);
@@ -863,6 +926,7 @@ ScriptEnvironment::~ScriptEnvironment() {
 
   // Before we start to pull the world apart
   // give every one their last wish.
+  script_at_exit.Execute(this);
   at_exit.Execute(this);
 
   delete thread_pool;
@@ -873,6 +937,9 @@ ScriptEnvironment::~ScriptEnvironment() {
   while (global_var_table)
     PopContextGlobal();
 
+  InternedFrameRegistry.clear();
+  ReleaseExternalFrames(true);
+
   // We collect a list of allocated VFBs here
   std::unordered_set<VideoFrameBuffer*> vfb_set;
   vfb_set.reserve(FrameRegistry.size());
@@ -950,6 +1017,8 @@ void __stdcall ScriptEnvironment::SetFilterMTMode(const char* filter, MtMode mod
   assert(NULL != filter);
   assert("" != filter);
 
+  plugin_manager->PluginInitSideEffect();
+
   std::string name_to_register;
   std::string loading = plugin_manager->PluginLoading();
   if (loading.empty())
@@ -958,6 +1027,10 @@ void __stdcall ScriptEnvironment::SetFilterMTMode(const char* filter, MtMode mod
       name_to_register = loading.append("_").append(filter);
 
   MTMap.SetMode(name_to_register, mode, force);
+
+  // Modes plugins set while loading stay with the plugin, which outlives ResetEnvironment
+  if (!loading.empty())
+    BaseMTMap.SetMode(name_to_register, mode, force);
 }
 
 MtMode __stdcall ScriptEnvironment::GetFilterMTMode(const AVSFunction* filter, bool* is_forced) const
@@ -989,6 +1062,62 @@ void __stdcall ScriptEnvironment::Free(void* ptr)
   BufferPool.Free(ptr);
 }
 
+void __stdcall ScriptEnvironment::ResetEnvironment()
+{
+  // The graph is owned by the variables (and by the host, which must have
+  // released its clips already). Shut down everything the script created
+  // the same way the destructor would.
+  script_at_exit.Execute(this);
+
+  while (var_table)
+    PopContext();
+
+  while (global_var_table)
+    PopContextGlobal();
+
+  prefetcher = NULL;
+  ImportDepth = 0;
+  PlanarChromaAlignmentState = true;
+  MTMap = BaseMTMap;
+
+  // Worker threads keep their own variables, they drop them before their next job
+  thread_pool->ResetThreadState();
+
+  {
+    std::lock_guard<std::mutex> lock(string_mutex);
+    script_string_dump.Clear();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(intern_mutex);
+    InternedFrameRegistry.clear();
+  }
+
+  // Settings the script may have changed go back to those of a new environment.
+  // Autoload directories added by the host must be added again, just as for a new one.
+  memory_max = base_memory_max;
+  if (!saved_working_dir.empty()) {
+    SetCurrentDirectory(saved_working_dir.c_str());
+    saved_working_dir.clear();
+  }
+
+  // Rebuild the globals. Plugins with the MT modes they set, the thread
+  // pool and the frame buffers in FrameRegistry and BufferPool are kept.
+  InitGlobalVars();
+  plugin_manager->ResetScriptState();
+  plugin_manager->ClearAutoloadDirs();
+  AddDefaultAutoloadDirs();
+  ExportBuiltinFilters();
+}
+
+void ScriptEnvironment::AddDefaultAutoloadDirs()
+{
+  plugin_manager->AddAutoloadDir("USER_PLUS_PLUGINS", false);
+  plugin_manager->AddAutoloadDir("MACHINE_PLUS_PLUGINS", false);
+  plugin_manager->AddAutoloadDir("USER_CLASSIC_PLUGINS", false);
+  plugin_manager->AddAutoloadDir("MACHINE_CLASSIC_PLUGINS", false);
+}
+
 /* This function adds information about builtin functions into global variables.
  * External utilities (like AvsPmod) can parse these variables and use them 
  * to learn about supported functions and their syntax.
@@ -1082,6 +1211,7 @@ void __stdcall ScriptEnvironment::AutoloadPlugins()
 }
 
 int ScriptEnvironment::SetMemoryMax(int mem) {
+  plugin_manager->PluginInitSideEffect();
 
   if (mem > 0)  /* If mem is zero, we should just return current setting */
     memory_max = ConstrainMemoryRequest(mem * 1048576ull);
@@ -1090,6 +1220,15 @@ int ScriptEnvironment::SetMemoryMax(int mem) {
 }
 
 int ScriptEnvironment::SetWorkingDir(const char * newdir) {
+  plugin_manager->PluginInitSideEffect();
+
+  if (saved_working_dir.empty()) {
+    DWORD cwdLen = GetCurrentDirectory(0, NULL);
+    std::vector<char> cwd(cwdLen);
+    if (cwdLen != 0 && GetCurrentDirectory(cwdLen, cwd.data()) != 0)
+      saved_working_dir = cwd.data();
+  }
+
   return SetCurrentDirectory(newdir) ? 0 : 1;
 }
 
@@ -1168,12 +1307,16 @@ const char* ScriptEnvironment::GetVar(const char* name, const char* def) const {
 bool ScriptEnvironment::SetVar(const char* name, const AVSValue& val) {
   if (closing) return true;  // We easily risk  being inside the critical section below, while deleting variables.
 
+  if (plugin_manager != NULL)  // NULL while the PluginManager constructor sets up its variables
+    plugin_manager->PluginInitSideEffect();
   return var_table->Set(name, val);
 }
 
 bool ScriptEnvironment::SetGlobalVar(const char* name, const AVSValue& val) {
   if (closing) return true;  // We easily risk  being inside the critical section below, while deleting variables.
 
+  if (plugin_manager != NULL)
+    plugin_manager->PluginInitSideEffect();
   return global_var_table->Set(name, val);
 }
 
@@ -1404,6 +1547,7 @@ PVideoFrame ScriptEnvironment::NewPlanarVideoFrame(int row_size, int height, int
   res->pitchUV = pitchUV;
   res->row_sizeUV = row_sizeUV;
   res->heightUV = heightUV;
+  res->constant_period = 0;
 
   return PVideoFrame(res);
 }
@@ -1438,6 +1582,7 @@ PVideoFrame ScriptEnvironment::NewVideoFrame(int row_size, int height, int align
   res->pitchUV = 0;
   res->row_sizeUV = 0;
   res->heightUV = 0;
+  res->constant_period = 0;
 
   return PVideoFrame(res);
 }
@@ -1486,7 +1631,160 @@ PVideoFrame __stdcall ScriptEnvironment::NewVideoFrame(const VideoInfo& vi, int
   return retval;
 }
 
+PVideoFrame __stdcall ScriptEnvironment::NewExternalVideoFrame(BYTE* data, int data_size, int pitch, int row_size, int height,
+                                                               int offsetU, int offsetV, int pitchUV, int row_sizeUV, int heightUV,
+                                                               ShutdownFunc release, void* user_data)
+{
+  std::unique_lock<std::mutex> env_lock(memory_mutex);
+
+  ReleaseExternalFrames(false);
+
+  VideoFrameBuffer* vfb = new VideoFrameBuffer(data, data_size);
+  InterlockedIncrement(&vfb->refcount);  // the registry's reference
+
+  VideoFrame* frame = new VideoFrame(vfb, 0, pitch, row_size, height, offsetU, offsetV, pitchUV, row_sizeUV, heightUV);
+
+  ExternalFrame ef = { frame, std::vector<VideoFrame*>(), release, user_data };
+  ExternalFrameRegistry.push_back(ef);
+
+  return PVideoFrame(frame);
+}
+
+// Hands back external memory nothing refers to any more, or all of it on shutdown.
+// A buffer is in use while its frame or any of its subframe views is referenced.
+void ScriptEnvironment::ReleaseExternalFrames(bool all)
+{
+  for (size_t i = 0; i < ExternalFrameRegistry.size(); )
+  {
+    ExternalFrame& ef = ExternalFrameRegistry[i];
+    VideoFrameBuffer* vfb = ef.frame->vfb;
+
+    bool in_use = (ef.frame->refcount != 0 || vfb->refcount != 1);
+    for (size_t v = 0; v < ef.views.size() && !in_use; ++v)
+      in_use = (ef.views[v]->refcount != 0);
+
+    if (!all && in_use)
+    {
+      ++i;
+      continue;
+    }
+
+    ef.release(ef.user_data, this);
+
+    // Like the destructor does for FrameRegistry, views still referenced on shutdown are left alone
+    for (size_t v = 0; v < ef.views.size(); ++v)
+    {
+      ef.views[v]->vfb = 0;
+      if (0 == ef.views[v]->refcount)
+        delete ef.views[v];
+    }
+    ef.views.clear();
+
+    ef.frame->vfb = 0;
+    delete ef.frame;
+    const_cast<BYTE*&>(vfb->data) = 0;  // not ours to delete
+    delete vfb;
+
+    ef = ExternalFrameRegistry.back();
+    ExternalFrameRegistry.pop_back();
+  }
+}
+
+static int InternPlaneCount(const PVideoFrame& frame)
+{
+  return frame->GetPitch(PLANAR_U) ? 3 : 1;
+}
+
+static unsigned InternHash(const PVideoFrame& frame)
+{
+  // FNV-1a over the visible bytes of every plane
+  static const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+  unsigned hash = 2166136261u;
+  for (int p = 0; p < InternPlaneCount(frame); ++p) {
+    const BYTE* srcp = frame->GetReadPtr(planes[p]);
+    const int pitch = frame->GetPitch(planes[p]);
+    const int row_size = frame->GetRowSize(planes[p]);
+    for (int y = frame->GetHeight(planes[p]); y > 0; --y) {
+      for (int x = 0; x < row_size; ++x)
+        hash = (hash ^ srcp[x]) * 16777619u;
+      srcp += pitch;
+    }
+  }
+  return hash;
+}
+
+static bool InternEqual(const PVideoFrame& a, const PVideoFrame& b)
+{
+  static const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+  if (InternPlaneCount(a) != InternPlaneCount(b))
+    return false;
+
+  for (int p = 0; p < InternPlaneCount(a); ++p) {
+    const int row_size = a->GetRowSize(planes[p]);
+    const int height = a->GetHeight(planes[p]);
+    if (row_size != b->GetRowSize(planes[p]) || height != b->GetHeight(planes[p]))
+      return false;
+
+    const BYTE* ap = a->GetReadPtr(planes[p]);
+    const BYTE* bp = b->GetReadPtr(planes[p]);
+    for (int y = 0; y < height; ++y) {
+      if (memcmp(ap, bp, row_size))
+        return false;
+      ap += a->GetPitch(planes[p]);
+      bp += b->GetPitch(planes[p]);
+    }
+  }
+  return true;
+}
+
+PVideoFrame __stdcall ScriptEnvironment::InternFrame(const PVideoFrame& frame)
+{
+  if (!frame)
+    return frame;
+
+  const unsigned hash = InternHash(frame);
+
+  std::unique_lock<std::mutex> env_lock(intern_mutex);
+
+  for (size_t i = 0; i < InternedFrameRegistry.size(); )
+  {
+    InternedFrame& entry = InternedFrameRegistry[i];
+
+    if (entry.frame->refcount == 1 && entry.frame->vfb->refcount == 1)
+    {
+      // Nobody outside the registry uses it any more
+      entry = InternedFrameRegistry.back();
+      InternedFrameRegistry.pop_back();
+    }
+    else
+      ++i;
+  }
+
+  InternedFrame* match = NULL;
+  for (size_t i = 0; i < InternedFrameRegistry.size() && !match; ++i)
+  {
+    if (InternedFrameRegistry[i].hash == hash && InternEqual(InternedFrameRegistry[i].frame, frame))
+      match = &InternedFrameRegistry[i];
+  }
+
+  if (match == NULL)
+  {
+    InternedFrame entry = { hash, frame };
+    InternedFrameRegistry.push_back(entry);
+    return frame;
+  }
+
+  // Prefer whichever copy knows it is constant
+  if (!match->frame->GetConstantPeriod() && frame->GetConstantPeriod())
+    match->frame = frame;
+  return match->frame;
+}
+
 bool ScriptEnvironment::MakeWritable(PVideoFrame* pvf) {
+  return MakePlanesWritable(pvf, PLANAR_Y | PLANAR_U | PLANAR_V);
+}
+
+bool __stdcall ScriptEnvironment::MakePlanesWritable(PVideoFrame* pvf, int keep_planes) {
   const PVideoFrame& vf = *pvf;
 
   // If the frame is already writable, do nothing.
@@ -1494,8 +1792,8 @@ bool ScriptEnvironment::MakeWritable(PVideoFrame* pvf) {
     return false;
 
   // Otherwise, allocate a new frame (using NewVideoFrame) and
-  // copy the data into it.  Then modify the passed PVideoFrame
-  // to point to the new buffer.
+  // copy the planes the caller keeps into it.  Then modify the
+  // passed PVideoFrame to point to the new buffer.
   const int row_size = vf->GetRowSize();
   const int height   = vf->GetHeight();
   PVideoFrame dst;
@@ -1509,12 +1807,16 @@ bool ScriptEnvironment::MakeWritable(PVideoFrame* pvf) {
     dst = NewVideoFrame(row_size, height, FRAME_ALIGN);
   }
 
-  BitBlt(dst->GetWritePtr(), dst->GetPitch(), vf->GetReadPtr(), vf->GetPitch(), row_size, height);
+  BYTE* dstp = dst->GetWritePtr();
+  if (keep_planes & PLANAR_Y)
+    BitBlt(dstp, dst->GetPitch(), vf->GetReadPtr(), vf->GetPitch(), row_size, height);
   // Blit More planes (pitch, rowsize and height should be 0, if none is present)
-  BitBlt(dst->GetWritePtr(PLANAR_V), dst->GetPitch(PLANAR_V), vf->GetReadPtr(PLANAR_V),
-         vf->GetPitch(PLANAR_V), vf->GetRowSize(PLANAR_V), vf->GetHeight(PLANAR_V));
-  BitBlt(dst->GetWritePtr(PLANAR_U), dst->GetPitch(PLANAR_U), vf->GetReadPtr(PLANAR_U),
-         vf->GetPitch(PLANAR_U), vf->GetRowSize(PLANAR_U), vf->GetHeight(PLANAR_U));
+  if (keep_planes & PLANAR_V)
+    BitBlt(dst->GetWritePtr(PLANAR_V), dst->GetPitch(PLANAR_V), vf->GetReadPtr(PLANAR_V),
+           vf->GetPitch(PLANAR_V), vf->GetRowSize(PLANAR_V), vf->GetHeight(PLANAR_V));
+  if (keep_planes & PLANAR_U)
+    BitBlt(dst->GetWritePtr(PLANAR_U), dst->GetPitch(PLANAR_U), vf->GetReadPtr(PLANAR_U),
+           vf->GetPitch(PLANAR_U), vf->GetRowSize(PLANAR_U), vf->GetHeight(PLANAR_U));
 
   *pvf = dst;
   return true;
@@ -1522,7 +1824,10 @@ bool ScriptEnvironment::MakeWritable(PVideoFrame* pvf) {
 
 
 void ScriptEnvironment::AtExit(IScriptEnvironment::ShutdownFunc function, void* user_data) {
-  at_exit.Add(function, user_data);
+  if ((plugin_manager != NULL) && plugin_manager->IsLoadingPlugin())
+    at_exit.Add(function, user_data);
+  else
+    script_at_exit.Add(function, user_data);
 }
 
 void ScriptEnvironment::PushContext(int level) {
@@ -1538,10 +1843,28 @@ void ScriptEnvironment::PopContextGlobal() {
 }
 
 
+// Subframes of external buffers are tracked with the buffer, see ReleaseExternalFrames,
+// all others in FrameRegistry.
+void ScriptEnvironment::RegisterSubframe(VideoFrame* subframe)
+{
+  std::unique_lock<std::mutex> env_lock(memory_mutex);
+
+  for (size_t i = 0; i < ExternalFrameRegistry.size(); ++i)
+  {
+    if (ExternalFrameRegistry[i].frame->vfb == subframe->vfb)
+    {
+      ExternalFrameRegistry[i].views.push_back(subframe);
+      return;
+    }
+  }
+
+  FrameRegistry.insert(FrameRegistryType::value_type(subframe->vfb->GetDataSize(), subframe));
+}
+
 PVideoFrame __stdcall ScriptEnvironment::Subframe(PVideoFrame src, int rel_offset, int new_pitch, int new_row_size, int new_height) {
 
   VideoFrame* subframe = src->Subframe(rel_offset, new_pitch, new_row_size, new_height);
-  FrameRegistry.insert(FrameRegistryType::value_type(src->GetFrameBuffer()->GetDataSize(), subframe));
+  RegisterSubframe(subframe);
   return subframe;
 }
 
@@ -1550,7 +1873,7 @@ PVideoFrame __stdcall ScriptEnvironment::SubframePlanar(PVideoFrame src, int rel
                                                         int new_height, int rel_offsetU, int rel_offsetV, int new_pitchUV) {
 
   VideoFrame* subframe = src->Subframe(rel_offset, new_pitch, new_row_size, new_height, rel_offsetU, rel_offsetV, new_pitchUV);
-  FrameRegistry.insert(FrameRegistryType::value_type(src->GetFrameBuffer()->GetDataSize(), subframe));
+  RegisterSubframe(subframe);
   return subframe;
 }
 
@@ -1751,6 +2074,8 @@ AVSValue ScriptEnvironment::Invoke(const char* name, const AVSValue args, const
 
 bool __stdcall ScriptEnvironment::Invoke(AVSValue *result, const char* name, const AVSValue& args, const char* const* arg_names)
 {
+  plugin_manager->PluginInitSideEffect();
+
   bool strict = false;
   const AVSFunction *f;
 
@@ -1901,9 +2226,17 @@ void ScriptEnvironment::BitBlt(BYTE* dstp, int dst_pitch, const BYTE* srcp, int
 }
 
 
+StringDump& ScriptEnvironment::CurrentStringDump() {
+  // Strings saved by plugin init functions must survive ResetEnvironment
+  if ((plugin_manager != NULL) && plugin_manager->IsLoadingPlugin())
+    return string_dump;
+  else
+    return script_string_dump;
+}
+
 char* ScriptEnvironment::SaveString(const char* s, int len) {
   std::lock_guard<std::mutex> lock(string_mutex);
-  return string_dump.SaveString(s, len);
+  return CurrentStringDump().SaveString(s, len);
 }
 
 
@@ -1922,7 +2255,7 @@ char* ScriptEnvironment::VSprintf(const char* fmt, void* val) {
     if (!buf) return NULL;
     count = _vsnprintf(buf, size, fmt, (va_list)val);
   }
-  return string_dump.SaveString(buf, count); // SaveString will add the NULL in len mode.
+  return CurrentStringDump().SaveString(buf, count); // SaveString will add the NULL in len mode.
 }
 
 char* ScriptEnvironment::Sprintf(const char* fmt, ...) {
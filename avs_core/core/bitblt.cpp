@@ -281,4 +281,18 @@ void BitBlt(BYTE* dstp, int dst_pitch, const BYTE* srcp, int src_pitch, int row_
       srcp += src_pitch;
     }
   }
-}
\ No newline at end of file
+}
+
+void FillPlane(BYTE* dstp, int dst_pitch, const BYTE* pattern, int period, int row_size, int height)
+{
+  if ( (!height) || (!row_size) ) return;
+
+  // Build the first row, the others are copies of it
+  for (int x = 0; x < row_size; ++x)
+    dstp[x] = pattern[x % period];
+
+  for (int y = height-1; y > 0; --y) {
+    memcpy(dstp + dst_pitch, dstp, row_size);
+    dstp += dst_pitch;
+  }
+}
@@ -36,4 +36,7 @@ typedef unsigned char BYTE;
 
 void BitBlt(BYTE* dstp, int dst_pitch, const BYTE* srcp, int src_pitch, int row_size, int height);
 
+// Fills every row with pattern repeated every period bytes, see VideoFrame::SetConstant.
+void FillPlane(BYTE* dstp, int dst_pitch, const BYTE* pattern, int period, int row_size, int height);
+
 #endif // AVSCORE_BITBLT_H
@@ -387,8 +387,7 @@ AVSValue __cdecl Cache::Create(AVSValue args, void*, IScriptEnvironment* env)
 
   if (p)  // If the child is a clip
   {
-    if ( (p->GetVersion() >= 5)
-      && (p->SetCacheHints(CACHE_DONT_CACHE_ME, 0) != 0) )
+    if (WantsNoCache(p))
     {
       // Don't create cache instance if the child doesn't want to be cached
       return p; /* This is op, not args! */
@@ -408,3 +407,11 @@ bool __stdcall Cache::IsCache(const PClip& p)
 {
   return ((p->GetVersion() >= 5) && (p->SetCacheHints(CACHE_IS_CACHE_REQ, 0) == CACHE_IS_CACHE_ANS));
 }
+
+// Pass-through and frame-reindexing filters (NonCachedGenericVideoFilter, Trim,
+// Interleave etc.) never touch pixels, so caching their output only duplicates
+// the entries of the cache below them.
+bool __stdcall Cache::WantsNoCache(const PClip& p)
+{
+  return ((p->GetVersion() >= 5) && (p->SetCacheHints(CACHE_DONT_CACHE_ME, 0) != 0));
+}
@@ -59,6 +59,7 @@ public:
 
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
   static bool __stdcall IsCache(const PClip& c);
+  static bool __stdcall WantsNoCache(const PClip& c);
 
 private:
   enum {
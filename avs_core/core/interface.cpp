@@ -405,9 +405,29 @@ BYTE* VideoFrame::GetWritePtr(int plane) const {
     }
     return (refcount == 1 && vfb->refcount == 1) ? vfb->GetWritePtr() + GetOffset(plane) : 0;
   }
+  // Chroma writes don't bump the sequence number, so drop the constant mark here
+  constant_period = 0;
   return vfb->data + GetOffset(plane);
 }
 
+void VideoFrame::SetConstant(int period, const BYTE* patternY, const BYTE* patternU, const BYTE* patternV) {
+  const BYTE* patterns[3] = { patternY, patternU, patternV };
+  for (int p = 0; p < 3; ++p) {
+    if (patterns[p])
+      memcpy(constant_pattern[p], patterns[p], period);
+  }
+  constant_sequence = vfb->GetSequenceNumber();
+  constant_period = period;
+}
+
+int VideoFrame::GetConstantPeriod() const {
+  return (constant_sequence == vfb->GetSequenceNumber()) ? constant_period : 0;
+}
+
+const BYTE* VideoFrame::GetConstantPattern(int plane) const {
+  switch (plane) {case PLANAR_U: return constant_pattern[1]; case PLANAR_V: return constant_pattern[2]; default: return constant_pattern[0];}
+}
+
 /* Baked ********************
 VideoFrame::~VideoFrame() { InterlockedDecrement(&vfb->refcount); }
    Baked ********************/
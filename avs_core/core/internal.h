@@ -38,6 +38,7 @@
 
 #include <avs/config.h>
 #include "version.h"
+#include <string>
 
 #define AVS_CLASSIC_VERSION 2.60  // Note: Used by VersionNumber() script function
 #define AVS_COPYRIGHT "\n\xA9 2000-2015 Ben Rudiak-Gould, et al.\nhttp://avisynth.nl\n\xA9 2013-2015 AviSynth+ Project\nhttp://avs-plus.net"
@@ -153,6 +154,12 @@ private:
 };
 
 
+// Returns the path of filename in the per-user AviSynth+ data directory
+// (%LOCALAPPDATA%/AviSynth+), creating the directory if needed.
+// Returns an empty string if there is no such directory.
+std::string GetUserDataPath(const char* filename);
+
+
 class NonCachedGenericVideoFilter : public GenericVideoFilter 
 /**
   * Class to select a range of frames from a longer clip
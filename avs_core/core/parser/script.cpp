@@ -44,7 +44,9 @@
 #include <avs/minmax.h>
 #include <new>
 #include "../internal.h"
+#include "../strings.h"
 #include "../Prefetcher.h"
+#include "scriptcache.h"
 
 
 /********************************************************************
@@ -320,6 +322,20 @@ DllDirChanger::~DllDirChanger(void)
   delete [] old_directory;
 }
 
+std::string GetUserDataPath(const char* filename)
+{
+  char appData[AVS_MAX_PATH];
+  DWORD len = GetEnvironmentVariable("LOCALAPPDATA", appData, AVS_MAX_PATH);
+  if ((len == 0) || (len >= AVS_MAX_PATH))
+    return std::string();
+
+  std::string path(appData);
+  replace(path, '\\', '/');
+  path.append("/AviSynth+");
+  CreateDirectory(path.c_str(), NULL);   // Fails harmlessly if it already exists
+  return path.append("/").append(filename);
+}
+
 AVSValue Assert(AVSValue args, void*, IScriptEnvironment* env) 
 {
   if (!args[0].AsBool())
@@ -424,6 +440,7 @@ AVSValue Import(AVSValue args, void*, IScriptEnvironment* env)
       env->SetGlobalVar("$MainScriptDir$", env->SaveString(full_path, dir_part_len));
     }
 
+    const std::string script_path(full_path);
     *file_part = 0;
     CWDChanger change_cwd(full_path);
 
@@ -448,8 +465,8 @@ AVSValue Import(AVSValue args, void*, IScriptEnvironment* env)
     }
 
     buf[size] = 0;
-    AVSValue eval_args[] = { buf.data(), script_name };
-    result = env->Invoke("Eval", AVSValue(eval_args, 2));
+    PParsedScript parsed = ScriptCache::Get(script_path.c_str(), buf.data(), size, script_name, env);
+    result = ScriptCache::Evaluate(parsed, env);
   }
 
   env->SetGlobalVar("$ScriptName$", lastScriptName);
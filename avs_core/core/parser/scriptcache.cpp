@@ -0,0 +1,181 @@
+// Avisynth v2.6.  Copyright 2002-2009 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#include "scriptcache.h"
+#include "scriptparser.h"
+#include "script.h"
+#include <map>
+#include <list>
+#include <mutex>
+
+
+/*****************************
+ *******   ParsedScript  ******
+ ****************************/
+
+ParsedScript::~ParsedScript()
+{
+  for (const FunctionDef& f : functions)
+    delete f.sf;
+}
+
+const char* ParsedScript::SaveString(const char* s, int len)
+{
+  if (len == -1)
+    len = lstrlen(s);
+  strings.push_back(std::string(s, len));
+  return strings.back().c_str();
+}
+
+void ParsedScript::AddFunction(const char* name, const char* param_types, ScriptFunction* sf)
+{
+  FunctionDef f = { name, SaveString(param_types), sf };
+  functions.push_back(f);
+}
+
+AVSValue ParsedScript::Evaluate(IScriptEnvironment* env) const
+{
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+
+  // Function definitions take effect before any statement of the script runs,
+  // just like when they are registered during parsing.
+  for (const FunctionDef& f : functions)
+    env2->AddFunction(f.name, f.param_types, ScriptFunction::Execute, f.sf, "$UserFunctions$");
+
+  return root->Evaluate(env);
+}
+
+
+/*****************************
+ *******   ScriptCache   ******
+ ****************************/
+
+namespace {
+
+// Scripts that fell out of the cache stay alive as long as an environment
+// that evaluated them, the cache only drops its own reference.
+const size_t MAX_CACHED_SCRIPTS = 64;
+
+struct CacheEntry
+{
+  unsigned __int64 hash;
+  size_t length;
+  PParsedScript script;
+  std::list<std::string>::iterator lru_pos;
+};
+
+struct StdStriLess
+{
+  bool operator() (const std::string& lhs, const std::string& rhs) const
+  {
+    return (lstrcmpi(lhs.c_str(), rhs.c_str()) < 0);
+  }
+};
+
+std::mutex cache_mutex;
+std::map<std::string, CacheEntry, StdStriLess> cache_entries;
+std::list<std::string> cache_lru;   // Paths of cache_entries, most recently used first
+
+// 64-bit FNV-1a
+unsigned __int64 HashCode(const char* code, size_t len)
+{
+  unsigned __int64 hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; ++i)
+  {
+    hash ^= (unsigned char)code[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void ReleaseScript(void* p, IScriptEnvironment*)
+{
+  delete static_cast<PParsedScript*>(p);
+}
+
+} // namespace
+
+PParsedScript ScriptCache::Get(const char* full_path, const char* code, size_t code_len,
+                               const char* filename, IScriptEnvironment* env)
+{
+  const unsigned __int64 hash = HashCode(code, code_len);
+
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache_entries.find(full_path);
+    if ((it != cache_entries.end()) && (it->second.hash == hash) && (it->second.length == code_len))
+    {
+      cache_lru.splice(cache_lru.begin(), cache_lru, it->second.lru_pos);
+      return it->second.script;
+    }
+  }
+
+  // Parse outside the lock, a long script must not block other environments.
+  // Should two threads parse the same file, the last one wins, which is harmless.
+  std::shared_ptr<ParsedScript> script = std::make_shared<ParsedScript>();
+  const char* saved_filename = (filename != NULL) ? script->SaveString(filename) : NULL;
+  ScriptParser parser(env, code, saved_filename, script.get());
+  script->SetRoot(parser.Parse());
+
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache_entries.find(full_path);
+    if (it == cache_entries.end())
+    {
+      cache_lru.push_front(full_path);
+      CacheEntry entry = { hash, code_len, script, cache_lru.begin() };
+      cache_entries.insert(std::make_pair(cache_lru.front(), entry));
+    }
+    else
+    {
+      it->second.hash = hash;
+      it->second.length = code_len;
+      it->second.script = script;
+      cache_lru.splice(cache_lru.begin(), cache_lru, it->second.lru_pos);
+    }
+
+    while (cache_entries.size() > MAX_CACHED_SCRIPTS)
+    {
+      cache_entries.erase(cache_lru.back());
+      cache_lru.pop_back();
+    }
+  }
+  return script;
+}
+
+AVSValue ScriptCache::Evaluate(const PParsedScript& script, IScriptEnvironment* env)
+{
+  env->AtExit(ReleaseScript, new PParsedScript(script));
+  return script->Evaluate(env);
+}
@@ -0,0 +1,104 @@
+// Avisynth v2.6.  Copyright 2002-2009 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef __ScriptCache_H__
+#define __ScriptCache_H__
+
+#include <avisynth.h>
+#include "expression.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+
+class ScriptFunction;
+
+
+class ParsedScript
+/**
+  * The result of parsing a script file, independent of any script environment.
+  * Owns every string the parse produced, the expression tree and the user
+  * functions defined in the script, so it can be evaluated in many environments.
+ **/
+{
+public:
+  ParsedScript() {}
+  ~ParsedScript();
+
+  const char* SaveString(const char* s, int len = -1);
+  void AddFunction(const char* name, const char* param_types, ScriptFunction* sf);
+  void SetRoot(const PExpression& _root) { root = _root; }
+
+  // Registers the script's functions in 'env', then evaluates the script body.
+  AVSValue Evaluate(IScriptEnvironment* env) const;
+
+private:
+  struct FunctionDef
+  {
+    const char* name;
+    const char* param_types;
+    ScriptFunction* sf;
+  };
+
+  std::list<std::string> strings;   // list, so that saved pointers stay valid
+  std::vector<FunctionDef> functions;
+  PExpression root;
+
+  ParsedScript(const ParsedScript&) = delete;
+  ParsedScript& operator=(const ParsedScript&) = delete;
+};
+
+typedef std::shared_ptr<const ParsedScript> PParsedScript;
+
+
+class ScriptCache
+/**
+  * Process-wide cache of parsed script files, shared between all script
+  * environments. Entries are keyed by the full path and validated against
+  * a hash of the file contents, so edited files are parsed again. Only the
+  * most recently used scripts are kept, so a long-running host that opens
+  * many different files does not grow the cache without bound.
+ **/
+{
+public:
+  // Returns the parsed form of 'code', parsing it on a cache miss.
+  static PParsedScript Get(const char* full_path, const char* code, size_t code_len,
+                           const char* filename, IScriptEnvironment* env);
+
+  // Evaluates a cached script and keeps it alive for the lifetime of 'env',
+  // which may still refer to its strings and functions.
+  static AVSValue Evaluate(const PParsedScript& script, IScriptEnvironment* env);
+};
+
+#endif  // __ScriptCache_H__
@@ -34,6 +34,7 @@
 
 
 #include "scriptparser.h"
+#include "scriptcache.h"
 
 
 /********************************
@@ -41,8 +42,8 @@
  *******************************/
  
 
-ScriptParser::ScriptParser(IScriptEnvironment* _env, const char* _code, const char* _filename)
-   : env(static_cast<IScriptEnvironment2*>(_env)), tokenizer(_code, _env), code(_code), filename(_filename), loopDepth(0) {}
+ScriptParser::ScriptParser(IScriptEnvironment* _env, const char* _code, const char* _filename, ParsedScript* _store)
+   : env(static_cast<IScriptEnvironment2*>(_env)), tokenizer(_code, _env, _store), code(_code), filename(_filename), store(_store), loopDepth(0) {}
 
 PExpression ScriptParser::Parse(void) 
 {
@@ -150,6 +151,10 @@ void ScriptParser::ParseFunctionDefinition(void)
   param_types[param_chars] = 0;
   PExpression body = new ExpRootBlock(ParseBlock(true, NULL));
   ScriptFunction* sf = new ScriptFunction(body, param_floats, param_names, param_count);
+  if (store) {
+    store->AddFunction(name, param_types, sf);
+    return;
+  }
   env->AtExit(ScriptFunction::Delete, sf);
   env->AddFunction(name, env->SaveString(param_types), ScriptFunction::Execute, sf, "$UserFunctions$");
 }
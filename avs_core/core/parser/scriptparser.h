@@ -52,7 +52,7 @@ class ScriptParser
  **/
 {
 public:
-  ScriptParser(IScriptEnvironment* _env, const char* _code, const char* _filename);
+  ScriptParser(IScriptEnvironment* _env, const char* _code, const char* _filename, ParsedScript* _store = NULL);
 
   PExpression Parse(void);
 
@@ -63,6 +63,7 @@ private:
   Tokenizer tokenizer;
   const char* const code;
   const char* const filename;
+  ParsedScript* const store;    // If set, function definitions are collected here instead of registered in env
   int loopDepth;    // how many loops are we in during parsing
 
   void Expect(int op, const char* msg);
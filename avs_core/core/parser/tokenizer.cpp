@@ -34,6 +34,7 @@
 
 
 #include "tokenizer.h"
+#include "scriptcache.h"
 #include <avs/win.h>
 
 #include <cfloat>
@@ -45,8 +46,8 @@
  *******   Tokenizer   ******
  ***************************/
 
-Tokenizer::Tokenizer(const char* pc, IScriptEnvironment* _env) 
-  : env(_env) 
+Tokenizer::Tokenizer(const char* pc, IScriptEnvironment* _env, ParsedScript* _store) 
+  : env(_env), store(_store) 
 {
   this->pc = pc;
   this->line = 1;
@@ -55,13 +56,18 @@ Tokenizer::Tokenizer(const char* pc, IScriptEnvironment* _env)
 }
 
 Tokenizer::Tokenizer(Tokenizer* old) 
-  : env(old->env) 
+  : env(old->env), store(old->store) 
 {
   pc = old->pc;
   line = old->line;
   NextToken();
 }  
 
+const char* Tokenizer::SaveString(const char* s, int len)
+{
+  return store ? store->SaveString(s, len) : env->SaveString(s, len);
+}
+
 bool Tokenizer::IsIdentifier(const char* id) const 
 {
   return IsIdentifier() && !lstrcmpi(id, identifier);
@@ -263,7 +269,7 @@ void Tokenizer::NextToken() {
         for (const char *cp = start; cp < end; cp++) {
           if (*cp == '\n') { line++; }
         }        type = 's';
-        string = env->SaveString(start, end-start);
+        string = SaveString(start, int(end-start));
       }
       break;
 
@@ -277,7 +283,7 @@ void Tokenizer::NextToken() {
           pc++;
         } while (*pc == '_' || isalnum(*pc));
         type = 'd';
-        identifier = env->SaveString(token_start, pc - token_start);
+        identifier = SaveString(token_start, int(pc - token_start));
         if (!lstrcmpi(identifier, "__END__")) {
           type = 0;
         }
@@ -43,13 +43,15 @@
 *********************************************************/
 
 
+class ParsedScript;
+
 class Tokenizer 
 /**
   * Breaks up scripts into tokens
  **/
 {
 public:
-  Tokenizer(const char* pc, IScriptEnvironment* _env);
+  Tokenizer(const char* pc, IScriptEnvironment* _env, ParsedScript* _store = NULL);
   explicit Tokenizer(Tokenizer* old);
 
   void NextToken();
@@ -81,8 +83,10 @@ private:
   void GetNumber();
   void AssertType(char expected_type) const;
   void SetToOperator(int o);
+  const char* SaveString(const char* s, int len);
   
   IScriptEnvironment* const env;
+  ParsedScript* const store;    // If set, strings are saved here instead of in env
   const char* token_start;
   const char* pc;
   int line;
@@ -101,6 +101,14 @@ public:
 		return index3;
 	}
 
+	// Drops the index and returns room for the given number of entries,
+	// for filling in an index that was stored earlier.
+	AVIIndexEntry2 *replaceIndex2(int total_entries) {
+		clear();
+		total_ents = total_entries;
+		return allocateIndex2(total_entries);
+	}
+
 	AVIIndexEntry2 *takeIndex2() {
 		AVIIndexEntry2 *idx = index2;
 
@@ -19,7 +19,7 @@
 #include <new>
 
 #include "AVIReadHandler.h"
-//#include "FastReadStream.h"
+#include "FastReadStream.h"
 //#include "ProgressDialog.h"
 #include "AVIIndex.h"
 #include "Error.h"
@@ -30,6 +30,7 @@
 #include "clip_info.h"
 
 #include <cmath>
+#include <string>
 
 
 #pragma warning(disable: 4200)    // nonstandard extension used : zero-sized array in struct/union
@@ -314,16 +315,28 @@ class AVIFileDesc : public ListNode2<AVIFileDesc> {
 public:
 	HANDLE		hFile;
 	HANDLE		hFileUnbuffered;
+	HANDLE		hFilePositional;	// only used with explicit offsets, see ReadDataPositional
+	HANDLE		hMapping;			// of hFilePositional, NULL if it couldn't be created
+	FastReadStream *pFastRead;		// over hFilePositional, only with read-ahead
 	__int64		i64Size;
 };
 
+// Identifies the file an index cache entry was made from.
+
+struct AVIIndexCacheKey {
+	__int64				i64Size;
+	FILETIME			ftLastWrite;
+	unsigned __int64	u64HeaderHash;		// FNV-1a of the first 64K
+};
+
 class AVIStreamNode;
 
 class AVIReadHandler : public IAVIReadHandler, private File64 {
 public:
 	bool		fDisableFastIO;
+	long		lReadAhead;
 
-	AVIReadHandler(const char *);
+	AVIReadHandler(const char *, bool fIndexCache);
 	AVIReadHandler(PAVIFILE);
 	~AVIReadHandler();
 
@@ -336,6 +349,8 @@ public:
 	bool isIndexFabricated();
 	bool AppendFile(const char *pszFile);
 	bool getSegmentHint(const char **ppszPath);
+	void EnableReadAhead(int depth);
+	__int64 getStallTime(int stream, long *plStalls);
 
 	void EnableStreaming(int stream);
 	void DisableStreaming(int stream);
@@ -344,6 +359,11 @@ public:
 	__int64 getStreamPtr();
 	void FixCacheProblems(class AVIReadStream *);
 	long ReadData(int stream, void *buffer, __int64 position, long len);
+	void Prefetch(int stream, __int64 position, long len);
+	long ReadDataPositional(void *buffer, __int64 position, long len);
+	const void *MapDataPositional(__int64 position, long len, void **ppView);
+	bool isMappable();
+	bool isPositionalReadable();
 
 private:
 //	enum { STREAM_SIZE = 65536 };
@@ -371,11 +391,20 @@ private:
 
 	bool		bAggressivelyRecovered;
 
+	// Keep parsed indices in <file>.avsidx and reuse them when the file is reopened.
+
+	bool		fIndexCache;
+
 	List2<AVIStreamNode>		listStreams;
 	List2<AVIFileDesc>			listFiles;
 
 	void		_construct(const char *pszFile);
 	void		_parseFile(List2<AVIStreamNode>& streams);
+	void		_parseFileCached(List2<AVIStreamNode>& streams, const char *pszFile);
+	bool		_indexCacheKey(AVIIndexCacheKey& key);
+	bool		_loadIndexCache(List2<AVIStreamNode>& streams, const char *pszPath, const AVIIndexCacheKey& key);
+	bool		_readIndexCache(HANDLE h, List2<AVIStreamNode>& streams, const AVIIndexCacheKey& key, DWORD& dwFlags, char *& pHint);
+	void		_saveIndexCache(List2<AVIStreamNode>& streams, const char *pszPath, const AVIIndexCacheKey& key);
 	bool		_parseStreamHeader(List2<AVIStreamNode>& streams, DWORD dwLengthLeft, bool& bIndexDamaged);
 	bool		_parseIndexBlock(List2<AVIStreamNode>& streams, int count, __int64);
 	void		_parseExtendedIndexBlock(List2<AVIStreamNode>& streams, AVIStreamNode *pasn, __int64 fpos, DWORD dwLength);
@@ -383,6 +412,7 @@ private:
 
 	char *		_StreamRead(long& bytes);
 	void		_SelectFile(int file);
+	AVIFileDesc *_FileDesc(int file);
 
 };
 
@@ -390,8 +420,8 @@ IAVIReadHandler *CreateAVIReadHandler(PAVIFILE paf) {
 	return new AVIReadHandler(paf);
 }
 
-IAVIReadHandler *CreateAVIReadHandler(const char *pszFile) {
-	return new AVIReadHandler(pszFile);
+IAVIReadHandler *CreateAVIReadHandler(const char *pszFile, bool fIndexCache) {
+	return new AVIReadHandler(pszFile, fIndexCache);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -592,6 +622,8 @@ public:
 	bool isStreaming();
 	bool isKeyframeOnly();
 	bool getVBRInfo(double& bitrate_mean, double& bitrate_stddev, double& maxdev) { return false; }
+	HRESULT ReadFrameConcurrent(long lFrame, void *lpBuffer, long cbBuffer, long *plBytes) { return AVIERR_UNSUPPORTED; }
+	const void *MapFrame(long lFrame, long *plBytes, void **ppView) { *plBytes = -1; return NULL; }
 
 private:
 	IAvisynthClipInfo *const pAvisynthClipInfo;
@@ -704,10 +736,14 @@ public:
 	HRESULT ReadFormat(long lFrame, void *pFormat, long *plSize);
 	bool isStreaming();
 	bool isKeyframeOnly();
+	HRESULT ReadFrameConcurrent(long lFrame, void *lpBuffer, long cbBuffer, long *plBytes);
+	const void *MapFrame(long lFrame, long *plBytes, void **ppView);
 	void Reinit();
 	bool getVBRInfo(double& bitrate_mean, double& bitrate_stddev, double& maxdev);
 
 private:
+	void _ReadAhead(const AVIIndexEntry2 *avie2);
+
 	AVIReadHandler *parent;
 	AVIStreamNode *psnData;
 	AVIIndexEntry2 *pIndex;
@@ -762,6 +798,12 @@ AVIReadStream::AVIReadStream(AVIReadHandler *parent, AVIStreamNode *psnData, int
 }
 
 AVIReadStream::~AVIReadStream() {
+	long lStalls;
+	__int64 i64StallTime = parent->getStallTime(streamno, &lStalls);
+
+	if (lStalls)
+		_RPT3(0,"AVIReadStream: stream %d stalled %ld times for %I64d us\n", streamno, lStalls, i64StallTime);
+
 	EndStreaming();
 	parent->Release();
 	Remove();
@@ -1022,6 +1064,9 @@ HRESULT AVIReadStream::Read(long lStart, long lSamples, void *lpBuffer, long cbB
 				lpBuffer = (char *)lpBuffer + tc;
 			}
 
+			if (!(psnData->cache && fStreamingActive))
+				_ReadAhead(avie2);
+
 			if (actual_bytes < sampsize) {
 				if (plBytes) *plBytes = 0;
 				if (plSamples) *plSamples = 0;
@@ -1108,8 +1153,10 @@ HRESULT AVIReadStream::Read(long lStart, long lSamples, void *lpBuffer, long cbB
 //OutputDebugString("[v] attempting cached read\n");
 				lActual = psnData->cache->Read(lpBuffer, avie2->pos, avie2->pos + 8, size);
 				psnData->stream_bytes += lActual;
-			} else
+			} else {
 				lActual = parent->ReadData(streamno, lpBuffer, avie2->pos+8, size);
+				_ReadAhead(avie2+1);
+			}
 
 			if (lActual != size) {
 				if (plBytes) *plBytes = 0;
@@ -1145,6 +1192,15 @@ HRESULT AVIReadStream::Read(long lStart, long lSamples, void *lpBuffer, long cbB
 	return 0;
 }
 
+// Announces the chunks following avie2 in index order.  Chunks of the other
+// streams are interleaved with them, so their blocks are mostly shared.
+void AVIReadStream::_ReadAhead(const AVIIndexEntry2 *avie2) {
+	const AVIIndexEntry2 *avie2_limit = pIndex+frames;
+
+	for(int i=0; i<parent->lReadAhead && avie2 < avie2_limit; ++i, ++avie2)
+		parent->Prefetch(streamno, avie2->pos, (avie2->size & 0x7FFFFFFF) + 8);
+}
+
 long AVIReadStream::Start() {
 	return 0;
 }
@@ -1233,6 +1289,56 @@ bool AVIReadStream::isKeyframeOnly() {
    return psnData->keyframe_only;
 }
 
+HRESULT AVIReadStream::ReadFrameConcurrent(long lFrame, void *lpBuffer, long cbBuffer, long *plBytes) {
+	if (sampsize || !parent->isPositionalReadable())
+		return AVIERR_UNSUPPORTED;
+
+	if (lFrame < 0 || lFrame >= length) {
+		*plBytes = 0;
+		return 0;
+	}
+
+	const AVIIndexEntry2 *avie2 = &pIndex[lFrame];
+	const long size = avie2->size & 0x7FFFFFFF;
+
+	*plBytes = size;
+
+	if (!lpBuffer || !size)
+		return 0;
+
+	if (size > cbBuffer)
+		return AVIERR_BUFFERTOOSMALL;
+
+	if (parent->ReadDataPositional(lpBuffer, avie2->pos+8, size) != size) {
+		*plBytes = 0;
+		return AVIERR_FILEREAD;
+	}
+
+	return 0;
+}
+
+const void *AVIReadStream::MapFrame(long lFrame, long *plBytes, void **ppView) {
+	if (sampsize || !parent->isMappable()) {
+		*plBytes = -1;
+		return NULL;
+	}
+
+	if (lFrame < 0 || lFrame >= length) {
+		*plBytes = 0;
+		return NULL;
+	}
+
+	const AVIIndexEntry2 *avie2 = &pIndex[lFrame];
+	const long size = avie2->size & 0x7FFFFFFF;
+
+	*plBytes = size;
+
+	if (!size)
+		return NULL;
+
+	return parent->MapDataPositional(avie2->pos+8, size, ppView);
+}
+
 bool AVIReadStream::getVBRInfo(double& bitrate_mean, double& bitrate_stddev, double& maxdev) {
 	if (psnData->was_VBR) {
 		bitrate_mean = psnData->bitrate_mean;
@@ -1246,9 +1352,10 @@ bool AVIReadStream::getVBRInfo(double& bitrate_mean, double& bitrate_stddev, dou
 
 ///////////////////////////////////////////////////////////////////////////
 
-AVIReadHandler::AVIReadHandler(const char *s)
+AVIReadHandler::AVIReadHandler(const char *s, bool fIndexCache)
 : pAvisynthClipInfo(0)
 , bAggressivelyRecovered(false)
+, fIndexCache(fIndexCache)
 {
 	this->hFile = INVALID_HANDLE_VALUE;
 	this->hFileUnbuffered = INVALID_HANDLE_VALUE;
@@ -1257,6 +1364,7 @@ AVIReadHandler::AVIReadHandler(const char *s)
 	streams=0;
 	fStreamsActive = 0;
 	fDisableFastIO = false;
+	lReadAhead = 0;
 	streamBuffer = NULL;
 	nRealTime = 0;
 	nActiveStreamers = 0;
@@ -1279,6 +1387,8 @@ AVIReadHandler::AVIReadHandler(PAVIFILE paf) {
 	this->paf = paf;
 	ref_count = 1;
 	streams=0;
+	lReadAhead = 0;
+	fIndexCache = false;
 	streamBuffer = NULL;
 	pSegmentHint = NULL;
 	fFakeIndex = false;
@@ -1332,7 +1442,7 @@ void AVIReadHandler::_construct(const char *pszFile) {
 
 		// recursively parse file
 
-		_parseFile(listStreams);
+		_parseFileCached(listStreams, pszFile);
 
 		// Create first link
 
@@ -1341,6 +1451,9 @@ void AVIReadHandler::_construct(const char *pszFile) {
 
 		pDesc->hFile			= hFile;
 		pDesc->hFileUnbuffered	= hFileUnbuffered;
+		pDesc->hFilePositional	= CreateFile(pszFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+		pDesc->hMapping			= pDesc->hFilePositional != INVALID_HANDLE_VALUE ? CreateFileMapping(pDesc->hFilePositional, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+		pDesc->pFastRead		= NULL;
 		pDesc->i64Size			= i64Size = _sizeFile();
 
 		listFiles.AddHead(pDesc);
@@ -1376,7 +1489,7 @@ bool AVIReadHandler::AppendFile(const char *pszFile) {
 		);
 
 	try {
-		_parseFile(newstreams);
+		_parseFileCached(newstreams, pszFile);
 
 		pasn_old = listStreams.AtHead();
 		pasn_new = newstreams.AtHead();
@@ -1442,6 +1555,9 @@ bool AVIReadHandler::AppendFile(const char *pszFile) {
 
 		pDesc->hFile			= hFile;
 		pDesc->hFileUnbuffered	= hFileUnbuffered;
+		pDesc->hFilePositional	= CreateFile(pszFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+		pDesc->hMapping			= pDesc->hFilePositional != INVALID_HANDLE_VALUE ? CreateFileMapping(pDesc->hFilePositional, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+		pDesc->pFastRead		= NULL;
 		pDesc->i64Size			= _sizeFile();
 	} catch(const AvisynthError&) {
 		while(pasn_new = newstreams.RemoveHead())
@@ -1850,6 +1966,268 @@ terminate_scan:
 //	throw MyError("Parse complete.  Aborting.");
 }
 
+///////////////////////////////////////////////////////////////////////////
+//
+//	index cache
+//
+///////////////////////////////////////////////////////////////////////////
+
+// Parsing a large OpenDML file walks every index chunk, and a file without
+// a usable index is scanned from end to end.  The cache keeps the outcome
+// of _parseFile() next to the file, valid as long as the file's size, write
+// time and first 64K don't change.
+
+static const char g_IndexCacheMagic[8] = { 'A', 'V', 'S', 'I', 'D', 'X', '0', '1' };
+
+enum {
+	kIndexCacheFakeIndex	= 1,
+	kIndexCacheAggressive	= 2,
+};
+
+struct AVIIndexCacheStream {
+	long		lFormatLen;
+	long		frames;
+	long		length;
+	__int64		bytes;
+	double		bitrate_mean;
+	double		bitrate_stddev;
+	double		max_deviation;
+	bool		keyframe_only;
+	bool		was_VBR;
+};
+
+static bool _cacheRead(HANDLE h, void *data, DWORD len) {
+	DWORD dwActual;
+
+	return ReadFile(h, data, len, &dwActual, NULL) && dwActual == len;
+}
+
+static bool _cacheWrite(HANDLE h, const void *data, DWORD len) {
+	DWORD dwActual;
+
+	return WriteFile(h, data, len, &dwActual, NULL) && dwActual == len;
+}
+
+void AVIReadHandler::_parseFileCached(List2<AVIStreamNode>& streamlist, const char *pszFile) {
+	AVIIndexCacheKey key;
+
+	if (!fIndexCache || !_indexCacheKey(key)) {
+		_parseFile(streamlist);
+		return;
+	}
+
+	const std::string path = std::string(pszFile) + ".avsidx";
+
+	if (_loadIndexCache(streamlist, path.c_str(), key))
+		return;
+
+	_parseFile(streamlist);
+	_saveIndexCache(streamlist, path.c_str(), key);
+}
+
+bool AVIReadHandler::_indexCacheKey(AVIIndexCacheKey& key) {
+	enum { HASH_SIZE = 65536 };
+	FILETIME ftCreation, ftLastAccess;
+
+	memset(&key, 0, sizeof key);	// the padding is compared too
+
+	if (!GetFileTime(hFile, &ftCreation, &ftLastAccess, &key.ftLastWrite))
+		return false;
+
+	key.i64Size = _sizeFile();
+
+	char *buf = new(std::nothrow) char[HASH_SIZE];
+
+	if (!buf)
+		return false;
+
+	__int64 i64Pos = _posFile();
+
+	_seekFile(0);
+	long len = _readFile(buf, HASH_SIZE);
+	_seekFile(i64Pos);
+
+	unsigned __int64 hash = 14695981039346656037ull;
+
+	for(long i=0; i<len; ++i)
+		hash = (hash ^ (unsigned char)buf[i]) * 1099511628211ull;
+
+	delete[] buf;
+
+	key.u64HeaderHash = hash;
+
+	return len >= 0;
+}
+
+bool AVIReadHandler::_loadIndexCache(List2<AVIStreamNode>& streamlist, const char *pszPath, const AVIIndexCacheKey& key) {
+	HANDLE h = CreateFile(pszPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (h == INVALID_HANDLE_VALUE)
+		return false;
+
+	List2<AVIStreamNode> cached;
+	AVIStreamNode *pasn;
+	DWORD dwFlags = 0;
+	char *pHint = NULL;
+	bool fOk;
+
+	try {
+		fOk = _readIndexCache(h, cached, key, dwFlags, pHint);
+	} catch(...) {
+		fOk = false;
+	}
+
+	CloseHandle(h);
+
+	if (!fOk) {
+		while(pasn = cached.RemoveHead())
+			delete pasn;
+
+		delete[] pHint;
+		return false;
+	}
+
+	while(pasn = cached.RemoveHead()) {
+		streamlist.AddTail(pasn);
+		++streams;
+	}
+
+	if (pHint) {
+		delete[] pSegmentHint;
+		pSegmentHint = pHint;
+	}
+
+	if (dwFlags & kIndexCacheFakeIndex)
+		fFakeIndex = true;
+
+	if (dwFlags & kIndexCacheAggressive)
+		bAggressivelyRecovered = true;
+
+	return true;
+}
+
+// Streams are added to the list as they are read, so the caller has to clean
+// up after a failure.
+
+bool AVIReadHandler::_readIndexCache(HANDLE h, List2<AVIStreamNode>& streamlist, const AVIIndexCacheKey& key, DWORD& dwFlags, char *& pHint) {
+	char magic[sizeof g_IndexCacheMagic];
+	AVIIndexCacheKey keyCached;
+	DWORD dwHintLen, dwStreams;
+
+	if (!_cacheRead(h, magic, sizeof magic) || memcmp(magic, g_IndexCacheMagic, sizeof magic))
+		return false;
+
+	if (!_cacheRead(h, &keyCached, sizeof keyCached) || memcmp(&keyCached, &key, sizeof key))
+		return false;
+
+	if (!_cacheRead(h, &dwFlags, sizeof dwFlags) || !_cacheRead(h, &dwHintLen, sizeof dwHintLen))
+		return false;
+
+	if (dwHintLen) {
+		pHint = new char[dwHintLen];
+
+		if (!_cacheRead(h, pHint, dwHintLen))
+			return false;
+	}
+
+	if (!_cacheRead(h, &dwStreams, sizeof dwStreams))
+		return false;
+
+	while(dwStreams--) {
+		AVIStreamNode *pasn = new AVIStreamNode();
+		AVIIndexCacheStream acs;
+
+		streamlist.AddTail(pasn);
+
+		if (!_cacheRead(h, &pasn->hdr, sizeof pasn->hdr) || !_cacheRead(h, &acs, sizeof acs))
+			return false;
+
+		if (acs.lFormatLen < 0 || acs.frames < 0)
+			return false;
+
+		pasn->pFormat		= new char[pasn->lFormatLen = acs.lFormatLen];
+		pasn->frames		= acs.frames;
+		pasn->length		= acs.length;
+		pasn->bytes			= acs.bytes;
+		pasn->bitrate_mean	= acs.bitrate_mean;
+		pasn->bitrate_stddev= acs.bitrate_stddev;
+		pasn->max_deviation	= acs.max_deviation;
+		pasn->keyframe_only	= acs.keyframe_only;
+		pasn->was_VBR		= acs.was_VBR;
+
+		if (!_cacheRead(h, pasn->pFormat, acs.lFormatLen))
+			return false;
+
+		AVIIndexEntry2 *pIdx = pasn->index.replaceIndex2(acs.frames);
+
+		if (!pIdx || !_cacheRead(h, pIdx, acs.frames * sizeof(AVIIndexEntry2)))
+			return false;
+	}
+
+	return true;
+}
+
+// Written to a temporary file first, so that a concurrent reader never sees
+// half a cache.  Failures are silent; the file is simply parsed next time.
+
+void AVIReadHandler::_saveIndexCache(List2<AVIStreamNode>& streamlist, const char *pszPath, const AVIIndexCacheKey& key) {
+	AVIStreamNode *pasn, *pasn_next;
+	DWORD dwFlags = (fFakeIndex ? kIndexCacheFakeIndex : 0) | (bAggressivelyRecovered ? kIndexCacheAggressive : 0);
+	DWORD dwHintLen = 0, dwStreams = 0;
+	bool fOk;
+
+	if (pSegmentHint)
+		dwHintLen = (DWORD)strlen(pSegmentHint+1) + 2;
+
+	pasn = streamlist.AtHead();
+	while(pasn_next = pasn->NextFromHead()) {
+		++dwStreams;
+		pasn = pasn_next;
+	}
+
+	const std::string tmpPath = std::string(pszPath) + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+
+	HANDLE h = CreateFile(tmpPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (h == INVALID_HANDLE_VALUE)
+		return;
+
+	fOk = _cacheWrite(h, g_IndexCacheMagic, sizeof g_IndexCacheMagic)
+		&& _cacheWrite(h, &key, sizeof key)
+		&& _cacheWrite(h, &dwFlags, sizeof dwFlags)
+		&& _cacheWrite(h, &dwHintLen, sizeof dwHintLen)
+		&& (!dwHintLen || _cacheWrite(h, pSegmentHint, dwHintLen))
+		&& _cacheWrite(h, &dwStreams, sizeof dwStreams);
+
+	pasn = streamlist.AtHead();
+	while(fOk && (pasn_next = pasn->NextFromHead())) {
+		AVIIndexCacheStream acs;
+
+		memset(&acs, 0, sizeof acs);
+		acs.lFormatLen		= pasn->lFormatLen;
+		acs.frames			= pasn->frames;
+		acs.length			= pasn->length;
+		acs.bytes			= pasn->bytes;
+		acs.bitrate_mean	= pasn->bitrate_mean;
+		acs.bitrate_stddev	= pasn->bitrate_stddev;
+		acs.max_deviation	= pasn->max_deviation;
+		acs.keyframe_only	= pasn->keyframe_only;
+		acs.was_VBR			= pasn->was_VBR;
+
+		fOk = _cacheWrite(h, &pasn->hdr, sizeof pasn->hdr)
+			&& _cacheWrite(h, &acs, sizeof acs)
+			&& _cacheWrite(h, pasn->pFormat, pasn->lFormatLen)
+			&& _cacheWrite(h, pasn->index.index2Ptr(), pasn->frames * sizeof(AVIIndexEntry2));
+
+		pasn = pasn_next;
+	}
+
+	CloseHandle(h);
+
+	if (!fOk || !MoveFileEx(tmpPath.c_str(), pszPath, MOVEFILE_REPLACE_EXISTING))
+		DeleteFile(tmpPath.c_str());
+}
+
 bool AVIReadHandler::_parseStreamHeader(List2<AVIStreamNode>& streamlist, DWORD dwLengthLeft, bool& bIndexDamaged) {
 	AVIStreamNode *pasn;
 	FOURCC fccType;
@@ -2147,8 +2525,13 @@ void AVIReadHandler::_destruct() {
 			CloseHandle(hFileUnbuffered);
 	} else
 		while(pDesc = listFiles.RemoveTail()) {
+			delete pDesc->pFastRead;
 			CloseHandle(pDesc->hFile);
 			CloseHandle(pDesc->hFileUnbuffered);
+			if (pDesc->hMapping)
+				CloseHandle(pDesc->hMapping);
+			if (pDesc->hFilePositional != INVALID_HANDLE_VALUE)
+				CloseHandle(pDesc->hFilePositional);
 			delete pDesc;
 		}
 
@@ -2203,6 +2586,68 @@ void AVIReadHandler::EnableFastIO(bool f) {
 	fDisableFastIO = !f;
 }
 
+// Gives every segment a block cache with a read-ahead thread.  It is sized
+// so that depth chunks of all streams fit twice, which keeps the blocks read
+// ahead from pushing out the ones still being read.
+void AVIReadHandler::EnableReadAhead(int depth) {
+	enum { BLOCK_SIZE = 65536, MAX_BLOCKS = 1024 };
+
+	AVIStreamNode *pasn, *pasn_next;
+	AVIFileDesc *pDesc, *pDesc_next;
+	__int64 i64StepBytes = 0;
+
+	if (paf || lReadAhead || depth <= 0)
+		return;
+
+	pasn = listStreams.AtHead();
+	while(pasn_next = pasn->NextFromHead()) {
+		if (pasn->frames)
+			i64StepBytes += pasn->bytes / pasn->frames + 8;
+		pasn = pasn_next;
+	}
+
+	__int64 i64Blocks = (i64StepBytes * depth + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	long lBlocks = (long)(i64Blocks*2 + 4 < MAX_BLOCKS ? i64Blocks*2 + 4 : MAX_BLOCKS);
+
+	pDesc = listFiles.AtHead();
+	while(pDesc_next = pDesc->NextFromHead()) {
+		if (!pDesc->pFastRead && pDesc->hFilePositional != INVALID_HANDLE_VALUE) {
+			FastReadStream *pFastRead = new(std::nothrow) FastReadStream(pDesc->hFilePositional, lBlocks, BLOCK_SIZE, lBlocks/2);
+
+			if (pFastRead && !pFastRead->Ready()) {
+				delete pFastRead;
+				pFastRead = NULL;
+			}
+			pDesc->pFastRead = pFastRead;
+		}
+		pDesc = pDesc_next;
+	}
+
+	lReadAhead = depth;
+}
+
+__int64 AVIReadHandler::getStallTime(int stream, long *plStalls) {
+	AVIFileDesc *pDesc, *pDesc_next;
+	__int64 i64StallTime = 0;
+	long lStalls = 0;
+
+	if (!paf && !listFiles.IsEmpty()) {
+		pDesc = listFiles.AtHead();
+		while(pDesc_next = pDesc->NextFromHead()) {
+			if (pDesc->pFastRead) {
+				i64StallTime += pDesc->pFastRead->StallTime(stream);
+				lStalls += pDesc->pFastRead->Stalls(stream);
+			}
+			pDesc = pDesc_next;
+		}
+	}
+
+	if (plStalls)
+		*plStalls = lStalls;
+
+	return i64StallTime;
+}
+
 bool AVIReadHandler::isOptimizedForRealtime() {
 	return nRealTime!=0;
 }
@@ -2516,6 +2961,11 @@ void AVIReadHandler::FixCacheProblems(AVIReadStream *arse) {
 }
 
 long AVIReadHandler::ReadData(int stream, void *buffer, __int64 position, long len) {
+	AVIFileDesc *pDesc = lReadAhead ? _FileDesc((int)(position>>48)) : NULL;
+
+	if (pDesc && pDesc->pFastRead)
+		return pDesc->pFastRead->Read(stream, position & 0x0000FFFFFFFFFFFFi64, buffer, len);
+
 	if (nCurrentFile<0 || nCurrentFile != (int)(position>>48))
 		_SelectFile((int)(position>>48));
 
@@ -2526,6 +2976,103 @@ long AVIReadHandler::ReadData(int stream, void *buffer, __int64 position, long l
 	return _readFile(buffer, len);
 }
 
+void AVIReadHandler::Prefetch(int stream, __int64 position, long len) {
+	AVIFileDesc *pDesc = _FileDesc((int)(position>>48));
+
+	if (pDesc && pDesc->pFastRead)
+		pDesc->pFastRead->Prefetch(stream, position & 0x0000FFFFFFFFFFFFi64, len);
+}
+
+// Reads through a handle of its own at an explicit offset, so neither the
+// shared file pointer nor nCurrentFile is touched.  Safe to call from any
+// thread once the file list is complete.
+long AVIReadHandler::ReadDataPositional(void *buffer, __int64 position, long len) {
+	AVIFileDesc *pDesc = _FileDesc((int)(position>>48));
+
+	if (!pDesc || pDesc->hFilePositional == INVALID_HANDLE_VALUE)
+		return -1;
+
+	position &= 0x0000FFFFFFFFFFFFi64;
+
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset		= (DWORD)position;
+	ov.OffsetHigh	= (DWORD)(position>>32);
+
+	DWORD dwActual;
+	if (!ReadFile(pDesc->hFilePositional, buffer, len, &dwActual, &ov))
+		return -1;
+
+	return (long)dwActual;
+}
+
+// Maps len bytes at position read-only.  Views have to start on the
+// allocation granularity, so the view may begin before the data.
+const void *AVIReadHandler::MapDataPositional(__int64 position, long len, void **ppView) {
+	AVIFileDesc *pDesc = _FileDesc((int)(position>>48));
+
+	if (!pDesc || !pDesc->hMapping)
+		return NULL;
+
+	position &= 0x0000FFFFFFFFFFFFi64;
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+
+	const __int64 base = position - position % si.dwAllocationGranularity;
+	void *view = MapViewOfFile(pDesc->hMapping, FILE_MAP_READ, (DWORD)(base>>32), (DWORD)base, (SIZE_T)(position - base + len));
+
+	if (!view)
+		return NULL;
+
+	*ppView = view;
+	return (const char *)view + (position - base);
+}
+
+bool AVIReadHandler::isMappable() {
+	AVIFileDesc *pDesc, *pDesc_next;
+
+	if (listFiles.IsEmpty())
+		return false;
+
+	pDesc = listFiles.AtHead();
+	while(pDesc_next = pDesc->NextFromHead()) {
+		if (!pDesc->hMapping)
+			return false;
+		pDesc = pDesc_next;
+	}
+
+	return true;
+}
+
+// False if any segment failed to open its positional handle, in which
+// case only the shared file pointer can be used.
+bool AVIReadHandler::isPositionalReadable() {
+	AVIFileDesc *pDesc, *pDesc_next;
+
+	if (listFiles.IsEmpty())
+		return false;
+
+	pDesc = listFiles.AtHead();
+	while(pDesc_next = pDesc->NextFromHead()) {
+		if (pDesc->hFilePositional == INVALID_HANDLE_VALUE)
+			return false;
+		pDesc = pDesc_next;
+	}
+
+	return true;
+}
+
+AVIFileDesc *AVIReadHandler::_FileDesc(int file) {
+	AVIFileDesc *pDesc, *pDesc_next;
+
+	pDesc = listFiles.AtHead();
+	while((pDesc_next = pDesc->NextFromHead()) && file--)
+		pDesc = pDesc_next;
+
+	return pDesc_next ? pDesc : NULL;
+}
+
 void AVIReadHandler::_SelectFile(int file) {
 	AVIFileDesc *pDesc, *pDesc_next;
 
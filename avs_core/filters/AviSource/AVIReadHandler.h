@@ -43,6 +43,16 @@ public:
 	virtual bool isStreaming()=0;
 	virtual bool isKeyframeOnly()=0;
 
+	// Reads one frame of a discrete stream straight from its index entry.
+	// Keeps no position or streaming state, so it may be called from several
+	// threads at once.  Returns AVIERR_UNSUPPORTED if the stream can't do it.
+	virtual HRESULT ReadFrameConcurrent(long lFrame, void *lpBuffer, long cbBuffer, long *plBytes)=0;
+
+	// Maps the data of one frame of a discrete stream read-only.  *plBytes is
+	// 0 for a dropped frame and negative if the stream can't be mapped.  A
+	// non-NULL result must be released by passing *ppView to UnmapViewOfFile.
+	virtual const void *MapFrame(long lFrame, long *plBytes, void **ppView)=0;
+
 	virtual bool getVBRInfo(double& bitrate_mean, double& bitrate_stddev, double& maxdev)=0;
 };
 
@@ -57,9 +67,14 @@ public:
 	virtual bool isIndexFabricated()=0;
 	virtual bool AppendFile(const char *pszFile)=0;
 	virtual bool getSegmentHint(const char **ppszPath)=0;
+
+	// Reads up to depth chunks ahead of each stream in the background.
+	virtual void EnableReadAhead(int depth)=0;
+	// Microseconds the stream has waited on the disk since read-ahead was enabled.
+	virtual __int64 getStallTime(int stream, long *plStalls)=0;
 };
 
 IAVIReadHandler *CreateAVIReadHandler(PAVIFILE paf);
-IAVIReadHandler *CreateAVIReadHandler(const char *pszFile);
+IAVIReadHandler *CreateAVIReadHandler(const char *pszFile, bool fIndexCache = false);
 
 #endif
@@ -25,6 +25,7 @@
 #include <io.h>
 #include <cstdio>
 #include <cerrno>
+#include <chrono>
 
 
 #pragma warning(disable: 4244)    // conversion from __int64, possible loss of data
@@ -36,38 +37,55 @@ public:
 	long lBytes;
 	long lAge;
 	long lHistoryVal;
+	bool fPending;		// being read by some thread, i64BlockNo is already set
 };
 
-FastReadStream::FastReadStream(HANDLE hFile, long lBlockCount, long lBlockSize) {
+FastReadStream::FastReadStream(HANDLE hFile, long lBlockCount, long lBlockSize, long lReadAhead) {
 	this->hFile			= hFile;
 	this->iFile			= -1;
 
-	_Init(lBlockCount, lBlockSize);
+	_Init(lBlockCount, lBlockSize, lReadAhead);
 }
 
-FastReadStream::FastReadStream(int iFile, long lBlockCount, long lBlockSize) {
+FastReadStream::FastReadStream(int iFile, long lBlockCount, long lBlockSize, long lReadAhead) {
 	this->hFile			= INVALID_HANDLE_VALUE;
 	this->iFile			= iFile;
-	_Init(lBlockCount, lBlockSize);
+	_Init(lBlockCount, lBlockSize, lReadAhead);
 }
 
-void FastReadStream::_Init(long lBlockCount, long lBlockSize) {
+void FastReadStream::_Init(long lBlockCount, long lBlockSize, long lReadAhead) {
 	this->lBlockCount	= lBlockCount;
 	this->lBlockSize	= (lBlockSize + 4095) & -4096;
 	this->pHeaders		= new FastReadStreamHeader[this->lBlockCount];
 	this->pBuffer		= VirtualAlloc(NULL, this->lBlockCount * this->lBlockSize, MEM_COMMIT, PAGE_READWRITE);
 
+	// The reader and the read-ahead thread each need a block to themselves.
+
+	this->lReadAhead	= lReadAhead < lBlockCount - 2 ? lReadAhead : lBlockCount - 2;
+	this->fExit			= false;
+
+	for(int i=0; i<MAX_STREAMS; i++) {
+		i64StallTime[i] = 0;
+		lStalls[i] = 0;
+	}
+
 	if (!this->pHeaders || !this->pBuffer) {
-		delete this->pHeaders;
+		delete[] this->pHeaders;
 		if (this->pBuffer) VirtualFree(this->pBuffer, 0, MEM_RELEASE);
 
 		this->pHeaders = NULL;
 		this->pBuffer = NULL;
 	} else {
+		for(int i=0; i<this->lBlockCount; i++)
+			pHeaders[i].fPending = false;
+
 		Flush();
 	}
 
 	lHistory			= 0;
+
+	if (Ready() && this->lReadAhead > 0)
+		thread = std::thread(&FastReadStream::_ReadAheadThread, this);
 }
 
 bool FastReadStream::Ready() {
@@ -75,7 +93,16 @@ bool FastReadStream::Ready() {
 }
 
 FastReadStream::~FastReadStream() {
-	delete pHeaders;
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			fExit = true;
+		}
+		cv.notify_all();
+		thread.join();
+	}
+
+	delete[] pHeaders;
 	if (pBuffer) VirtualFree(pBuffer, 0, MEM_RELEASE);
 }
 
@@ -96,13 +123,17 @@ long FastReadStream::Read(int stream, __int64 i64Pos, void *pDest, long lBytes)
 
 //	_RPT3(0,"Read request: %ld bytes, pos %I64x, first block %I64d\n", lBytes, i64Pos, i64BlockNo);
 
+	// Blocks are only replaced with the lock held, so copying out of one is safe.
+
+	std::unique_lock<std::mutex> lock(mutex);
+
 	while(lBytes) {
 		long lInBlock;
 
 		lToCopy = lBlockSize - lOffset;
 		if (lToCopy > lBytes) lToCopy = lBytes;
 
-		iCacheBlock = _Commit(stream, i64BlockNo);
+		iCacheBlock = _Commit(stream, i64BlockNo, lock);
 		lInBlock = pHeaders[iCacheBlock].lBytes - lOffset;
 
 //		_RPT4(0,"(%ld) Reading %ld from cache block %d, offset %ld\n", stream, lToCopy, iCacheBlock, lOffset);
@@ -128,18 +159,77 @@ long FastReadStream::Read(int stream, __int64 i64Pos, void *pDest, long lBytes)
 	return lActual;
 }
 
+// Queues the blocks of a range the stream is going to read.  Requests beyond
+// the read-ahead depth are dropped; the reader fetches those itself.
+
+void FastReadStream::Prefetch(int stream, __int64 i64Pos, long lBytes) {
+	if (!thread.joinable() || lBytes <= 0)
+		return;
+
+	__int64 i64BlockNo = i64Pos / lBlockSize;
+	__int64 i64BlockLast = (i64Pos + lBytes - 1) / lBlockSize;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for(; i64BlockNo <= i64BlockLast && (long)queue.size() < lReadAhead; ++i64BlockNo) {
+			if (_Find(i64BlockNo) >= 0)
+				continue;
+
+			bool fQueued = false;
+
+			for(auto it = queue.begin(); it != queue.end(); ++it)
+				if (it->second == i64BlockNo) {
+					fQueued = true;
+					break;
+				}
+
+			if (!fQueued)
+				queue.push_back(std::make_pair(stream, i64BlockNo));
+		}
+	}
+
+	cv.notify_all();
+}
+
 void FastReadStream::Flush() {
+	std::lock_guard<std::mutex> lock(mutex);
+
 	for(int i=0; i<lBlockCount; i++) {
+		if (pHeaders[i].fPending)
+			continue;
+
 		pHeaders[i].i64BlockNo = -1;
 		pHeaders[i].fAccessedBits = 0;
 		pHeaders[i].lHistoryVal = 0;
 	}
 
+	queue.clear();
 	lHistory = 0;
 }
 
+__int64 FastReadStream::StallTime(int stream) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return stream < MAX_STREAMS ? i64StallTime[stream] : 0;
+}
+
+long FastReadStream::Stalls(int stream) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return stream < MAX_STREAMS ? lStalls[stream] : 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
+int FastReadStream::_Find(__int64 i64BlockNo) {
+	for(int i=0; i<lBlockCount; i++)
+		if (pHeaders[i].i64BlockNo == i64BlockNo)
+			return i;
+
+	return -1;
+}
+
 int FastReadStream::_PickVictim(int stream) {
 	int i;
 	int iLoneBlock = -1;
@@ -150,7 +240,7 @@ int FastReadStream::_PickVictim(int stream) {
 	// Look for an unused block.
 
 	for(i=0; i<lBlockCount; i++)
-		if (pHeaders[i].i64BlockNo == -1)
+		if (pHeaders[i].i64BlockNo == -1 && !pHeaders[i].fPending)
 			return i;
 
 	// Compile a list of streams with lone blocks.  These can't be replaced.
@@ -163,9 +253,13 @@ int FastReadStream::_PickVictim(int stream) {
 		fStreamEncounteredBits |= pHeaders[i].fAccessedBits;
 	}
 
-	// Look at the histories, and choose a few candidates.
+	// Look at the histories, and choose a few candidates.  Blocks still
+	// being read are off limits.
 
 	for(i=0; i<lBlockCount; i++) {
+		if (pHeaders[i].fPending)
+			continue;
+
 		long lThisHistory = lHistory - pHeaders[i].lHistoryVal;
 
 		if (lThisHistory<0) lThisHistory = 0x7FFFFFFF;
@@ -194,63 +288,142 @@ int FastReadStream::_PickVictim(int stream) {
 	return iPreferred>=0 ? iPreferred : iOurLowest>=0 ? iOurLowest : iGlobalLowest;
 }
 
-int FastReadStream::_Commit(int stream, __int64 i64BlockNo) {
+int FastReadStream::_Commit(int stream, __int64 i64BlockNo, std::unique_lock<std::mutex>& lock) {
+	std::chrono::steady_clock::time_point start;
+	bool fStalled = false;
 	int iCacheBlock;
-	int i;
 
-	// Already have the block?
+	for(;;) {
+		iCacheBlock = _Find(i64BlockNo);
 
-	for(i=0; i<lBlockCount; i++)
-		if (pHeaders[i].i64BlockNo == i64BlockNo) {
-			pHeaders[i].fAccessedBits |= 1L<<stream;
+		// Already have the block?
+
+		if (iCacheBlock >= 0 && !pHeaders[iCacheBlock].fPending) {
+			pHeaders[iCacheBlock].fAccessedBits |= 1L<<stream;
 //			_RPT1(0,"Commit(%I64d): cache hit\n", i64BlockNo);
-			return i;
+			break;
 		}
 
-	// Pick a replacement candidate.
+		if (!fStalled) {
+			fStalled = true;
+			start = std::chrono::steady_clock::now();
+		}
 
-	iCacheBlock = _PickVictim(stream);
+		// Being read ahead, or every block is busy: wait for one to finish.
 
-	// Replace it.
+		if (iCacheBlock >= 0 || (iCacheBlock = _PickVictim(stream)) < 0) {
+			cv.wait(lock);
+			continue;
+		}
 
-	try {
-		++lHistory;
+		// Replace it.
 
 		_RPT2(0,"Commit(%I64d): cache miss (stream %d)\n", i64BlockNo, stream);
-		if (iFile >= 0) {
-			int iActual;
+		_Fill(iCacheBlock, stream, i64BlockNo, lock);
+		break;
+	}
+
+	if (fStalled && stream < MAX_STREAMS) {
+		i64StallTime[stream] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		++lStalls[stream];
+	}
+
+	return iCacheBlock;
+}
+
+// Reads a block into a cache slot with the lock released.  A failed read
+// leaves an empty slot behind.
+
+void FastReadStream::_Fill(int iCacheBlock, int stream, __int64 i64BlockNo, std::unique_lock<std::mutex>& lock) {
+	FastReadStreamHeader& hdr = pHeaders[iCacheBlock];
+	long lActual = -1;
 
-			if (-1 == _lseeki64(iFile, i64BlockNo * lBlockSize, SEEK_SET))
-				throw MyError("FastRead seek error: %s.", strerror(errno));
+	++lHistory;
 
-			iActual = _read(iFile, (char *)pBuffer + iCacheBlock * lBlockSize, lBlockSize);
+	hdr.i64BlockNo = i64BlockNo;
+	hdr.fAccessedBits = 0;
+	hdr.lBytes = 0;
+	hdr.fPending = true;
 
-			if (iActual < 0)
-				throw MyError("FastRead read error: %s.", strerror(errno));
+	lock.unlock();
 
-			pHeaders[iCacheBlock].lBytes = iActual;
+	try {
+		lActual = _ReadBlock(i64BlockNo, (char *)pBuffer + iCacheBlock * lBlockSize);
+	} catch(...) {
+	}
+
+	lock.lock();
+
+	hdr.fPending = false;
+
+	if (lActual < 0) {
+		hdr.i64BlockNo = -1;
+		hdr.fAccessedBits = 0;
+	} else {
+		hdr.lBytes = lActual;
+		hdr.fAccessedBits = 1L<<stream;
+		hdr.lHistoryVal = lHistory;
+	}
+
+	cv.notify_all();
+}
 
-		} else {
-			LONG lLow = (LONG)i64BlockNo*lBlockSize;
-			LONG lHigh = (LONG)((i64BlockNo*lBlockSize) >> 32);
-			DWORD err, dwActual;
+long FastReadStream::_ReadBlock(__int64 i64BlockNo, void *pDest) {
+	if (iFile >= 0) {
+		std::lock_guard<std::mutex> lock(io_mutex);
+		int iActual;
 
-			if (0xFFFFFFFF == SetFilePointer(hFile, lLow, &lHigh, FILE_BEGIN))
-				if ((err = GetLastError()) != NO_ERROR)
-					throw MyWin32Error("FastRead seek error: %%s", GetLastError());
+		if (-1 == _lseeki64(iFile, i64BlockNo * lBlockSize, SEEK_SET))
+			throw MyError("FastRead seek error: %s.", strerror(errno));
 
-			if (!ReadFile(hFile, (char *)pBuffer + iCacheBlock * lBlockSize, lBlockSize, &dwActual, NULL))
+		iActual = _read(iFile, pDest, lBlockSize);
+
+		if (iActual < 0)
+			throw MyError("FastRead read error: %s.", strerror(errno));
+
+		return iActual;
+
+	} else {
+		__int64 i64Pos = i64BlockNo * lBlockSize;
+		OVERLAPPED ov;
+		DWORD dwActual;
+
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset		= (DWORD)i64Pos;
+		ov.OffsetHigh	= (DWORD)(i64Pos>>32);
+
+		if (!ReadFile(hFile, pDest, lBlockSize, &dwActual, &ov)) {
+			if (GetLastError() != ERROR_HANDLE_EOF)
 				throw MyWin32Error("FastRead read error: %%s", GetLastError());
 
-			pHeaders[iCacheBlock].lBytes = dwActual;
+			dwActual = 0;
 		}
-		pHeaders[iCacheBlock].i64BlockNo = i64BlockNo;
-		pHeaders[iCacheBlock].fAccessedBits = 1L<<stream;
-		pHeaders[iCacheBlock].lHistoryVal = lHistory;
-	} catch(...) {
-		pHeaders[iCacheBlock].i64BlockNo = -1;
-		pHeaders[iCacheBlock].fAccessedBits = 0;
+
+		return dwActual;
 	}
+}
 
-	return iCacheBlock;
-}
\ No newline at end of file
+void FastReadStream::_ReadAheadThread() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for(;;) {
+		while(!fExit && queue.empty())
+			cv.wait(lock);
+
+		if (fExit)
+			break;
+
+		int stream = queue.front().first;
+		__int64 i64BlockNo = queue.front().second;
+
+		queue.pop_front();
+
+		if (_Find(i64BlockNo) >= 0)
+			continue;
+
+		int iCacheBlock = _PickVictim(stream);
+
+		if (iCacheBlock >= 0)
+			_Fill(iCacheBlock, stream, i64BlockNo, lock);
+	}
+}
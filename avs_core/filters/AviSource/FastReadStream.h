@@ -22,32 +22,62 @@
 #define f_VIRTUALDUB_FASTREADSTREAM_H
 
 #include <avs/win.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
 
 class FastReadStreamHeader;
 
+// Block cache over a file.  With a non-zero read-ahead, blocks announced
+// through Prefetch() are read by a background thread, up to lReadAhead
+// blocks ahead of the reader.  Read() and Prefetch() are thread safe; reads
+// through a HANDLE are positional and leave its file pointer alone.
 class FastReadStream {
 public:
-	FastReadStream(HANDLE hFile, long lBlockCount, long lBlockSize);
-	FastReadStream(int iFile, long lBlockCount, long lBlockSize);
+	FastReadStream(HANDLE hFile, long lBlockCount, long lBlockSize, long lReadAhead = 0);
+	FastReadStream(int iFile, long lBlockCount, long lBlockSize, long lReadAhead = 0);
 	virtual ~FastReadStream();
 
 	bool Ready();
 	long Read(int stream, __int64 i64Pos, void *pBuffer, long lBytes);
+	void Prefetch(int stream, __int64 i64Pos, long lBytes);
 	void Flush();
 
+	// Time a stream has spent waiting for data that wasn't cached yet.
+	__int64 StallTime(int stream);	// microseconds
+	long Stalls(int stream);
+
 private:
+	enum { MAX_STREAMS = 32 };
+
 	HANDLE hFile;
 	int iFile;
 	long lBlockCount;
 	long lBlockSize;
 	long lHistory;
+	long lReadAhead;
 
 	FastReadStreamHeader *pHeaders;
 	void *pBuffer;
 
-	void _Init(long lBlockCount, long lBlockSize);
+	std::mutex mutex;				// guards everything but the block data being read
+	std::mutex io_mutex;			// iFile reads move the file pointer
+	std::condition_variable cv;		// a block was filled or a prefetch queued
+	std::deque<std::pair<int, __int64> > queue;	// (stream, block) to read ahead
+	std::thread thread;
+	bool fExit;
+
+	__int64 i64StallTime[MAX_STREAMS];
+	long lStalls[MAX_STREAMS];
+
+	void _Init(long lBlockCount, long lBlockSize, long lReadAhead);
+	int _Find(__int64 i64BlockNo);
 	int _PickVictim(int stream);
-	int _Commit(int stream, __int64 i64BlockNo);
+	int _Commit(int stream, __int64 i64BlockNo, std::unique_lock<std::mutex>& lock);
+	void _Fill(int iCacheBlock, int stream, __int64 i64BlockNo, std::unique_lock<std::mutex>& lock);
+	long _ReadBlock(__int64 i64BlockNo, void *pDest);
+	void _ReadAheadThread();
 };
 
 #endif
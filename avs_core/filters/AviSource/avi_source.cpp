@@ -41,6 +41,7 @@
 #include "AVIReadHandler.h"
 #include "avi_source.h"
 #include <avs/minmax.h>
+#include <avs/alignment.h>
 
 static PVideoFrame AdjustFrameAlignment(const PVideoFrame& frame, const VideoInfo& vi, IScriptEnvironment* env)
 {
@@ -104,6 +105,13 @@ LRESULT AVISource::DecompressFrame(int n, bool preroll, PVideoFrame &frame, IScr
                                           0, 0, vi.width, vi.height);
     if (result != ICERR_OK) return result;
   }
+  UnpackFrame(frame, env);
+  return ICERR_OK;
+}
+
+// Brings a decoded DIB into AviSynth layout: planar frames are repacked
+// as subframes, bottom-up RGB is flipped in place.
+void AVISource::UnpackFrame(PVideoFrame &frame, IScriptEnvironment* env) {
   if (!bMediaPad && !vi.IsY8() && vi.IsPlanar()) {
     // Planar frames are packed!
     const int rowsizeY  = vi.RowSize(PLANAR_Y);
@@ -131,7 +139,7 @@ LRESULT AVISource::DecompressFrame(int n, bool preroll, PVideoFrame &frame, IScr
   else if (bInvertFrames) {
     const int h2 = frame->GetHeight() >> 1;
     const int w4 = (frame->GetRowSize()+3) >> 2;
-    long *pT = (long*)buf;
+    long *pT = (long*)frame->GetWritePtr();
     long *pB = pT + w4 * (frame->GetHeight() - 1);
 
     // Inplace flip RGB frame
@@ -145,6 +153,154 @@ LRESULT AVISource::DecompressFrame(int n, bool preroll, PVideoFrame &frame, IScr
       pB -= w4;
     }
   }
+}
+
+bool AVISource::IsIntraOnly() {
+  long bytes;
+  if (pvideo->ReadFrameConcurrent(0, NULL, 0, &bytes) == AVIERR_UNSUPPORTED)
+    return false;
+
+  if (hic) {
+    ICINFO info;
+    if (!ICGetInfo(hic, &info, sizeof(info)))
+      return false;
+    fccDecoder = info.fccHandler;
+  }
+
+  if (!hic || pvideo->isKeyframeOnly())
+    return true;
+
+  // Dropped frames have no data and carry no keyframe flag
+  for (int i = 0; i < vi.num_frames; ++i) {
+    if (!pvideo->IsKeyFrame(i) && (pvideo->ReadFrameConcurrent(i, NULL, 0, &bytes) != 0 || bytes != 0))
+      return false;
+  }
+  return true;
+}
+
+HIC AVISource::AcquireDecoder(IScriptEnvironment* env) {
+  {
+    std::lock_guard<std::mutex> lock(decoder_mutex);
+    if (!idle_decoders.empty()) {
+      HIC decoder = idle_decoders.back();
+      idle_decoders.pop_back();
+      return decoder;
+    }
+  }
+
+  HIC decoder = ICOpen(ICTYPE_VIDEO, fccDecoder, ICMODE_DECOMPRESS);
+  if (!decoder)
+    env->ThrowError("AVISource: couldn't open another instance of the video decompressor");
+
+  LRESULT result = !ex ? ICDecompressBegin(decoder, pbiSrc, &biDst)
+                       : ICDecompressExBegin(decoder, 0,
+                           pbiSrc, 0, 0, 0, pbiSrc->biWidth, pbiSrc->biHeight,
+                           &biDst, 0, 0, 0, biDst.biWidth, biDst.biHeight);
+  if (result != ICERR_OK) {
+    ICClose(decoder);
+    env->ThrowError("AVISource: couldn't start another instance of the video decompressor");
+  }
+  return decoder;
+}
+
+void AVISource::ReleaseDecoder(HIC decoder) {
+  std::lock_guard<std::mutex> lock(decoder_mutex);
+  idle_decoders.push_back(decoder);
+}
+
+static void __cdecl UnmapFrameView(void* view, IScriptEnvironment*) {
+  UnmapViewOfFile(view);
+}
+
+static bool IsFrameAligned(const PVideoFrame& frame) {
+  return IsPtrAligned(frame->GetReadPtr(),         FRAME_ALIGN) && !(frame->GetPitch()         & (FRAME_ALIGN-1))
+      && IsPtrAligned(frame->GetReadPtr(PLANAR_U), FRAME_ALIGN) && !(frame->GetPitch(PLANAR_U) & (FRAME_ALIGN-1))
+      && IsPtrAligned(frame->GetReadPtr(PLANAR_V), FRAME_ALIGN) && !(frame->GetPitch(PLANAR_V) & (FRAME_ALIGN-1));
+}
+
+// Wraps the mapped file data of frame n in a read-only frame.  Returns
+// false if the data can't be mapped, the caller then reads it instead.
+bool AVISource::MapFrame(int n, PVideoFrame &frame, bool &dropped, IScriptEnvironment* env) {
+  void* view = NULL;
+  long bytes;
+  const BYTE* data = (const BYTE*)pvideo->MapFrame(n, &bytes, &view);
+
+  dropped = !bytes;
+  if (dropped)
+    return true;
+  if (!data)
+    return false;
+
+  int pitch, offsetU = 0, offsetV = 0, pitchUV = 0, row_sizeUV = 0, heightUV = 0;
+  int size;
+
+  if (!vi.IsY8() && vi.IsPlanar()) {
+    // Planar frames are packed, see UnpackFrame
+    pitch      = vi.RowSize(PLANAR_Y);
+    row_sizeUV = pitchUV = vi.RowSize(PLANAR_U);
+    heightUV   = vi.height >> vi.GetPlaneHeightSubsampling(PLANAR_U);
+
+    const int sizeY  = pitch * vi.height;
+    const int sizeUV = pitchUV * heightUV;
+    offsetV = vi.IsVPlaneFirst() ? sizeY : sizeY + sizeUV;
+    offsetU = vi.IsVPlaneFirst() ? sizeY + sizeUV : sizeY;
+    size    = sizeY + 2 * sizeUV;
+  }
+  else {
+    pitch = (vi.RowSize() + 3) & ~3;
+    size  = pitch * vi.height;
+  }
+
+  if (bytes < size) {
+    UnmapViewOfFile(view);
+    return false;
+  }
+
+  // The frame is never writable, so the mapped pages are only ever read
+  frame = static_cast<IScriptEnvironment2*>(env)->NewExternalVideoFrame(
+    const_cast<BYTE*>(data), size, pitch, vi.RowSize(), vi.height,
+    offsetU, offsetV, pitchUV, row_sizeUV, heightUV, UnmapFrameView, view);
+  return true;
+}
+
+// Thread safe counterpart of DecompressFrame for keyframe-only streams.
+LRESULT AVISource::DecompressFrameConcurrent(int n, PVideoFrame &frame, bool &dropped, IScriptEnvironment* env) {
+  BYTE* buf = frame->GetWritePtr();
+  long bytes_read;
+
+  dropped = false;
+  if (!hic) {
+    if (pvideo->ReadFrameConcurrent(n, buf, vi.BMPSize(), &bytes_read) != 0)
+      return ICERR_ERROR;
+    dropped = !bytes_read;
+    if (dropped) return ICERR_OK;
+  }
+  else {
+    pvideo->ReadFrameConcurrent(n, NULL, 0, &bytes_read);
+    dropped = !bytes_read;
+    if (dropped) return ICERR_OK;
+
+    // 16 guard bytes, see DecompressFrame
+    std::vector<BYTE> data(bytes_read + 16, 0xA5);
+    data[bytes_read + 15] = 0;
+    if (pvideo->ReadFrameConcurrent(n, &data[0], bytes_read, &bytes_read) != 0)
+      return ICERR_ERROR;
+
+    // Both headers are handed to the codec as non-const, so use private copies
+    std::vector<BYTE> format((BYTE*)pbiSrc, (BYTE*)pbiSrc + pbiSrc_size);
+    BITMAPINFOHEADER* biSrc = (BITMAPINFOHEADER*)&format[0];
+    biSrc->biSizeImage = bytes_read;
+    BITMAPINFOHEADER bi = biDst;
+
+    HIC decoder = AcquireDecoder(env);
+    LRESULT result = !ex ? ICDecompress  (decoder, 0, biSrc, &data[0], &bi, buf)
+                         : ICDecompressEx(decoder, 0, biSrc, &data[0],
+                                          0, 0, vi.width, vi.height,     &bi, buf,
+                                          0, 0, vi.width, vi.height);
+    ReleaseDecoder(decoder);
+    if (result != ICERR_OK) return result;
+  }
+  UnpackFrame(frame, env);
   return ICERR_OK;
 }
 
@@ -223,6 +379,7 @@ void AVISource::LocateVideoCodec(const char fourCC[], IScriptEnvironment* env) {
     pbiSrc = (LPBITMAPINFOHEADER)malloc(size);
     CheckHresult(pvideo->ReadFormat(0, pbiSrc, &size), "couldn't get video format", env);
   }
+  pbiSrc_size = size;
 
   vi.width = pbiSrc->biWidth;
   vi.height = pbiSrc->biHeight < 0 ? -pbiSrc->biHeight : pbiSrc->biHeight;
@@ -283,7 +440,7 @@ void AVISource::LocateVideoCodec(const char fourCC[], IScriptEnvironment* env) {
 }
 
 
-AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[], const char fourCC[], int vtrack, int atrack, int mode, IScriptEnvironment* env) {
+AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[], const char fourCC[], int vtrack, int atrack, int mode, int readahead, bool indexcache, IScriptEnvironment* env) {
   srcbuffer = 0; srcbuffer_size = 0;
   memset(&vi, 0, sizeof(vi));
   ex = false;
@@ -297,6 +454,9 @@ AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[]
   hic = 0;
   bInvertFrames = false;
   bMediaPad = false;
+  concurrent = false;
+  mapped = false;
+  fccDecoder = 0;
 
   AVIFileInit();
   try {
@@ -330,7 +490,8 @@ AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[]
 	  }
 	  pfile = CreateAVIReadHandler(paf);
     } else {              // OpenDML mode
-      pfile = CreateAVIReadHandler(filename);
+      pfile = CreateAVIReadHandler(filename, indexcache);
+      pfile->EnableReadAhead(readahead);
     }
 
     if (mode != MODE_WAV) { // check for video stream
@@ -573,6 +734,20 @@ AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[]
       }
       last_frame_no=0;
       last_frame = AdjustFrameAlignment(frame, vi, env);
+
+      if (IsIntraOnly()) {
+        _RPT0(0,"AVISource: Keyframe-only stream, decoding concurrently.\n");
+        concurrent = true;
+        if (hic)
+          idle_decoders.push_back(hic);
+        else {
+          long bytes;
+          void* view;
+          mapped = !bInvertFrames && !bMediaPad && pvideo->MapFrame(0, &bytes, &view) != NULL;
+          if (mapped)
+            UnmapViewOfFile(view);
+        }
+      }
     }
   }
   catch (...) {
@@ -586,6 +761,13 @@ AVISource::~AVISource() {
 }
 
 void AVISource::CleanUp() { // Tritical - Jan 2006
+  for (size_t i = 0; i < idle_decoders.size(); ++i) {
+    if (idle_decoders[i] == hic)
+      continue;
+    !ex ? ICDecompressEnd(idle_decoders[i]) : ICDecompressExEnd(idle_decoders[i]);
+    ICClose(idle_decoders[i]);
+  }
+  idle_decoders.clear();
   if (hic) {
     !ex ? ICDecompressEnd(hic) : ICDecompressExEnd(hic);
     ICClose(hic);
@@ -604,9 +786,42 @@ void AVISource::CleanUp() { // Tritical - Jan 2006
 
 const VideoInfo& AVISource::GetVideoInfo() { return vi; }
 
+// Decodes frame n without touching any per-clip state.  Only dropped
+// frames are skipped, repeating the nearest earlier one like the
+// sequential path does; a frame that fails to read or decode throws.
+PVideoFrame AVISource::GetFrameConcurrent(int n, IScriptEnvironment* env) {
+  PVideoFrame frame;
+  for (int i = n; i >= 0; --i) {
+    bool dropped;
+    // A frame that can't be mapped is still read through the decode path
+    if (mapped && MapFrame(i, frame, dropped, env)) {
+      if (dropped)
+        continue;
+      return IsFrameAligned(frame) ? frame : AdjustFrameAlignment(frame, vi, env);
+    }
+
+    if (!frame) {
+      frame = env->NewVideoFrame(vi, -4);
+      if (!frame)
+        env->ThrowError("AviSource: Could not allocate frame %d", n);
+    }
+
+    LRESULT error = DecompressFrameConcurrent(i, frame, dropped, env);
+    if (error != ICERR_OK)
+      env->ThrowError("AVISource: could not decompress frame %d.", i);
+    if (!dropped)
+      return AdjustFrameAlignment(frame, vi, env);
+  }
+  return last_frame;  // leading drops repeat the first keyframe, decoded in the constructor
+}
+
 PVideoFrame AVISource::GetFrame(int n, IScriptEnvironment* env) {
 
   n = clamp(n, 0, vi.num_frames-1);
+  if (concurrent)
+    return GetFrameConcurrent(n, env);
+
+  std::lock_guard<std::mutex> lock(read_mutex);
   dropped_frame=false;
   if (n != last_frame_no) {
     // find the last keyframe
@@ -650,6 +865,7 @@ PVideoFrame AVISource::GetFrame(int n, IScriptEnvironment* env) {
 }
 
 void AVISource::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
+  std::lock_guard<std::mutex> lock(read_mutex);
   long bytes_read=0;
   __int64 samples_read=0;
 
@@ -679,7 +895,7 @@ int __stdcall AVISource::SetCacheHints(int cachehints,int frame_range)
   switch(cachehints)
   {
   case CACHE_GET_MTMODE:
-    return MT_SERIALIZED;
+    return MT_NICE_FILTER;  // serializes itself where needed
   default:
     return 0;
   }
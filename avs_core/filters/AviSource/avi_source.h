@@ -35,6 +35,8 @@
 #include "../../core/alignplanar.h"
 #include "VD_Audio.h"
 #include "AVIReadHandler.h"
+#include <vector>
+#include <mutex>
 
 
 class AVISource : public IClip {
@@ -45,6 +47,7 @@ class AVISource : public IClip {
   BYTE* srcbuffer;
   int srcbuffer_size;
   BITMAPINFOHEADER* pbiSrc;
+  long pbiSrc_size;
   BITMAPINFOHEADER biDst;
   bool ex;
   bool dropped_frame;
@@ -57,9 +60,28 @@ class AVISource : public IClip {
   AudioSource* aSrc;
   AudioStreamSource* audioStreamSource;
   __int64 audio_stream_pos;
+  std::mutex read_mutex;  // audio, and video unless decoded concurrently
+
+  // Keyframe-only streams are read by index position and decoded on the
+  // calling thread, with a decoder instance taken from this pool.
+  bool concurrent;
+  DWORD fccDecoder;
+  std::vector<HIC> idle_decoders;
+  std::mutex decoder_mutex;
+  // Uncompressed frames of a mappable file are delivered straight from the
+  // mapped file pages instead of being read into a new frame.
+  bool mapped;
 
   LRESULT DecompressBegin(LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst);
   LRESULT DecompressFrame(int n, bool preroll, PVideoFrame &frame, IScriptEnvironment* env);
+  void UnpackFrame(PVideoFrame &frame, IScriptEnvironment* env);
+
+  bool IsIntraOnly();
+  HIC AcquireDecoder(IScriptEnvironment* env);
+  void ReleaseDecoder(HIC decoder);
+  LRESULT DecompressFrameConcurrent(int n, PVideoFrame &frame, bool &dropped, IScriptEnvironment* env);
+  PVideoFrame GetFrameConcurrent(int n, IScriptEnvironment* env);
+  bool MapFrame(int n, PVideoFrame &frame, bool &dropped, IScriptEnvironment* env);
 
   void CheckHresult(HRESULT hr, const char* msg, IScriptEnvironment* env);
   bool AttemptCodecNegotiation(DWORD fccHandler, BITMAPINFOHEADER* bmih);
@@ -75,7 +97,7 @@ public:
   };
 
   AVISource(const char filename[], bool fAudio, const char pixel_type[],
-            const char fourCC[], int vtrack, int atrack, int mode, IScriptEnvironment* env);  // mode: 0=detect, 1=avifile, 2=opendml, 3=avifile (audio only)
+            const char fourCC[], int vtrack, int atrack, int mode, int readahead, bool indexcache, IScriptEnvironment* env);  // mode: 0=detect, 1=avifile, 2=opendml, 3=avifile (audio only)
   ~AVISource();
   void CleanUp(); // Tritical - Jan 2006
   const VideoInfo& __stdcall GetVideoInfo();
@@ -91,10 +113,17 @@ public:
     const char* fourCC = (mode != MODE_WAV) ? args[3].AsString("") : "";
     const int vtrack = args[4].AsInt(0);
     const int atrack = args[5].AsInt(0);
+    // Read-ahead and the index cache need the OpenDML handler, so AVIFileSource doesn't take them
+    const bool has_opendml = (mode == MODE_NORMAL) || (mode == MODE_OPENDML);
+    const int readahead = has_opendml ? args[6].AsInt(0) : 0;
+    const bool indexcache = has_opendml && args[7].AsBool(false);
+
+    if (readahead < 0)
+      env->ThrowError("AVISource: readahead must not be negative");
 
-    PClip result = new AVISource(args[0][0].AsString(), fAudio, pixel_type, fourCC, vtrack, atrack, mode, env);
+    PClip result = new AVISource(args[0][0].AsString(), fAudio, pixel_type, fourCC, vtrack, atrack, mode, readahead, indexcache, env);
     for (int i=1; i<args[0].ArraySize(); ++i)
-      result = new_Splice(result, new AVISource(args[0][i].AsString(), fAudio, pixel_type, fourCC, vtrack, atrack, mode, env), false, env);
+      result = new_Splice(result, new AVISource(args[0][i].AsString(), fAudio, pixel_type, fourCC, vtrack, atrack, mode, readahead, indexcache, env), false, env);
     return AlignPlanar::Create(result);
   }
 };
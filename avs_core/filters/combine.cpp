@@ -34,6 +34,7 @@
 
 #include "combine.h"
 #include "../core/internal.h"
+#include "../core/bitblt.h"
 #include <avs/win.h>
 #include <avs/minmax.h>
 #include <cmath>
@@ -62,6 +63,18 @@ extern const AVSFunction Combine_filters[] = {
 
 
 
+// Copies one plane of src, or fills it when src is known to be a single colour,
+// which leaves the source frame unread.
+static void stack_plane(BYTE* dstp, int dst_pitch, const PVideoFrame& src, int plane, int row_size, int height, IScriptEnvironment* env)
+{
+  const int period = src->GetConstantPeriod();
+  if (period)
+    FillPlane(dstp, dst_pitch, src->GetConstantPattern(plane), period, row_size, height);
+  else
+    env->BitBlt(dstp, dst_pitch, src->GetReadPtr(plane), src->GetPitch(plane), row_size, height);
+}
+
+
 /********************************
  *******   StackVertical   ******
  ********************************/
@@ -108,22 +121,18 @@ PVideoFrame __stdcall StackVertical::GetFrame(int n, IScriptEnvironment* env)
     // reverse the order of the clips in RGB mode because it's upside-down
     for (size_t i = children.size(); i-- > 0; /* empty */)
     {
-      const BYTE* srcp = frames[i]->GetReadPtr();
-      const int src_pitch = frames[i]->GetPitch();
       const int src_height = frames[i]->GetHeight();
 
-      env->BitBlt(dstp, dst_pitch, srcp, src_pitch, row_size, src_height);
+      stack_plane(dstp, dst_pitch, frames[i], 0, row_size, src_height, env);
       dstp += dst_pitch * src_height;
     }
   }
   else {
     for (size_t i = 0; i < nClips; ++i)
     {
-      const BYTE* srcp = frames[i]->GetReadPtr();
-      const int src_pitch = frames[i]->GetPitch();
       const int src_height = frames[i]->GetHeight();
 
-      env->BitBlt(dstp, dst_pitch, srcp, src_pitch, row_size, src_height);
+      stack_plane(dstp, dst_pitch, frames[i], 0, row_size, src_height, env);
       dstp += dst_pitch * src_height;
     }
     
@@ -137,11 +146,9 @@ PVideoFrame __stdcall StackVertical::GetFrame(int n, IScriptEnvironment* env)
         BYTE* dstp_uv = dst->GetWritePtr(plane);
         for (size_t i = 0; i < nClips; ++i)
         {
-          const BYTE* srcp = frames[i]->GetReadPtr(plane);
-          const int src_pitch = frames[i]->GetPitch(plane);
           const int src_height = frames[i]->GetHeight(plane);
 
-          env->BitBlt(dstp_uv, dst_pitchUV, srcp, src_pitch, row_sizeUV, src_height);
+          stack_plane(dstp_uv, dst_pitchUV, frames[i], plane, row_sizeUV, src_height, env);
           dstp_uv += dst_pitchUV * src_height;
         }
       }
@@ -223,11 +230,9 @@ PVideoFrame __stdcall StackHorizontal::GetFrame(int n, IScriptEnvironment* env)
   BYTE* dstp = dst->GetWritePtr();
   for (size_t i = 0; i < nClips; ++i)
   {
-    const BYTE* srcp = frames[i]->GetReadPtr();
-    const int src_pitch = frames[i]->GetPitch();
     const int src_rowsize = frames[i]->GetRowSize();
 
-    env->BitBlt(dstp, dst_pitch, srcp, src_pitch, src_rowsize, height);
+    stack_plane(dstp, dst_pitch, frames[i], 0, src_rowsize, height, env);
     dstp += src_rowsize;
   }
 
@@ -241,11 +246,9 @@ PVideoFrame __stdcall StackHorizontal::GetFrame(int n, IScriptEnvironment* env)
       BYTE* dstp_uv = dst->GetWritePtr(plane);
       for (size_t i = 0; i < nClips; ++i)
       {
-        const BYTE* srcp = frames[i]->GetReadPtr(plane);
-        const int src_pitch = frames[i]->GetPitch(plane);
         const int src_width = frames[i]->GetRowSize(plane);
 
-        env->BitBlt(dstp_uv, dst_pitchUV, srcp, src_pitch, src_width, heightUV);
+        stack_plane(dstp_uv, dst_pitchUV, frames[i], plane, src_width, heightUV, env);
         dstp_uv += src_width;
       }
     }
@@ -39,6 +39,8 @@
 #include <avs/minmax.h>
 #include <avs/alignment.h>
 #include <emmintrin.h>
+#include <mutex>
+#include <map>
 
 
 extern const AVSFunction Conditional_funtions_filters[] = {
@@ -122,120 +124,128 @@ AVSValue __cdecl AveragePlane::Create_v(AVSValue args, void* user_data, IScriptE
   return AvgPlane(args[0],user_data, PLANAR_V, env);
 }
 
-// Average plane
-static size_t get_sum_of_pixels_c(const BYTE* srcp, size_t height, size_t width, size_t pitch) {
-  unsigned int accum = 0;
-  for (size_t y = 0; y < height; y++) {
-    for (size_t x = 0; x < width; x++) {
-      accum += srcp[x];
+// Runtime statistics of a plane: the sum for AverageLuma and friends
+// and the histogram for the *PlaneMin/Max/Median functions.
+struct PlaneStats {
+  size_t sum;
+  unsigned int histogram[256];
+};
+
+// Fused statistics pass. Every pixel is read once and gives the sum, its
+// histogram count and, if other_ptr is set, the SAD against other_ptr.
+// Counting into four partial histograms keeps runs of equal pixels from
+// waiting on the same counter.
+static void get_plane_stats_c(const BYTE* srcp, const BYTE* other_ptr, size_t height, size_t width, size_t pitch, size_t other_pitch, PlaneStats* stats, size_t* sad) {
+  unsigned int partial[4][256] = {};
+  size_t mod4_width = width / 4 * 4;
+  size_t sum = 0;
+  size_t sad_sum = 0;
+
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < mod4_width; x+=4) {
+      partial[0][srcp[x]]++;
+      partial[1][srcp[x+1]]++;
+      partial[2][srcp[x+2]]++;
+      partial[3][srcp[x+3]]++;
+      sum += srcp[x] + srcp[x+1] + srcp[x+2] + srcp[x+3];
+    }
+
+    for (size_t x = mod4_width; x < width; ++x) {
+      partial[0][srcp[x]]++;
+      sum += srcp[x];
+    }
+
+    if (other_ptr != NULL) {
+      for (size_t x = 0; x < width; ++x) {
+        sad_sum += abs(srcp[x] - other_ptr[x]);
+      }
+      other_ptr += other_pitch;
     }
+
     srcp += pitch;
   }
-  return accum;
+
+  for (int i = 0; i < 256; ++i) {
+    stats->histogram[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+  }
+  stats->sum = sum;
+  if (sad != NULL)
+    *sad = sad_sum;
 }
 
-static size_t get_sum_of_pixels_sse2(const BYTE* srcp, size_t height, size_t width, size_t pitch) {
+// The sum and the SAD come from psadbw on the block which was just loaded;
+// the histogram is counted from the same 16 pixels while they are in L1.
+template<bool with_sad>
+static void get_plane_stats_sse2(const BYTE* srcp, const BYTE* other_ptr, size_t height, size_t width, size_t pitch, size_t other_pitch, PlaneStats* stats, size_t* sad) {
+  unsigned int partial[4][256] = {};
   size_t mod16_width = width / 16 * 16;
-  int result = 0;
+  size_t sum_rest = 0;
+  size_t sad_rest = 0;
   __m128i sum = _mm_setzero_si128();
+  __m128i sad_sum = _mm_setzero_si128();
   __m128i zero = _mm_setzero_si128();
 
   for (size_t y = 0; y < height; ++y) {
     for (size_t x = 0; x < mod16_width; x+=16) {
       __m128i src = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + x));
-      __m128i sad = _mm_sad_epu8(src, zero);
-      sum = _mm_add_epi32(sum, sad);
+      sum = _mm_add_epi32(sum, _mm_sad_epu8(src, zero));
+      if (with_sad) {
+        __m128i other = _mm_load_si128(reinterpret_cast<const __m128i*>(other_ptr + x));
+        sad_sum = _mm_add_epi32(sad_sum, _mm_sad_epu8(src, other));
+      }
+
+      const BYTE* block = srcp + x;
+      for (int i = 0; i < 16; i+=4) {
+        partial[0][block[i]]++;
+        partial[1][block[i+1]]++;
+        partial[2][block[i+2]]++;
+        partial[3][block[i+3]]++;
+      }
     }
 
     for (size_t x = mod16_width; x < width; ++x) {
-      result += srcp[x];
+      partial[0][srcp[x]]++;
+      sum_rest += srcp[x];
+      if (with_sad)
+        sad_rest += std::abs(srcp[x] - other_ptr[x]);
     }
 
     srcp += pitch;
+    if (with_sad)
+      other_ptr += other_pitch;
   }
-  __m128i upper = _mm_castps_si128(_mm_movehl_ps(_mm_setzero_ps(), _mm_castsi128_ps(sum)));
-  sum = _mm_add_epi32(sum, upper);
-  result += _mm_cvtsi128_si32(sum);
-  return result;
-}
-
-#ifdef X86_32
-static size_t get_sum_of_pixels_isse(const BYTE* srcp, size_t height, size_t width, size_t pitch) {
-  size_t mod8_width = width / 8 * 8;
-  int result = 0;
-  __m64 sum = _mm_setzero_si64();
-  __m64 zero = _mm_setzero_si64();
 
-  for (size_t y = 0; y < height; ++y) {
-    for (size_t x = 0; x < mod8_width; x+=8) {
-      __m64 src = *reinterpret_cast<const __m64*>(srcp + x);
-      __m64 sad = _mm_sad_pu8(src, zero);
-      sum = _mm_add_pi32(sum, sad);
-    }
+  for (int i = 0; i < 256; ++i) {
+    stats->histogram[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+  }
 
-    for (size_t x = mod8_width; x < width; ++x) {
-      result += srcp[x];
-    }
+  __m128i upper = _mm_castps_si128(_mm_movehl_ps(_mm_setzero_ps(), _mm_castsi128_ps(sum)));
+  sum = _mm_add_epi32(sum, upper);
+  stats->sum = sum_rest + _mm_cvtsi128_si32(sum);
 
-    srcp += pitch;
+  if (with_sad) {
+    upper = _mm_castps_si128(_mm_movehl_ps(_mm_setzero_ps(), _mm_castsi128_ps(sad_sum)));
+    sad_sum = _mm_add_epi32(sad_sum, upper);
+    *sad = sad_rest + _mm_cvtsi128_si32(sad_sum);
   }
-  result += _mm_cvtsi64_si32(sum);
-  _mm_empty();
-  return result;
 }
-#endif
-
-
-
-AVSValue AveragePlane::AvgPlane(AVSValue clip, void* user_data, int plane, IScriptEnvironment* env)
-{
-  if (!clip.IsClip())
-    env->ThrowError("Average Plane: No clip supplied!");
-  if (!(env->GetCPUFlags() & CPUF_INTEGER_SSE))
-    env->ThrowError("Average Plane: Requires Integer SSE capable CPU.");
-
-  PClip child = clip.AsClip();
-  VideoInfo vi = child->GetVideoInfo();
 
-  if (!vi.IsPlanar())
-    env->ThrowError("Average Plane: Only planar images (as YV12) supported!");
-
-  AVSValue cn = GetVar(env, "current_frame");
-  if (!cn.IsInt())
-    env->ThrowError("Average Plane: This filter can only be used within run-time filters");
-
-  int n = cn.AsInt();
-
-  PVideoFrame src = child->GetFrame(n,env);
-
-  const BYTE* srcp = src->GetReadPtr(plane);
-  int height = src->GetHeight(plane);
-  int width = src->GetRowSize(plane);
-  int pitch = src->GetPitch(plane);
-
-  if (width == 0 || height == 0)
-    env->ThrowError("Average Plane: No chroma planes in Y8!");
-
-  unsigned int sum = 0;
-  
+static void get_plane_stats(const BYTE* srcp, const BYTE* other_ptr, size_t height, size_t width, size_t pitch, size_t other_pitch, PlaneStats* stats, size_t* sad, IScriptEnvironment* env) {
   if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(srcp, 16) && width >= 16) {
-    sum = get_sum_of_pixels_sse2(srcp, height, width, pitch);
-  } else 
-#ifdef X86_32
-  if ((env->GetCPUFlags() & CPUF_INTEGER_SSE) && width >= 8) {
-    sum = get_sum_of_pixels_isse(srcp, height, width, pitch);
-  } else 
-#endif
-  {
-    sum = get_sum_of_pixels_c(srcp, height, width, pitch);
+    if (other_ptr == NULL) {
+      get_plane_stats_sse2<false>(srcp, NULL, height, width, pitch, 0, stats, NULL);
+      return;
+    }
+    if (IsPtrAligned(other_ptr, 16)) {
+      get_plane_stats_sse2<true>(srcp, other_ptr, height, width, pitch, other_pitch, stats, sad);
+      return;
+    }
   }
-
-  float f = (float)((double)sum / (height * width));
-
-  return (AVSValue)f;
+  get_plane_stats_c(srcp, other_ptr, height, width, pitch, other_pitch, stats, sad);
 }
 
 
+
 AVSValue __cdecl ComparePlane::Create_y(AVSValue args, void* user_data, IScriptEnvironment* env) {
   return CmpPlane(args[0],args[1],user_data, PLANAR_Y, env);
 }
@@ -429,6 +439,254 @@ static size_t get_sad_rgb_isse(const BYTE* src_ptr, const BYTE* other_ptr, size_
 
 #endif
 
+static size_t get_sad(const BYTE* srcp, const BYTE* srcp2, size_t height, size_t width, size_t pitch, size_t pitch2, bool rgb32, IScriptEnvironment* env) {
+  if (rgb32) {
+    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(srcp, 16) && IsPtrAligned(srcp2, 16) && width >= 16) {
+      return get_sad_rgb_sse2(srcp, srcp2, height, width, pitch, pitch2);
+    } else
+#ifdef X86_32
+      if ((env->GetCPUFlags() & CPUF_INTEGER_SSE) && width >= 8) {
+        return get_sad_rgb_isse(srcp, srcp2, height, width, pitch, pitch2);
+      } else 
+#endif
+      {
+        return get_sad_rgb_c(srcp, srcp2, height, width, pitch, pitch2);
+      }
+  } else {
+    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(srcp, 16) && IsPtrAligned(srcp2, 16) && width >= 16) {
+      return get_sad_sse2(srcp, srcp2, height, width, pitch, pitch2);
+    } else
+#ifdef X86_32
+      if ((env->GetCPUFlags() & CPUF_INTEGER_SSE) && width >= 8) {
+        return get_sad_isse(srcp, srcp2, height, width, pitch, pitch2);
+      } else 
+#endif
+      {
+        return get_sad_c(srcp, srcp2, height, width, pitch, pitch2);
+      }
+  }
+}
+
+
+/********************************
+ *  Memoized plane statistics
+ ********************************/
+
+// Runtime scripts usually ask several questions about the same frame
+// (AverageLuma, YPlaneMin, YPlaneMax, YDifferenceFromPrevious...).
+// PlaneStatsCache remembers the answers per plane, so each plane is
+// scanned once.
+//
+// Entries do not hold a reference to their frame, a cached frame would
+// otherwise stay non-writable and force copies downstream. A plane is
+// identified by its frame buffer and the buffer's sequence number, which
+// changes whenever the buffer is written; this is the same test the
+// frame cache and the constant mark use. The pointers in a key are only
+// compared, never dereferenced.
+
+struct PlaneKey {
+  const VideoFrameBuffer* vfb;
+  int sequence_number;
+  const BYTE* srcp;
+  int pitch, width, height;
+
+  PlaneKey() : vfb(NULL), sequence_number(0), srcp(NULL), pitch(0), width(0), height(0) {}
+
+  PlaneKey(const PVideoFrame& frame, int plane) :
+    vfb(frame->GetFrameBuffer()),
+    sequence_number(frame->GetFrameBuffer()->GetSequenceNumber()),
+    srcp(frame->GetReadPtr(plane)), pitch(frame->GetPitch(plane)),
+    width(frame->GetRowSize(plane)), height(frame->GetHeight(plane))
+  {}
+
+  bool operator==(const PlaneKey& other) const {
+    return vfb == other.vfb && sequence_number == other.sequence_number && srcp == other.srcp
+      && pitch == other.pitch && width == other.width && height == other.height;
+  }
+};
+
+// One cache per environment, created on first use and deleted by the
+// environment's AtExit. The mutex covers applications which call one
+// environment from several threads.
+class PlaneStatsCache {
+  enum { STATS_ENTRIES = 16, SAD_ENTRIES = 8 };
+
+  struct StatsEntry {
+    PlaneKey key;
+    PlaneStats stats;
+  };
+
+  struct SadEntry {
+    PlaneKey key, key2;
+    bool rgb32;
+    size_t sad;
+  };
+
+  IScriptEnvironment* const env;
+  std::mutex mutex;
+  StatsEntry stats[STATS_ENTRIES];
+  int next_stats;
+  SadEntry sads[SAD_ENTRIES];
+  int next_sad;
+
+  static std::mutex caches_mutex;
+  static std::map<IScriptEnvironment*, PlaneStatsCache*> caches;
+
+  PlaneStatsCache(IScriptEnvironment* _env) : env(_env), next_stats(0), next_sad(0) {}
+
+  StatsEntry* FindStats(const PlaneKey& key);
+  void AddStats(const PlaneKey& key, const PlaneStats& plane_stats);
+  void AddSad(const PlaneKey& key, const PlaneKey& key2, bool rgb32, size_t sad);
+  static void __cdecl DeleteCallback(void* user_data, IScriptEnvironment* env);
+
+public:
+  static PlaneStatsCache* Get(IScriptEnvironment* env);
+
+  void GetStats(const PVideoFrame& frame, int plane, PlaneStats* plane_stats);
+  size_t GetSad(const PVideoFrame& frame, const PVideoFrame& frame2, int plane, bool rgb32);
+};
+
+std::mutex PlaneStatsCache::caches_mutex;
+std::map<IScriptEnvironment*, PlaneStatsCache*> PlaneStatsCache::caches;
+
+PlaneStatsCache* PlaneStatsCache::Get(IScriptEnvironment* env) {
+  std::lock_guard<std::mutex> lock(caches_mutex);
+  std::map<IScriptEnvironment*, PlaneStatsCache*>::iterator it = caches.find(env);
+  if (it != caches.end())
+    return it->second;
+
+  PlaneStatsCache* cache = new PlaneStatsCache(env);
+  caches[env] = cache;
+  env->AtExit(DeleteCallback, cache);
+  return cache;
+}
+
+void __cdecl PlaneStatsCache::DeleteCallback(void* user_data, IScriptEnvironment* env) {
+  PlaneStatsCache* cache = static_cast<PlaneStatsCache*>(user_data);
+  {
+    std::lock_guard<std::mutex> lock(caches_mutex);
+    caches.erase(cache->env);
+  }
+  delete cache;
+}
+
+PlaneStatsCache::StatsEntry* PlaneStatsCache::FindStats(const PlaneKey& key) {
+  for (int i = 0; i < STATS_ENTRIES; ++i) {
+    if (stats[i].key.vfb != NULL && stats[i].key == key)
+      return &stats[i];
+  }
+  return NULL;
+}
+
+void PlaneStatsCache::AddStats(const PlaneKey& key, const PlaneStats& plane_stats) {
+  if (FindStats(key) != NULL)
+    return;
+
+  StatsEntry& entry = stats[next_stats];
+  next_stats = (next_stats + 1) % STATS_ENTRIES;
+  entry.key = key;
+  entry.stats = plane_stats;
+}
+
+void PlaneStatsCache::AddSad(const PlaneKey& key, const PlaneKey& key2, bool rgb32, size_t sad) {
+  SadEntry& entry = sads[next_sad];
+  next_sad = (next_sad + 1) % SAD_ENTRIES;
+  entry.key = key;
+  entry.key2 = key2;
+  entry.rgb32 = rgb32;
+  entry.sad = sad;
+}
+
+void PlaneStatsCache::GetStats(const PVideoFrame& frame, int plane, PlaneStats* plane_stats) {
+  const PlaneKey key(frame, plane);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    StatsEntry* entry = FindStats(key);
+    if (entry != NULL) {
+      *plane_stats = entry->stats;
+      return;
+    }
+  }
+
+  // Scan outside the lock, other threads may be busy with other frames
+  get_plane_stats(key.srcp, NULL, key.height, key.width, key.pitch, 0, plane_stats, NULL, env);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  AddStats(key, *plane_stats);
+}
+
+size_t PlaneStatsCache::GetSad(const PVideoFrame& frame, const PVideoFrame& frame2, int plane, bool rgb32) {
+  const PlaneKey key(frame, plane);
+  const PlaneKey key2(frame2, plane);
+  bool has_stats;
+  {
+    // The difference is symmetric: YDifferenceToNext of frame n
+    // is YDifferenceFromPrevious of frame n+1.
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < SAD_ENTRIES; ++i) {
+      const SadEntry& entry = sads[i];
+      if (entry.key.vfb != NULL && entry.rgb32 == rgb32 &&
+          ((entry.key == key && entry.key2 == key2) || (entry.key == key2 && entry.key2 == key)))
+        return entry.sad;
+    }
+    has_stats = FindStats(key) != NULL;
+  }
+
+  size_t sad;
+  if (rgb32 || has_stats) {
+    // Interleaved RGB has no plane statistics to gather on the way
+    sad = get_sad(key.srcp, key2.srcp, key.height, key.width, key.pitch, key2.pitch, rgb32, env);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    AddSad(key, key2, rgb32, sad);
+  } else {
+    // First look at this plane: the same pass gives its statistics
+    PlaneStats plane_stats;
+    get_plane_stats(key.srcp, key2.srcp, key.height, key.width, key.pitch, key2.pitch, &plane_stats, &sad, env);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    AddStats(key, plane_stats);
+    AddSad(key, key2, rgb32, sad);
+  }
+  return sad;
+}
+
+
+
+AVSValue AveragePlane::AvgPlane(AVSValue clip, void* user_data, int plane, IScriptEnvironment* env)
+{
+  if (!clip.IsClip())
+    env->ThrowError("Average Plane: No clip supplied!");
+  if (!(env->GetCPUFlags() & CPUF_INTEGER_SSE))
+    env->ThrowError("Average Plane: Requires Integer SSE capable CPU.");
+
+  PClip child = clip.AsClip();
+  VideoInfo vi = child->GetVideoInfo();
+
+  if (!vi.IsPlanar())
+    env->ThrowError("Average Plane: Only planar images (as YV12) supported!");
+
+  AVSValue cn = GetVar(env, "current_frame");
+  if (!cn.IsInt())
+    env->ThrowError("Average Plane: This filter can only be used within run-time filters");
+
+  int n = cn.AsInt();
+
+  PVideoFrame src = child->GetFrame(n,env);
+
+  int height = src->GetHeight(plane);
+  int width = src->GetRowSize(plane);
+
+  if (width == 0 || height == 0)
+    env->ThrowError("Average Plane: No chroma planes in Y8!");
+
+  PlaneStats stats;
+  PlaneStatsCache::Get(env)->GetStats(src, plane, &stats);
+
+  float f = (float)((double)stats.sum / (height * width));
+
+  return (AVSValue)f;
+}
 
 
 AVSValue ComparePlane::CmpPlane(AVSValue clip, AVSValue clip2, void* user_data, int plane, IScriptEnvironment* env)
@@ -466,14 +724,10 @@ AVSValue ComparePlane::CmpPlane(AVSValue clip, AVSValue clip2, void* user_data,
   PVideoFrame src = child->GetFrame(n,env);
   PVideoFrame src2 = child2->GetFrame(n,env);
 
-  const BYTE* srcp = src->GetReadPtr(plane);
-  const BYTE* srcp2 = src2->GetReadPtr(plane);
   const int height = src->GetHeight(plane);
   const int width = src->GetRowSize(plane);
-  const int pitch = src->GetPitch(plane);
   const int height2 = src2->GetHeight(plane);
   const int width2 = src2->GetRowSize(plane);
-  const int pitch2 = src2->GetPitch(plane);
 
   if (width == 0 || height == 0)
     env->ThrowError("Plane Difference: No chroma planes in Y8!");
@@ -481,32 +735,7 @@ AVSValue ComparePlane::CmpPlane(AVSValue clip, AVSValue clip2, void* user_data,
   if (height != height2 || width != width2)
     env->ThrowError("Plane Difference: Images are not the same size!");
 
-  size_t sad = 0;
-  if (vi.IsRGB32()) {
-    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(srcp, 16) && IsPtrAligned(srcp2, 16) && width >= 16) {
-      sad = get_sad_rgb_sse2(srcp, srcp2, height, width, pitch, pitch2);
-    } else
-#ifdef X86_32
-      if ((env->GetCPUFlags() & CPUF_INTEGER_SSE) && width >= 8) {
-        sad = get_sad_rgb_isse(srcp, srcp2, height, width, pitch, pitch2);
-      } else 
-#endif
-      {
-        sad = get_sad_rgb_c(srcp, srcp2, height, width, pitch, pitch2);
-      }
-  } else {
-    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(srcp, 16) && IsPtrAligned(srcp2, 16) && width >= 16) {
-      sad = get_sad_sse2(srcp, srcp2, height, width, pitch, pitch2);
-    } else
-#ifdef X86_32
-      if ((env->GetCPUFlags() & CPUF_INTEGER_SSE) && width >= 8) {
-        sad = get_sad_isse(srcp, srcp2, height, width, pitch, pitch2);
-      } else 
-#endif
-      {
-        sad = get_sad_c(srcp, srcp2, height, width, pitch, pitch2);
-      }
-  }
+  size_t sad = PlaneStatsCache::Get(env)->GetSad(src, src2, plane, vi.IsRGB32());
 
   float f;
 
@@ -548,42 +777,13 @@ AVSValue ComparePlane::CmpPlaneSame(AVSValue clip, void* user_data, int offset,
   PVideoFrame src = child->GetFrame(n,env);
   PVideoFrame src2 = child->GetFrame(n2,env);
 
-  const BYTE* srcp = src->GetReadPtr(plane);
-  const BYTE* srcp2 = src2->GetReadPtr(plane);
   int height = src->GetHeight(plane);
   int width = src->GetRowSize(plane);
-  int pitch = src->GetPitch(plane);
-  int pitch2 = src2->GetPitch(plane);
 
   if (width == 0 || height == 0)
     env->ThrowError("Plane Difference: No chroma planes in Y8!");
 
-  size_t sad = 0;
-  if (vi.IsRGB32()) {
-    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(srcp, 16) && IsPtrAligned(srcp2, 16) && width >= 16) {
-      sad = get_sad_rgb_sse2(srcp, srcp2, height, width, pitch, pitch2);
-    } else
-#ifdef X86_32
-      if ((env->GetCPUFlags() & CPUF_INTEGER_SSE) && width >= 8) {
-        sad = get_sad_rgb_isse(srcp, srcp2, height, width, pitch, pitch2);
-      } else 
-#endif
-      {
-        sad = get_sad_rgb_c(srcp, srcp2, height, width, pitch, pitch2);
-      }
-  } else {
-    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(srcp, 16) && IsPtrAligned(srcp2, 16) && width >= 16) {
-      sad = get_sad_sse2(srcp, srcp2, height, width, pitch, pitch2);
-    } else
-#ifdef X86_32
-      if ((env->GetCPUFlags() & CPUF_INTEGER_SSE) && width >= 8) {
-        sad = get_sad_isse(srcp, srcp2, height, width, pitch, pitch2);
-      } else 
-#endif
-      {
-        sad = get_sad_c(srcp, srcp2, height, width, pitch, pitch2);
-      }
-  }
+  size_t sad = PlaneStatsCache::Get(env)->GetSad(src, src2, plane, vi.IsRGB32());
 
   float f;
 
@@ -651,7 +851,6 @@ AVSValue __cdecl MinMaxPlane::Create_minmax_v(AVSValue args, void* user_data, IS
 
 
 AVSValue MinMaxPlane::MinMax(AVSValue clip, void* user_data, float threshold, int plane, int mode, IScriptEnvironment* env) {
-  unsigned int accum[256];
 
   if (!clip.IsClip())
     env->ThrowError("MinMax: No clip supplied!");
@@ -672,26 +871,16 @@ AVSValue MinMaxPlane::MinMax(AVSValue clip, void* user_data, float threshold, in
   // Prepare the source
   PVideoFrame src = child->GetFrame(n, env);
 
-  const BYTE* srcp = src->GetReadPtr(plane);
-  int pitch = src->GetPitch(plane);
   int w = src->GetRowSize(plane);
   int h = src->GetHeight(plane);
 
   if (w == 0 || h == 0)
     env->ThrowError("MinMax: No chroma planes in Y8!");
 
-  // Reset accumulators
-  for (int i=0;i<256;i++) {
-    accum[i]=0;
-  }
-
   // Count each component.
-  for (int y=0;y<h;y++) {
-    for (int x=0;x<w;x++) {
-       accum[srcp[x]]++;
-    }
-    srcp+=pitch;
-  }
+  PlaneStats stats;
+  PlaneStatsCache::Get(env)->GetStats(src, plane, &stats);
+  const unsigned int* accum = stats.histogram;
 
   int pixels = w*h;
   threshold /=100.0f;  // Thresh now 0-1
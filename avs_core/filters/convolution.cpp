@@ -34,7 +34,9 @@
 
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <vector>
+#include <emmintrin.h>
 
 // Avisynth filter: general convolution
 // by Richard Berg (avisynth-dev@richardberg.net)
@@ -42,6 +44,7 @@
 
 #include "Convolution.h"
 #include "../core/internal.h"
+#include <avs/minmax.h>
 
 
 /********************************************************************
@@ -79,8 +82,8 @@ GeneralConvolution::GeneralConvolution(PClip _child, double _divisor, int _nBias
                                        bool _autoscale, IScriptEnvironment* _env)
   : GenericVideoFilter(_child), divisor(_divisor), nBias(_nBias), autoscale(_autoscale)
 {
-  if (!child->GetVideoInfo().IsRGB32())
-    _env->ThrowError("GeneralConvolution requires RGBA input");
+  if (!vi.IsRGB32() && !(vi.IsPlanar() && vi.IsYUV()))
+    _env->ThrowError("GeneralConvolution requires RGBA or planar YUV input");
   if (divisor == 0.0)
     _env->ThrowError("GeneralConvolution: divisor cannot be zero");
   setMatrix(_matrix, _env);
@@ -94,6 +97,45 @@ AVSValue __cdecl GeneralConvolution::Create(AVSValue args, void* user_data, IScr
 }
 
 
+// Splits a rank-1 integer kernel into a vertical and a horizontal vector whose outer
+// product reproduces it exactly.  Integer sums are the same in any order, so running the
+// two 1D passes gives bit-identical output to the full 2D kernel.
+static bool factorize_kernel(const int* kernel, int diameter, int* vertical, int* horizontal)
+{
+  int r0 = 0;
+  while (r0 < diameter*diameter && kernel[r0] == 0)
+    ++r0;
+  if (r0 == diameter*diameter)
+    return false;
+  r0 /= diameter;
+
+  int g = 0;
+  for (int j = 0; j < diameter; ++j) {
+    int a = abs(kernel[r0*diameter + j]), b = g;
+    while (b) { int t = a % b; a = b; b = t; }
+    g = a;
+  }
+
+  int j0 = -1;
+  for (int j = 0; j < diameter; ++j) {
+    horizontal[j] = kernel[r0*diameter + j] / g;
+    if (j0 < 0 && horizontal[j] != 0)
+      j0 = j;
+  }
+
+  for (int i = 0; i < diameter; ++i) {
+    if (kernel[i*diameter + j0] % horizontal[j0] != 0)
+      return false;
+    vertical[i] = kernel[i*diameter + j0] / horizontal[j0];
+    for (int j = 0; j < diameter; ++j) {
+      if ((__int64)vertical[i] * horizontal[j] != kernel[i*diameter + j])
+        return false;
+    }
+  }
+  return true;
+}
+
+
 void GeneralConvolution::setMatrix(const char * _matrix, IScriptEnvironment* env)
 {
   char * copymatrix = _strdup (_matrix); // strtok mangles the input string
@@ -114,30 +156,41 @@ void GeneralConvolution::setMatrix(const char * _matrix, IScriptEnvironment* env
   else if (nSize > 25)
     env->ThrowError("GeneralConvolution sez: matrix too big");
 
+  // Smaller (3x3) kernels only look at the 3x3 ring of pixels
+  nRadius = nSize == 25 ? 2 : 1;
+  const int diameter = nRadius*2 + 1;
 
-  // Uglify matrix storage in return for fast lookups
-  if (25 == nSize)
-  {
-    i00 = matrix[ 0]; i10 = matrix[ 1]; i20 = matrix[ 2]; i30 = matrix[ 3]; i40 = matrix[ 4];
-    i01 = matrix[ 5]; i11 = matrix[ 6]; i21 = matrix[ 7]; i31 = matrix[ 8]; i41 = matrix[ 9];
-    i02 = matrix[10]; i12 = matrix[11]; i22 = matrix[12]; i32 = matrix[13]; i42 = matrix[14];
-    i03 = matrix[15]; i13 = matrix[16]; i23 = matrix[17]; i33 = matrix[18]; i43 = matrix[19];
-    i04 = matrix[20]; i14 = matrix[21]; i24 = matrix[22]; i34 = matrix[23]; i44 = matrix[24];
+  int iCountT = 0;
+  bool fits_word = true;
+  for (int i = 0; i < diameter*diameter; ++i) {
+    kernel[i] = matrix[i];
+    iCountT += kernel[i];
+    fits_word &= kernel[i] >= -32768 && kernel[i] <= 32767;
   }
-  else if (9 == nSize)
-  {
-    i11 = matrix[0]; i21 = matrix[1]; i31 = matrix[2];
-    i12 = matrix[3]; i22 = matrix[4]; i32 = matrix[5];
-    i13 = matrix[6]; i23 = matrix[7]; i33 = matrix[8];
-
-    i00 = i10 = i20 = i30 = i40 = 0;
-    i01 =                   i41 = 0;
-    i02 =                   i42 = 0;
-    i03 =                   i43 = 0;
-    i04 = i14 = i24 = i34 = i44 = 0;
+  if (!autoscale)
+    iCountT = 0;
+
+  // Truncate instead of round - keep in the spirit of the original code
+  iCountDiv = (int)(0x100000 / (iCountT == 0 ? divisor : iCountT * divisor));
+
+  separable = factorize_kernel(kernel, diameter, kernel_v, kernel_h);
+
+  // The SSE2 code multiplies bytes by 16 bit coefficients.  The separable variant also keeps
+  // the vertical pass in 16 bits, which holds as long as its taps cannot sum past 32767.
+  sse2_2d = fits_word;
+  sse2_separable = false;
+  if (separable) {
+    int v_range = 0;
+    sse2_separable = true;
+    for (int i = 0; i < diameter; ++i) {
+      v_range += abs(kernel_v[i]) * 255;
+      sse2_separable &= kernel_h[i] >= -32768 && kernel_h[i] <= 32767;
+    }
+    sse2_separable &= v_range <= 32767;
   }
 }
 
+
 template<int mi, int ma>
 __forceinline int static_clip(int value) {
   if (value < mi) {
@@ -149,153 +202,287 @@ __forceinline int static_clip(int value) {
   return value;
 }
 
-PVideoFrame __stdcall GeneralConvolution::GetFrame(int n, IScriptEnvironment* env)
-{
-  auto env2 = static_cast<IScriptEnvironment2*>(env);
-  auto pbyA = static_cast<uint8_t*>(env2->Allocate(vi.width*vi.height, 8, AVS_POOLED_ALLOC));
-  auto pbyR = static_cast<uint8_t*>(env2->Allocate(vi.width*vi.height, 8, AVS_POOLED_ALLOC));
-  auto pbyG = static_cast<uint8_t*>(env2->Allocate(vi.width*vi.height, 8, AVS_POOLED_ALLOC));
-  auto pbyB = static_cast<uint8_t*>(env2->Allocate(vi.width*vi.height, 8, AVS_POOLED_ALLOC));
 
-  if (pbyA == nullptr || pbyR == nullptr || pbyG == nullptr || pbyB == nullptr) {
-    env->ThrowError("GeneralConvolution: out of memory");
+// Column of the tap d pixels away from x.  Matches the original edge handling: the left
+// side clamps to column 0, the outer right tap stops at w-2.
+static __forceinline int gc_column(int x, int d, int w) {
+  switch (d) {
+  case -2: return x > 2 ? x - 2 : 0;
+  case -1: return x > 1 ? x - 1 : 0;
+  case  1: return x < w - 2 ? x + 1 : w - 1;
+  case  2: return x < w - 3 ? x + 2 : w - 2;
+  default: return x;
   }
+}
 
-  int h = vi.height;
-  int w = vi.width;
 
-  PVideoFrame src = child->GetFrame(n, env);
-  PVideoFrame dst = env->NewVideoFrame(vi);
-  char *dstStart = (char *) dst->GetWritePtr();
+static __forceinline BYTE gc_scale(int sum, int iCountDiv, int nBias) {
+  return (BYTE)static_clip<0, 255>(((sum * iCountDiv) >> 20) + nBias);
+}
 
-  const int pitch = dst->GetPitch();
-  const int modulo = src->GetPitch() - src->GetRowSize();
 
-  Pixel32* srcp = (Pixel32*)src->GetReadPtr();
-  uint8_t *pbyA0 = pbyA;
-  uint8_t *pbyR0 = pbyR;
-  uint8_t *pbyG0 = pbyG;
-  uint8_t *pbyB0 = pbyB;
+// rows[k] is the source row under kernel row k, rows[radius] is the centre row.  step is the
+// distance between pixels in bytes; with a step of 4 the fourth byte is alpha and is copied.
+static void convolution_2d_c(BYTE* dstp, const BYTE* const* rows, int x_from, int x_to, int width, int step,
+                             int radius, const int* kernel, int iCountDiv, int nBias) {
+  const int diameter = radius*2 + 1;
+  const int channels = step == 4 ? 3 : 1;
+  for (int x = x_from; x < x_to; ++x) {
+    for (int c = 0; c < channels; ++c) {
+      int sum = 0;
+      for (int k = 0; k < diameter; ++k)
+        for (int d = -radius; d <= radius; ++d)
+          sum += kernel[k*diameter + d + radius] * rows[k][gc_column(x, d, width)*step + c];
+      dstp[x*step + c] = gc_scale(sum, iCountDiv, nBias);
+    }
+    if (step == 4)
+      dstp[x*4 + 3] = rows[radius][x*4 + 3];
+  }
+}
+
 
-  for(int y = 0; y < h; y++)
-  {
-    for(int x = 0; x < w; x++)
-    {
-      *pbyA0++ = (uint8_t)((*srcp &  0xff000000) >> 24);
-      *pbyR0++ = (uint8_t)((*srcp &  0x00ff0000) >> 16);
-      *pbyG0++ = (uint8_t)((*srcp &  0x0000ff00) >> 8);
-      *pbyB0++ = (uint8_t)(*srcp++ & 0x000000ff);
+static void convolution_vertical_c(int* line, const BYTE* const* rows, int row_size, int diameter, const int* kernel_v) {
+  for (int e = 0; e < row_size; ++e) {
+    int sum = 0;
+    for (int k = 0; k < diameter; ++k)
+      sum += kernel_v[k] * rows[k][e];
+    line[e] = sum;
+  }
+}
+
+
+template<typename T>
+static void convolution_horizontal_c(BYTE* dstp, const T* line, const BYTE* center, int x_from, int x_to, int width, int step,
+                                     int radius, const int* kernel_h, int iCountDiv, int nBias) {
+  const int channels = step == 4 ? 3 : 1;
+  for (int x = x_from; x < x_to; ++x) {
+    for (int c = 0; c < channels; ++c) {
+      int sum = 0;
+      for (int d = -radius; d <= radius; ++d)
+        sum += kernel_h[d + radius] * line[gc_column(x, d, width)*step + c];
+      dstp[x*step + c] = gc_scale(sum, iCountDiv, nBias);
     }
-    srcp = (Pixel32 *)((char *)srcp + modulo);
+    if (step == 4)
+      dstp[x*4 + 3] = center[x*4 + 3];
   }
+}
 
-  int iA, iR, iG, iB, x0, x1, x2, x3, x4;
 
-  int iCountT;
-  if (autoscale) {
-    iCountT = i00 + i01 + i02 + i03 + i04 +
-              i10 + i11 + i12 + i13 + i14 +
-              i20 + i21 + i22 + i23 + i24 +
-              i30 + i31 + i32 + i33 + i34 +
-              i40 + i41 + i42 + i43 + i44;
-  } else {
-    iCountT = 0;
+static __forceinline __m128i gc_mullo_epi32_sse2(__m128i a, __m128i b) {
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+
+static __forceinline __m128i gc_scale_sse2(__m128i sum, __m128i &div, __m128i &bias) {
+  return _mm_add_epi32(_mm_srai_epi32(gc_mullo_epi32_sse2(sum, div), 20), bias);
+}
+
+
+// Scales four groups of four sums and packs them with the 0..255 clip.  For RGB32 the alpha
+// bytes are taken from the centre pixels.
+static __forceinline __m128i gc_pack_sse2(__m128i *acc, __m128i &div, __m128i &bias, __m128i &center, __m128i &alpha_mask) {
+  __m128i lo = _mm_packs_epi32(gc_scale_sse2(acc[0], div, bias), gc_scale_sse2(acc[1], div, bias));
+  __m128i hi = _mm_packs_epi32(gc_scale_sse2(acc[2], div, bias), gc_scale_sse2(acc[3], div, bias));
+  __m128i result = _mm_packus_epi16(lo, hi);
+  return _mm_or_si128(_mm_andnot_si128(alpha_mask, result), _mm_and_si128(alpha_mask, center));
+}
+
+
+// Works on the interleaved bytes directly: 16 bytes per pass, taps paired up for pmaddwd.
+// Returns the first byte it did not process.
+static int convolution_2d_sse2(BYTE* dstp, const BYTE* const* rows, int e_from, int e_to, int step,
+                               int radius, const int* kernel, int iCountDiv, int nBias) {
+  const int diameter = radius*2 + 1;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i div = _mm_set1_epi32(iCountDiv);
+  __m128i bias = _mm_set1_epi32(nBias);
+  __m128i alpha_mask = step == 4 ? _mm_set1_epi32(0xFF000000) : zero;
+
+  // Only the non-zero taps, padded to an even count with a zero weight on the centre
+  const BYTE* tap_row[26];
+  int tap_offset[26];
+  __m128i tap_pair[13];
+  int taps = 0;
+  short weight[26];
+  for (int k = 0; k < diameter; ++k) {
+    for (int d = -radius; d <= radius; ++d) {
+      if (kernel[k*diameter + d + radius] == 0)
+        continue;
+      tap_row[taps] = rows[k];
+      tap_offset[taps] = d*step;
+      weight[taps++] = (short)kernel[k*diameter + d + radius];
+    }
   }
-    
-  // Truncate instead of round - keep in the spirit of the original code
-  int iCountDiv = (int)(0x100000 / (iCountT == 0 ? divisor : iCountT * divisor));
+  if (taps & 1) {
+    tap_row[taps] = rows[radius];
+    tap_offset[taps] = 0;
+    weight[taps++] = 0;
+  }
+  for (int t = 0; t < taps; t += 2)
+    tap_pair[t>>1] = _mm_set1_epi32((int)(unsigned short)weight[t] | ((int)weight[t+1] << 16));
+
+  int e = e_from;
+  for (; e + 16 <= e_to; e += 16) {
+    __m128i acc[4] = { zero, zero, zero, zero };
+    for (int t = 0; t < taps; t += 2) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tap_row[t] + e + tap_offset[t]));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tap_row[t+1] + e + tap_offset[t+1]));
+      __m128i a_lo = _mm_unpacklo_epi8(a, zero), a_hi = _mm_unpackhi_epi8(a, zero);
+      __m128i b_lo = _mm_unpacklo_epi8(b, zero), b_hi = _mm_unpackhi_epi8(b, zero);
+      acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi16(a_lo, b_lo), tap_pair[t>>1]));
+      acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi16(a_lo, b_lo), tap_pair[t>>1]));
+      acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi16(a_hi, b_hi), tap_pair[t>>1]));
+      acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi16(a_hi, b_hi), tap_pair[t>>1]));
+    }
+    __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[radius] + e));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp + e), gc_pack_sse2(acc, div, bias, center, alpha_mask));
+  }
+  return e;
+}
 
-  for(int y = 0; y < h; y++)
-  {
-    uint8_t *pbyR1, *pbyG1, *pbyB1, *pbyR2, *pbyG2, *pbyB2,
-      *pbyR3, *pbyG3, *pbyB3, *pbyR4, *pbyG4, *pbyB4;
-
-    pbyA0                                 = pbyA + y * w;
-    pbyR0 = pbyR1 = pbyR2 = pbyR3 = pbyR4 = pbyR + y * w;
-    pbyG0 = pbyG1 = pbyG2 = pbyG3 = pbyG4 = pbyG + y * w;
-    pbyB0 = pbyB1 = pbyB2 = pbyB3 = pbyB4 = pbyB + y * w;
-
-    if(y > 0)
-    {
-      pbyR4 -= w;  pbyG4 -= w;  pbyB4 -= w;
-      pbyR3 -= w;  pbyG3 -= w;  pbyB3 -= w;
-
-      if(y > 1)
-      {
-        pbyR4 -= w;  pbyG4 -= w;  pbyB4 -= w;
-      }
+
+static void convolution_vertical_sse2(short* line, const BYTE* const* rows, int row_size, int diameter, const int* kernel_v) {
+  const __m128i zero = _mm_setzero_si128();
+  int e = 0;
+  for (; e + 16 <= row_size; e += 16) {
+    __m128i lo = zero, hi = zero;
+    for (int k = 0; k < diameter; ++k) {
+      __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + e));
+      __m128i w = _mm_set1_epi16((short)kernel_v[k]);
+      lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), w));
+      hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), w));
     }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(line + e), lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(line + e + 8), hi);
+  }
+  for (; e < row_size; ++e) {
+    int sum = 0;
+    for (int k = 0; k < diameter; ++k)
+      sum += kernel_v[k] * rows[k][e];
+    line[e] = (short)sum;
+  }
+}
 
-    if(y < h - 1)
-    {
-      pbyR1 += w;  pbyG1 += w;  pbyB1 += w;
-      pbyR0 += w;  pbyG0 += w;  pbyB0 += w;
 
-      if(y < h - 2)
-      {
-        pbyR0 += w;  pbyG0 += w;  pbyB0 += w;
-      }
+static int convolution_horizontal_sse2(BYTE* dstp, const short* line, const BYTE* center, int e_from, int e_to, int step,
+                                       int radius, const int* kernel_h, int iCountDiv, int nBias) {
+  const int diameter = radius*2 + 1;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i div = _mm_set1_epi32(iCountDiv);
+  __m128i bias = _mm_set1_epi32(nBias);
+  __m128i alpha_mask = step == 4 ? _mm_set1_epi32(0xFF000000) : zero;
+
+  // Taps paired for pmaddwd, the last one with a zero partner on the centre
+  int tap_offset[6];
+  short weight[6];
+  __m128i tap_pair[3];
+  for (int d = 0; d < diameter; ++d) {
+    tap_offset[d] = (d - radius)*step;
+    weight[d] = (short)kernel_h[d];
+  }
+  tap_offset[diameter] = 0;
+  weight[diameter] = 0;
+  for (int t = 0; t < diameter; t += 2)
+    tap_pair[t>>1] = _mm_set1_epi32((int)(unsigned short)weight[t] | ((int)weight[t+1] << 16));
+
+  int e = e_from;
+  for (; e + 16 <= e_to; e += 16) {
+    __m128i acc[4] = { zero, zero, zero, zero };
+    for (int t = 0; t < diameter; t += 2) {
+      const short* a = line + e + tap_offset[t];
+      const short* b = line + e + tap_offset[t+1];
+      __m128i a_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+      __m128i a_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 8));
+      __m128i b_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+      __m128i b_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 8));
+      acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi16(a_lo, b_lo), tap_pair[t>>1]));
+      acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi16(a_lo, b_lo), tap_pair[t>>1]));
+      acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi16(a_hi, b_hi), tap_pair[t>>1]));
+      acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi16(a_hi, b_hi), tap_pair[t>>1]));
     }
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + e));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp + e), gc_pack_sse2(acc, div, bias, c, alpha_mask));
+  }
+  return e;
+}
+
+
+// row_dir is -1 for bottom-up RGB so that the first matrix row stays on top of the image.
+void GeneralConvolution::convolvePlane(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int row_size, int height,
+                                       int step, int row_dir, IScriptEnvironment* env)
+{
+  const int width = row_size / step;
+  const int diameter = nRadius*2 + 1;
+  // Columns whose taps all fall inside the row; the rest go through the edge rules of gc_column
+  const int x_lo = nRadius;
+  const int x_hi = nRadius == 2 ? width - 3 : width - 1;
+  const bool sse2 = (env->GetCPUFlags() & CPUF_SSE2) && (x_hi - x_lo)*step >= 16;
+  const bool use_separable = separable && (!sse2 || sse2_separable || !sse2_2d);
+  const bool sse2_h = use_separable && sse2 && sse2_separable;
+
+  auto env2 = static_cast<IScriptEnvironment2*>(env);
+  void* line = nullptr;
+  if (use_separable) {
+    line = env2->Allocate(row_size * (sse2_h ? sizeof(short) : sizeof(int)), 16, AVS_POOLED_ALLOC);
+    if (line == nullptr)
+      env->ThrowError("GeneralConvolution: out of memory");
+  }
+
+  const BYTE* rows[5];
+  for (int y = 0; y < height; y++)
+  {
+    for (int k = 0; k < diameter; ++k)
+      rows[k] = srcp + src_pitch * clamp(y + row_dir*(k - nRadius), 0, height-1);
 
-    Pixel32* dstp = (Pixel32 *)(dstStart + y * pitch);
-    for(x2 = 0; x2 < w; x2++)
-    {
-      x0 = x2 > 2 ? x2 - 2 : 0;
-      x1 = x2 > 1 ? x2 - 1 : 0;
-      x3 = x2 < w - 2 ? x2 + 1 : w - 1;
-      x4 = x2 < w - 3 ? x2 + 2 : w - 2;
-
-      iA = pbyA0[x2];
-      // Always do 3x3 ring of pixel
-      iR = i11 * pbyR1[x1] + i21 * pbyR1[x2] + i31 * pbyR1[x3] +
-           i12 * pbyR2[x1] + i22 * pbyR2[x2] + i32 * pbyR2[x3] +
-           i13 * pbyR3[x1] + i23 * pbyR3[x2] + i33 * pbyR3[x3];
-
-      iG = i11 * pbyG1[x1] + i21 * pbyG1[x2] + i31 * pbyG1[x3] +
-           i12 * pbyG2[x1] + i22 * pbyG2[x2] + i32 * pbyG2[x3] +
-           i13 * pbyG3[x1] + i23 * pbyG3[x2] + i33 * pbyG3[x3];
-
-      iB = i11 * pbyB1[x1] + i21 * pbyB1[x2] + i31 * pbyB1[x3] +
-           i12 * pbyB2[x1] + i22 * pbyB2[x2] + i32 * pbyB2[x3] +
-           i13 * pbyB3[x1] + i23 * pbyB3[x2] + i33 * pbyB3[x3];
-      // Only do 5x5 ring of pixel if needed
-      if(nSize == 25)
-      {
-        iR += i00 * pbyR0[x0] + i10 * pbyR0[x1] + i20 * pbyR0[x2] + i30 * pbyR0[x3] + i40 * pbyR0[x4] +
-              i01 * pbyR1[x0] +                                                       i41 * pbyR1[x4] +
-              i02 * pbyR2[x0] +                                                       i42 * pbyR2[x4] +
-              i03 * pbyR3[x0] +                                                       i43 * pbyR3[x4] +
-              i04 * pbyR4[x0] + i14 * pbyR4[x1] + i24 * pbyR4[x2] + i34 * pbyR4[x3] + i44 * pbyR4[x4];
-
-        iG += i00 * pbyG0[x0] + i10 * pbyG0[x1] + i20 * pbyG0[x2] + i30 * pbyG0[x3] + i40 * pbyG0[x4] +
-              i01 * pbyG1[x0] +                                                       i41 * pbyG1[x4] +
-              i02 * pbyG2[x0] +                                                       i42 * pbyG2[x4] +
-              i03 * pbyG3[x0] +                                                       i43 * pbyG3[x4] +
-              i04 * pbyG4[x0] + i14 * pbyG4[x1] + i24 * pbyG4[x2] + i34 * pbyG4[x3] + i44 * pbyG4[x4];
-
-        iB += i00 * pbyB0[x0] + i10 * pbyB0[x1] + i20 * pbyB0[x2] + i30 * pbyB0[x3] + i40 * pbyB0[x4] +
-              i01 * pbyB1[x0] +                                                       i41 * pbyB1[x4] +
-              i02 * pbyB2[x0] +                                                       i42 * pbyB2[x4] +
-              i03 * pbyB3[x0] +                                                       i43 * pbyB3[x4] +
-              i04 * pbyB4[x0] + i14 * pbyB4[x1] + i24 * pbyB4[x2] + i34 * pbyB4[x3] + i44 * pbyB4[x4];
-      }
-
-      iR = ((iR * iCountDiv) >> 20) + nBias;
-      iG = ((iG * iCountDiv) >> 20) + nBias;
-      iB = ((iB * iCountDiv) >> 20) + nBias;
-
-      iR = static_clip<0, 255>(iR);
-      iG = static_clip<0, 255>(iG);
-      iB = static_clip<0, 255>(iB);
-
-      *dstp++ = (iA << 24) + (iR << 16) + (iG << 8) + iB;
+    if (x_hi <= x_lo) {
+      convolution_2d_c(dstp, rows, 0, width, width, step, nRadius, kernel, iCountDiv, nBias);
+    }
+    else if (sse2_h) {
+      short* line16 = static_cast<short*>(line);
+      convolution_vertical_sse2(line16, rows, row_size, diameter, kernel_v);
+      int e = convolution_horizontal_sse2(dstp, line16, rows[nRadius], x_lo*step, x_hi*step, step, nRadius, kernel_h, iCountDiv, nBias);
+      convolution_horizontal_c(dstp, line16, rows[nRadius], 0, x_lo, width, step, nRadius, kernel_h, iCountDiv, nBias);
+      convolution_horizontal_c(dstp, line16, rows[nRadius], e / step, width, width, step, nRadius, kernel_h, iCountDiv, nBias);
+    }
+    else if (use_separable) {
+      int* line32 = static_cast<int*>(line);
+      convolution_vertical_c(line32, rows, row_size, diameter, kernel_v);
+      convolution_horizontal_c(dstp, line32, rows[nRadius], 0, width, width, step, nRadius, kernel_h, iCountDiv, nBias);
     }
+    else {
+      int x = x_lo;
+      if (sse2 && sse2_2d)
+        x = convolution_2d_sse2(dstp, rows, x_lo*step, x_hi*step, step, nRadius, kernel, iCountDiv, nBias) / step;
+      convolution_2d_c(dstp, rows, 0, x_lo, width, step, nRadius, kernel, iCountDiv, nBias);
+      convolution_2d_c(dstp, rows, x, width, width, step, nRadius, kernel, iCountDiv, nBias);
+    }
+    dstp += dst_pitch;
   }
 
-  env2->Free(pbyA);
-  env2->Free(pbyR);
-  env2->Free(pbyG);
-  env2->Free(pbyB);
+  if (line)
+    env2->Free(line);
+}
+
+
+PVideoFrame __stdcall GeneralConvolution::GetFrame(int n, IScriptEnvironment* env)
+{
+  PVideoFrame src = child->GetFrame(n, env);
+  PVideoFrame dst = env->NewVideoFrame(vi);
+
+  if (vi.IsPlanar()) {
+    const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+    const int plane_count = vi.IsY8() ? 1 : 3;
+    for (int p = 0; p < plane_count; ++p) {
+      const int plane = planes[p];
+      convolvePlane(dst->GetWritePtr(plane), src->GetReadPtr(plane), dst->GetPitch(plane), src->GetPitch(plane),
+                    src->GetRowSize(plane), src->GetHeight(plane), 1, 1, env);
+    }
+  } else {
+    convolvePlane(dst->GetWritePtr(), src->GetReadPtr(), dst->GetPitch(), src->GetPitch(),
+                  src->GetRowSize(), src->GetHeight(), 4, -1, env);
+  }
 
   return dst;
 }
@@ -51,7 +51,8 @@
 
 class GeneralConvolution : public GenericVideoFilter 
 /** This class exposes a video filter that applies general convolutions -- up to a 5x5
-  * kernel -- to a clip.  Smaller (3x3) kernels have their own code path.  SIMD support forthcoming.
+  * kernel -- to a clip.  Separable kernels are applied as two 1D passes, with SSE2 code
+  * for both kinds working directly on interleaved RGB32 or on planar YUV.
  **/
 {
 public:
@@ -67,37 +68,24 @@ protected:
     void setMatrix(const char * _matrix, IScriptEnvironment* env);
 
 private:      
+    void convolvePlane(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int row_size, int height,
+                       int step, int row_dir, IScriptEnvironment* env);
+
     double divisor;
     size_t nSize;
     int nBias;
     bool autoscale;
 
-    // Messy way of storing matrix, but avoids performance penalties of indirection    
-    int i00;
-    int i10;
-    int i20;
-    int i30;
-    int i40;
-    int i01;
-    int i11;
-    int i21;
-    int i31;
-    int i41;
-    int i02;
-    int i12;
-    int i22;
-    int i32;
-    int i42;
-    int i03;
-    int i13;
-    int i23;
-    int i33;
-    int i43;
-    int i04;
-    int i14;
-    int i24;
-    int i34;
-    int i44;
+    int nRadius;
+    int iCountDiv;
+    int kernel[25];       // row-major, (2*nRadius+1)^2 entries, first row on top of the image
+
+    // Rank-1 kernels run as a vertical and a horizontal 1D pass
+    bool separable;
+    int kernel_v[5];
+    int kernel_h[5];
+
+    bool sse2_2d, sse2_separable;
 };
 
 
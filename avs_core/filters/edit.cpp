@@ -579,10 +579,11 @@ AVSValue __cdecl Dissolve::Create(AVSValue args, void*, IScriptEnvironment* env)
 }
 
 
-Dissolve::Dissolve(PClip _child1, PClip _child2, int _overlap, double fps, IScriptEnvironment* env)
+Dissolve::Dissolve(PClip _child1, PClip _child2, int _overlap, double fps, IScriptEnvironment* env, int _constant)
  : GenericVideoFilter(ConvertAudio::Create(_child1,SAMPLE_INT16|SAMPLE_FLOAT,SAMPLE_FLOAT)),
    child2(_child2),
    overlap(_overlap),
+   constant(_constant),
    audbuffer(0),
    audbufsize(0)
 {
@@ -640,6 +641,24 @@ Dissolve::Dissolve(PClip _child1, PClip _child2, int _overlap, double fps, IScri
     env->ThrowError("Dissolve: Maximum number of frames exceeded.");
 
   vi.num_audio_samples = audio_fade_start + vi2.num_audio_samples;
+
+  if (!vi.HasVideo())
+    constant = NoConstant;
+  if (constant != NoConstant) {
+    // Sample the colour once, the blend then never needs a frame of the colour clip.
+    // Rows repeat every 1, 3 or 4 bytes, 48 bytes hold a whole number of both periods.
+    PVideoFrame frame = (constant == FirstConstant ? child : child2)->GetFrame(0, env);
+    const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+    const int period = vi.IsRGB24() ? 3 : vi.IsRGB32() || vi.IsYUY2() ? 4 : 1;
+    memset(constant_pattern, 0, sizeof(constant_pattern));
+    for (int p = 0; p < (vi.IsPlanar() ? 3 : 1); ++p) {
+      if (frame->GetRowSize(planes[p]) < period)
+        continue;
+      const BYTE* srcp = frame->GetReadPtr(planes[p]);
+      for (int x = 0; x < 48; ++x)
+        constant_pattern[p][x] = srcp[x % period];
+    }
+  }
 }
 
 
@@ -656,6 +675,38 @@ PVideoFrame Dissolve::GetFrame(int n, IScriptEnvironment* env)
   if (n > video_fade_end)
     return child2->GetFrame(n - video_fade_start, env);
 
+  if (constant != NoConstant) {
+    // Fading to or from a colour: blend the one real frame straight into a new frame, which
+    // reads it once and leaves out both the MakeWritable copy and the colour clip's frame.
+    PVideoFrame src = constant == FirstConstant ? child2->GetFrame(n - video_fade_start, env) : child->GetFrame(n, env);
+    PVideoFrame dst = env->NewVideoFrame(vi);
+
+    const int multiplier = n - video_fade_end + overlap;
+    // Same weights as the merge routines below, so both paths give identical output
+    bool simd = !!(env->GetCPUFlags() & CPUF_SSE2);
+#ifdef X86_32
+    simd = simd || !!(env->GetCPUFlags() & CPUF_MMX);
+#endif
+    const int scale = simd ? 32767 : 65535;
+    const int weight = (multiplier * scale) / (overlap+1);   // of the second clip
+    const int src_weight = constant == FirstConstant ? weight : scale - weight;
+    const int colour_weight = scale - src_weight;
+
+    const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+    for (int p = 0; p < (vi.IsPlanar() ? 3 : 1); ++p) {
+      const int plane = planes[p];
+      BYTE* dstp = dst->GetWritePtr(plane);
+      const BYTE* srcp = src->GetReadPtr(plane);
+      if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(dstp, 16) && IsPtrAligned(srcp, 16))
+        weighted_merge_constant_sse2(dstp, srcp, dst->GetPitch(plane), src->GetPitch(plane), src->GetRowSize(plane), src->GetHeight(plane),
+                                     constant_pattern[p], src_weight, colour_weight);
+      else
+        weighted_merge_constant_c(dstp, srcp, dst->GetPitch(plane), src->GetPitch(plane), src->GetRowSize(plane), src->GetHeight(plane),
+                                  constant_pattern[p], src_weight, colour_weight, simd ? 15 : 16);
+    }
+    return dst;
+  }
+
   PVideoFrame a = child->GetFrame(n, env);
   PVideoFrame b = child2->GetFrame(n - video_fade_start, env);
 
@@ -1049,7 +1100,7 @@ AVSValue __cdecl Create_FadeOut0(AVSValue args, void*,IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration,fadeclr,fps,env);
-  return new Dissolve(a, b, duration, fps, env);
+  return new Dissolve(a, b, duration, fps, env, Dissolve::SecondConstant);
 }
 
 AVSValue __cdecl Create_FadeOut(AVSValue args, void*,IScriptEnvironment* env) {
@@ -1058,7 +1109,7 @@ AVSValue __cdecl Create_FadeOut(AVSValue args, void*,IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration+1,fadeclr,fps,env);
-  return new Dissolve(a, b, duration, fps, env);
+  return new Dissolve(a, b, duration, fps, env, Dissolve::SecondConstant);
 }
 
 AVSValue __cdecl Create_FadeOut2(AVSValue args, void*,IScriptEnvironment* env) {
@@ -1067,7 +1118,7 @@ AVSValue __cdecl Create_FadeOut2(AVSValue args, void*,IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration+2,fadeclr,fps,env);
-  return new Dissolve(a, b, duration, fps, env);
+  return new Dissolve(a, b, duration, fps, env, Dissolve::SecondConstant);
 }
 
 AVSValue __cdecl Create_FadeIn0(AVSValue args, void*,IScriptEnvironment* env) {
@@ -1076,7 +1127,7 @@ AVSValue __cdecl Create_FadeIn0(AVSValue args, void*,IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration,fadeclr,fps,env);
-  return new Dissolve(b, a, duration, fps, env);
+  return new Dissolve(b, a, duration, fps, env, Dissolve::FirstConstant);
 }
 
 AVSValue __cdecl Create_FadeIn(AVSValue args, void*,IScriptEnvironment* env) {
@@ -1085,7 +1136,7 @@ AVSValue __cdecl Create_FadeIn(AVSValue args, void*,IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration+1,fadeclr,fps,env);
-  return new Dissolve(b, a, duration, fps, env);
+  return new Dissolve(b, a, duration, fps, env, Dissolve::FirstConstant);
 }
 
 AVSValue __cdecl Create_FadeIn2(AVSValue args, void*,IScriptEnvironment* env) {
@@ -1094,7 +1145,7 @@ AVSValue __cdecl Create_FadeIn2(AVSValue args, void*,IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration+2,fadeclr,fps,env);
-  return new Dissolve(b, a, duration, fps, env);
+  return new Dissolve(b, a, duration, fps, env, Dissolve::FirstConstant);
 }
 
 AVSValue __cdecl Create_FadeIO0(AVSValue args, void*, IScriptEnvironment* env) {
@@ -1103,8 +1154,8 @@ AVSValue __cdecl Create_FadeIO0(AVSValue args, void*, IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration,fadeclr,fps,env);
-  AVSValue dissolve_args[] = { b, a, b, duration, fps };
-  return env->Invoke("Dissolve", AVSValue(dissolve_args,5)).AsClip();
+  PClip fadein = new Dissolve(b, a, duration, fps, env, Dissolve::FirstConstant);
+  return new Dissolve(fadein, b, duration, fps, env, Dissolve::SecondConstant);
 }
 
 AVSValue __cdecl Create_FadeIO(AVSValue args, void*, IScriptEnvironment* env) {
@@ -1113,8 +1164,8 @@ AVSValue __cdecl Create_FadeIO(AVSValue args, void*, IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration+1,fadeclr,fps,env);
-  AVSValue dissolve_args[] = { b, a, b, duration, fps };
-  return env->Invoke("Dissolve", AVSValue(dissolve_args,5)).AsClip();
+  PClip fadein = new Dissolve(b, a, duration, fps, env, Dissolve::FirstConstant);
+  return new Dissolve(fadein, b, duration, fps, env, Dissolve::SecondConstant);
 }
 
 AVSValue __cdecl Create_FadeIO2(AVSValue args, void*, IScriptEnvironment* env) {
@@ -1123,8 +1174,8 @@ AVSValue __cdecl Create_FadeIO2(AVSValue args, void*, IScriptEnvironment* env) {
   const float fps = (float)args[3].AsFloat(24.0f);
   PClip a = args[0].AsClip();
   PClip b = ColorClip(a,duration+2,fadeclr,fps,env);
-  AVSValue dissolve_args[] = { b, a, b, duration, fps };
-  return env->Invoke("Dissolve", AVSValue(dissolve_args,5)).AsClip();
+  PClip fadein = new Dissolve(b, a, duration, fps, env, Dissolve::FirstConstant);
+  return new Dissolve(fadein, b, duration, fps, env, Dissolve::SecondConstant);
 }
 
 
@@ -153,7 +153,10 @@ class Dissolve : public GenericVideoFilter
  **/
 {
 public:
-  Dissolve(PClip _child1, PClip _child2, int _overlap, double fps, IScriptEnvironment* env);
+  // Which input, if any, is a single colour (the fades), see GetFrame
+  enum { NoConstant = 0, FirstConstant, SecondConstant };
+
+  Dissolve(PClip _child1, PClip _child2, int _overlap, double fps, IScriptEnvironment* env, int _constant = NoConstant);
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
   bool __stdcall GetParity(int n);
@@ -163,6 +166,8 @@ public:
 private:
   PClip child2;
   const int overlap;
+  int constant;
+  BYTE constant_pattern[3][48];   // Colour bytes of each plane for the first 48 bytes of a row
   int video_fade_start, video_fade_end;
   __int64 audio_fade_start, audio_fade_end;
   int audio_overlap;
@@ -1336,6 +1336,27 @@ static int calculate_sad(const BYTE* cur_ptr, const BYTE* other_ptr, int cur_pit
   return calculate_sad_c(cur_ptr, other_ptr, cur_pitch, other_pitch, width, height);
 }
 
+int TemporalSoften::FrameSAD(int plane, int cur, int other, const BYTE* cur_ptr, const BYTE* other_ptr, int cur_pitch,
+                             int other_pitch, size_t width, size_t height, IScriptEnvironment* env)
+{
+  if (cur == other)
+    return 0;   // Edge frames repeat at the clip ends
+
+  const std::pair<int, int> key(min(cur, other), max(cur, other));
+  {
+    std::lock_guard<std::mutex> lock(sad_mutex);
+    auto it = sad_cache[plane].find(key);
+    if (it != sad_cache[plane].end())
+      return it->second;
+  }
+
+  const int sad = calculate_sad(cur_ptr, other_ptr, cur_pitch, other_pitch, width, height, env);
+
+  std::lock_guard<std::mutex> lock(sad_mutex);
+  sad_cache[plane][key] = sad;
+  return sad;
+}
+
 PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
 {
   int radius = (kernel-1) / 2;
@@ -1354,10 +1375,25 @@ PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
   }
 
   auto frames = static_cast<PVideoFrame*>(alloca(sizeof(PVideoFrame)* kernel));
+  int frame_no[MAX_RADIUS*2+1];
   
   for (int p = n-radius; p<=n+radius; p++) {
     new(frames+p+radius-n) PVideoFrame;
-    frames[p+radius-n] = child->GetFrame(clamp(p, 0, vi.num_frames-1), env);
+    frame_no[p+radius-n] = clamp(p, 0, vi.num_frames-1);
+    frames[p+radius-n] = child->GetFrame(frame_no[p+radius-n], env);
+  }
+
+  if (scenechange>0) {
+    // Drop pairs that no frame near this one will ask for again
+    std::lock_guard<std::mutex> lock(sad_mutex);
+    for (int p = 0; p < 3; p++) {
+      for (auto it = sad_cache[p].begin(); it != sad_cache[p].end(); ) {
+        if (it->first.second < n - kernel || it->first.first > n + kernel)
+          it = sad_cache[p].erase(it);
+        else
+          ++it;
+      }
+    }
   }
 
   env->MakeWritable(&frames[radius]);
@@ -1391,7 +1427,7 @@ PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
       bool skiprest = false;
       for (int i = radius-1; i>=0; i--) { // Check frames backwards
         if ((!skiprest) && (!planeDisabled[i])) {
-          int sad = calculate_sad(c_plane, planeP[i], pitch, planePitch[i], frames[radius]->GetRowSize(planes[c]), h, env);
+          int sad = FrameSAD(c/2, frame_no[radius], frame_no[i], c_plane, planeP[i], pitch, planePitch[i], frames[radius]->GetRowSize(planes[c]), h, env);
           if (sad < scenechange) {
             planePitch2[d2] = planePitch[i];
             planeP2[d2++] = planeP[i];
@@ -1406,7 +1442,7 @@ PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
       skiprest = false;
       for (int i = radius; i < 2*radius; i++) { // Check forward frames
         if ((!skiprest)  && (!planeDisabled[i])) {   // Disable this frame on next plane (so that Y can affect UV)
-          int sad = calculate_sad(c_plane, planeP[i], pitch, planePitch[i], frames[radius]->GetRowSize(planes[c]), h, env);
+          int sad = FrameSAD(c/2, frame_no[radius], frame_no[i+1], c_plane, planeP[i], pitch, planePitch[i], frames[radius]->GetRowSize(planes[c]), h, env);
           if (sad < scenechange) {
             planePitch2[d2] = planePitch[i];
             planeP2[d2++] = planeP[i];
@@ -1481,8 +1517,106 @@ SpatialSoften::SpatialSoften( PClip _child, int _radius, unsigned _luma_threshol
   : GenericVideoFilter(_child), diameter(_radius*2+1),
     luma_threshold(_luma_threshold), chroma_threshold(_chroma_threshold)
 {
-  if (!vi.IsYUY2())
-    env->ThrowError("SpatialSoften: requires YUY2 input");
+  if (!vi.IsYUY2() && !(vi.IsPlanar() && vi.IsYUV()))
+    env->ThrowError("SpatialSoften: requires YUY2 or planar YUV input");
+  if (_radius < 0 || diameter > 65)
+    env->ThrowError("SpatialSoften: radius must be between 0 and 32");
+}
+
+
+// Planar soften: every pixel becomes the rounded mean of the taps in its diameter x diameter
+// window that are within threshold of it. Border columns closer than radius to the edge are
+// copied; rows past the top and bottom repeat the edge row, as in the YUY2 path.
+static void spatial_soften_plane_c(BYTE* dstp, const BYTE** line, int offset, int width, int radius, int threshold) {
+  for (int x = offset; x < width - radius; ++x) {
+    const int c = line[radius][x];
+    int cnt = 0, sum = 0;
+    for (int h = 0; h <= radius*2; ++h) {
+      for (int w = -radius; w <= radius; ++w) {
+        const int p = line[h][x+w];
+        if (IsClose(p, c, threshold)) {
+          ++cnt; sum += p;
+        }
+      }
+    }
+    dstp[x] = (sum + (cnt>>1)) / cnt;
+  }
+}
+
+
+static __forceinline __m128i ss_divide_sse2(__m128i &sum, __m128i &cnt) {
+  // sum < 2^24 and cnt <= 65*65, so the correctly rounded float quotient never crosses the
+  // next integer and truncation matches the integer division of the C path.
+  __m128 q = _mm_div_ps(_mm_cvtepi32_ps(_mm_add_epi32(sum, _mm_srli_epi32(cnt, 1))), _mm_cvtepi32_ps(cnt));
+  return _mm_cvttps_epi32(q);
+}
+
+
+// Returns the first column it did not process so the C routine can finish the row.
+static int spatial_soften_plane_sse2(BYTE* dstp, const BYTE** line, int width, int radius, int threshold) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i thresh = _mm_set1_epi8((char)min(threshold, 255));
+  const int diameter = radius*2 + 1;
+
+  int x = radius;
+  for (; x + 16 <= width - radius; x += 16) {
+    __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line[radius]+x));
+    __m128i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+    __m128i cnt_lo = zero, cnt_hi = zero;
+
+    for (int h = 0; h < diameter; ++h) {
+      // A single row holds at most 65 taps: byte counters and 16 bit sums cannot overflow.
+      __m128i row_lo = zero, row_hi = zero, row_cnt = zero;
+      const BYTE* row = line[h] + x - radius;
+      for (int w = 0; w < diameter; ++w) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row+w));
+        __m128i absdiff = _mm_or_si128(_mm_subs_epu8(p, center), _mm_subs_epu8(center, p));
+        __m128i leq_thresh = _mm_cmpeq_epi8(_mm_subs_epu8(absdiff, thresh), zero);
+        __m128i taken = _mm_and_si128(p, leq_thresh);
+        row_lo = _mm_add_epi16(row_lo, _mm_unpacklo_epi8(taken, zero));
+        row_hi = _mm_add_epi16(row_hi, _mm_unpackhi_epi8(taken, zero));
+        row_cnt = _mm_sub_epi8(row_cnt, leq_thresh);
+      }
+      sum0 = _mm_add_epi32(sum0, _mm_unpacklo_epi16(row_lo, zero));
+      sum1 = _mm_add_epi32(sum1, _mm_unpackhi_epi16(row_lo, zero));
+      sum2 = _mm_add_epi32(sum2, _mm_unpacklo_epi16(row_hi, zero));
+      sum3 = _mm_add_epi32(sum3, _mm_unpackhi_epi16(row_hi, zero));
+      cnt_lo = _mm_add_epi16(cnt_lo, _mm_unpacklo_epi8(row_cnt, zero));
+      cnt_hi = _mm_add_epi16(cnt_hi, _mm_unpackhi_epi8(row_cnt, zero));
+    }
+
+    __m128i c0 = _mm_unpacklo_epi16(cnt_lo, zero);
+    __m128i c1 = _mm_unpackhi_epi16(cnt_lo, zero);
+    __m128i c2 = _mm_unpacklo_epi16(cnt_hi, zero);
+    __m128i c3 = _mm_unpackhi_epi16(cnt_hi, zero);
+    __m128i lo = _mm_packs_epi32(ss_divide_sse2(sum0, c0), ss_divide_sse2(sum1, c1));
+    __m128i hi = _mm_packs_epi32(ss_divide_sse2(sum2, c2), ss_divide_sse2(sum3, c3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x), _mm_packus_epi16(lo, hi));
+  }
+  return x;
+}
+
+
+static void spatial_soften_plane(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int width, int height,
+                                 int radius, unsigned threshold, IScriptEnvironment* env) {
+  const bool sse2 = (env->GetCPUFlags() & CPUF_SSE2) && width - radius*2 >= 16;
+  const int thresh = (int)min(threshold, 255u); // every tap is within 255 of the centre anyway
+  const BYTE* line[65];
+
+  for (int y = 0; y < height; ++y) {
+    for (int h = 0; h <= radius*2; ++h)
+      line[h] = srcp + src_pitch * clamp(y+h-radius, 0, height-1);
+
+    if (width <= radius*2) {
+      memcpy(dstp, line[radius], width);
+    } else {
+      memcpy(dstp, line[radius], radius);
+      int x = sse2 ? spatial_soften_plane_sse2(dstp, line, width, radius, thresh) : radius;
+      spatial_soften_plane_c(dstp, line, x, width, radius, thresh);
+      memcpy(dstp + width - radius, line[radius] + width - radius, radius);
+    }
+    dstp += dst_pitch;
+  }
 }
 
 
@@ -1491,6 +1625,18 @@ PVideoFrame SpatialSoften::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame src = child->GetFrame(n, env);
   PVideoFrame dst = env->NewVideoFrame(vi);
 
+  if (vi.IsPlanar()) {
+    const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+    const int plane_count = vi.IsY8() ? 1 : 3;
+    for (int p = 0; p < plane_count; ++p) {
+      const int plane = planes[p];
+      spatial_soften_plane(dst->GetWritePtr(plane), src->GetReadPtr(plane), dst->GetPitch(plane), src->GetPitch(plane),
+                           src->GetRowSize(plane), src->GetHeight(plane), diameter>>1,
+                           plane == PLANAR_Y ? luma_threshold : chroma_threshold, env);
+    }
+    return dst;
+  }
+
   const BYTE* srcp = src->GetReadPtr();
   BYTE* dstp = dst->GetWritePtr();
   int src_pitch = src->GetPitch();
@@ -36,6 +36,8 @@
 #define __Focus_H__
 
 #include <avisynth.h>
+#include <map>
+#include <mutex>
 
 
 class AdjustFocusV : public GenericVideoFilter 
@@ -95,10 +97,18 @@ public:
   }
 
 private:
+  int FrameSAD(int plane, int cur, int other, const BYTE* cur_ptr, const BYTE* other_ptr, int cur_pitch,
+               int other_pitch, size_t width, size_t height, IScriptEnvironment* env);
+
 // YV12:
     int planes[8];
     int scenechange;
 
+  // Scene change SADs of frame pairs, per plane.  Sequential output frames share most of their
+  // pairs, so each pair is scanned once instead of once per output frame that looks at it.
+  std::map<std::pair<int, int>, int> sad_cache[3];
+  std::mutex sad_mutex;
+
 // YUY2:
   const unsigned luma_threshold, chroma_threshold;
   const int kernel;
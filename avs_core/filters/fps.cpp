@@ -38,6 +38,8 @@
 #include <avs/minmax.h>
 #include "../core/bitblt.h"
 #include "../core/internal.h"
+#include <avs/alignment.h>
+#include <emmintrin.h>
 
 
 
@@ -613,12 +615,103 @@ ConvertFPS::ConvertFPS( PClip _child, unsigned new_numerator, unsigned new_denom
 }
 
 
+/* -----------------------------------
+ *   ConvertFPS blend kernels
+ * -----------------------------------
+ */
+
+// a += ((b - a) * mix_ratio + half) >> resolution, written as the weighted sum
+// (a * (one - mix_ratio) + b * mix_ratio + half) >> resolution, which is the same value.
+static void convertfps_blend_sse2(BYTE* a, const BYTE* b, int a_pitch, int b_pitch, int row_size, int height, int mix_ratio, int resolution) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(1 << (resolution-1));
+  const __m128i weights = _mm_set1_epi32(((1 << resolution) - mix_ratio) | (mix_ratio << 16));
+  const int mod16 = row_size & ~15;
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < mod16; x += 16) {
+      __m128i pa = _mm_load_si128(reinterpret_cast<const __m128i*>(a+x));
+      __m128i pb = _mm_load_si128(reinterpret_cast<const __m128i*>(b+x));
+
+      __m128i lo = _mm_unpacklo_epi8(pa, pb); //b7a7 .. b0a0
+      __m128i hi = _mm_unpackhi_epi8(pa, pb);
+
+      __m128i p0 = _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), weights);
+      __m128i p1 = _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), weights);
+      __m128i p2 = _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), weights);
+      __m128i p3 = _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), weights);
+
+      p0 = _mm_srli_epi32(_mm_add_epi32(p0, round), resolution);
+      p1 = _mm_srli_epi32(_mm_add_epi32(p1, round), resolution);
+      p2 = _mm_srli_epi32(_mm_add_epi32(p2, round), resolution);
+      p3 = _mm_srli_epi32(_mm_add_epi32(p3, round), resolution);
+
+      __m128i result = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+      _mm_store_si128(reinterpret_cast<__m128i*>(a+x), result);
+    }
+    for (int x = mod16; x < row_size; x++)
+      a[x] += ((b[x] - a[x]) * mix_ratio + (1 << (resolution-1))) >> resolution;
+    a += a_pitch;
+    b += b_pitch;
+  }
+}
+
+static void convertfps_blend_c(BYTE* a, const BYTE* b, int a_pitch, int b_pitch, int row_size, int height, int mix_ratio, int resolution) {
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < row_size; x++)
+      a[x] += ((b[x] - a[x]) * mix_ratio + (1 << (resolution-1))) >> resolution;
+    a += a_pitch;
+    b += b_pitch;
+  }
+}
+
+static void convertfps_blend(BYTE* a, const BYTE* b, int a_pitch, int b_pitch, int row_size, int height, int mix_ratio, int resolution, IScriptEnvironment* env) {
+  if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(a, 16) && IsPtrAligned(b, 16) && !(a_pitch & 15) && !(b_pitch & 15))
+    convertfps_blend_sse2(a, b, a_pitch, b_pitch, row_size, height, mix_ratio, resolution);
+  else
+    convertfps_blend_c(a, b, a_pitch, b_pitch, row_size, height, mix_ratio, resolution);
+}
+
+
+// One line of the zone transition, pd = pa + ((pb - pa) * scale + zone/2) / zone.  The
+// quotient is done in float: the numerator is exact and, with zone <= 32767, the rounded
+// quotient can't cross an integer, so truncation gives the same result as the C division.
+static void convertfps_zone_line_sse2(BYTE* pd, const BYTE* pa, const BYTE* pb, int row_size, int scale, int zone) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i weights = _mm_set1_epi32(scale | ((zone>>1) << 16));
+  const __m128 divisor = _mm_set1_ps((float)zone);
+  const int mod16 = row_size & ~15;
+
+  for (int x = 0; x < mod16; x += 16) {
+    __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(pa+x));
+    __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(pb+x));
+    __m128i a_lo = _mm_unpacklo_epi8(a, zero), a_hi = _mm_unpackhi_epi8(a, zero);
+    __m128i d_lo = _mm_sub_epi16(_mm_unpacklo_epi8(b, zero), a_lo);
+    __m128i d_hi = _mm_sub_epi16(_mm_unpackhi_epi8(b, zero), a_hi);
+
+    __m128i q[4];
+    q[0] = _mm_madd_epi16(_mm_unpacklo_epi16(d_lo, one), weights);
+    q[1] = _mm_madd_epi16(_mm_unpackhi_epi16(d_lo, one), weights);
+    q[2] = _mm_madd_epi16(_mm_unpacklo_epi16(d_hi, one), weights);
+    q[3] = _mm_madd_epi16(_mm_unpackhi_epi16(d_hi, one), weights);
+    for (int i = 0; i < 4; i++)
+      q[i] = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(q[i]), divisor));
+
+    __m128i lo = _mm_add_epi16(a_lo, _mm_packs_epi32(q[0], q[1]));
+    __m128i hi = _mm_add_epi16(a_hi, _mm_packs_epi32(q[2], q[3]));
+    _mm_store_si128(reinterpret_cast<__m128i*>(pd+x), _mm_packus_epi16(lo, hi));
+  }
+  for (int x = mod16; x < row_size; x++)
+    pd[x] = pa[x] + ((pb[x] - pa[x]) * scale + (zone>>1)) / zone;
+}
+
+
 PVideoFrame __stdcall ConvertFPS::GetFrame(int n, IScriptEnvironment* env)
 {
 	static const int resolution =10; //bits. Must be >= 4, or modify next line
 	static const int threshold  = 1<<(resolution-4);
 	static const int one        = 1<<resolution;
-	static const int half       = 1<<(resolution-1);
 
 	int nsrc      = int( n * fa / fb );
 	int frac      = int( (((n*fa) % fb) << resolution) / fb );
@@ -652,14 +745,7 @@ PVideoFrame __stdcall ConvertFPS::GetFrame(int n, IScriptEnvironment* env)
 			int          row_size = a->GetRowSize(plane[j]);
 			int          height   = a->GetHeight(plane[j]);
 
-// :FIXME: Use fast plane blend routine from Merge here
-
-			for (int y = 0; y < height; y++) {
-				for (int x = 0; x < row_size; x++)
-					a_data[x] += ((b_data[x] - a_data[x]) * mix_ratio + half) >> resolution;
-				a_data += a_pitch;
-				b_data += b_pitch;
-			}
+			convertfps_blend(a_data, b_data, a_pitch, b_pitch, row_size, height, mix_ratio, resolution, env);
 		}
 		return a;
 
@@ -679,6 +765,7 @@ PVideoFrame __stdcall ConvertFPS::GetFrame(int n, IScriptEnvironment* env)
 		BYTE *pd;
 		const BYTE *pa, *pb, *a_data = a->GetReadPtr();
 		int   a_pitch = a->GetPitch();
+		const bool sse2 = (env->GetCPUFlags() & CPUF_SSE2) && zone <= 32767;
 
 		int switch_line = (lps * (one - frac)) >> resolution;
 		int top = switch_line - (zone>>1);
@@ -711,8 +798,11 @@ loop:
 		pb = b_data + safe_top * b_pitch;
 		for( int y = safe_top; y < bottom; y++ ) {
 			int scale = y - top;
-			for( int x = 0; x < row_size; x++ )
-				pd[x] = pa[x] + ((pb[x] - pa[x]) * scale + (zone>>1)) / zone;
+			if( sse2 && IsPtrAligned(pd, 16) && IsPtrAligned(pa, 16) && IsPtrAligned(pb, 16) )
+				convertfps_zone_line_sse2(pd, pa, pb, row_size, scale, zone);
+			else
+				for( int x = 0; x < row_size; x++ )
+					pd[x] = pa[x] + ((pb[x] - pa[x]) * scale + (zone>>1)) / zone;
 			pd += pitch;
 			pa += a_pitch;
 			pb += b_pitch;
@@ -212,18 +212,21 @@ PVideoFrame Greyscale::GetFrame(int n, IScriptEnvironment* env)
   if (vi.IsY8())
     return frame;
 
-  env->MakeWritable(&frame);
-  BYTE* srcp = frame->GetWritePtr();
-  int pitch = frame->GetPitch();
-  int height = vi.height;
-  int width = vi.width;
-
   if (vi.IsPlanar()) {
+    // The chroma is overwritten, a shared frame only needs its luma copied
+    static_cast<IScriptEnvironment2*>(env)->MakePlanesWritable(&frame, PLANAR_Y);
+    frame->GetWritePtr(PLANAR_Y); //Must be requested
     memset(frame->GetWritePtr(PLANAR_U), 0x80808080, frame->GetHeight(PLANAR_U) * frame->GetPitch(PLANAR_U));
     memset(frame->GetWritePtr(PLANAR_V), 0x80808080, frame->GetHeight(PLANAR_V) * frame->GetPitch(PLANAR_V));
     return frame;
   }
 
+  env->MakeWritable(&frame);
+  BYTE* srcp = frame->GetWritePtr();
+  int pitch = frame->GetPitch();
+  int height = vi.height;
+  int width = vi.width;
+
   if (vi.IsYUY2()) {
     if ((env->GetCPUFlags() & CPUF_SSE2) && width > 4 && IsPtrAligned(srcp, 16)) {
       greyscale_yuy2_sse2(srcp, width, height, pitch);
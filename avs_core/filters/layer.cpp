@@ -42,6 +42,7 @@
 #include <avs/minmax.h>
 #include <avs/alignment.h>
 #include "../core/internal.h"
+#include "../core/bitblt.h"
 #include <emmintrin.h>
 
 
@@ -2238,14 +2239,37 @@ PVideoFrame __stdcall Layer::GetFrame(int n, IScriptEnvironment* env)
 
   PVideoFrame src2 = child2->GetFrame(min(n,overlay_frames-1), env);
 
-  env->MakeWritable(&src1);
+  // Solid-colour frames (BlankClip), see VideoFrame::SetConstant. Every op
+  // works on whole pixels, so a pattern of up to 4 bytes stays one.
+  const int period1 = src1->GetConstantPeriod();
+  const int period2 = src2->GetConstantPeriod();
+
+  // A transparent solid overlay leaves the frame as it is in every RGB32 op
+  // but Fast, which ignores alpha. No need to copy src1 and blend.
+  if (vi.IsRGB32() && (period2 == 1 || period2 == 4) && lstrcmpi(Op, "Fast")) {
+    const int alpha = (src2->GetConstantPattern()[3 % period2] * levelB + 1) >> 8;
+    if (alpha == 0)
+      return src1;
+  }
+
+  // Two solid colours over the whole frame give a solid colour: blend the
+  // first row only and repeat it.
+  const bool constant_result = period1 != 0 && period2 != 0 && 4 % period1 == 0 && 4 % period2 == 0 &&
+                               xdest == 0 && ydest == 0 && xcount == vi.width && ycount == vi.height;
+  if (constant_result) {
+    PVideoFrame dst = env->NewVideoFrame(vi);
+    FillPlane(dst->GetWritePtr(), dst->GetPitch(), src1->GetConstantPattern(), period1, dst->GetRowSize(), 1);
+    src1 = dst;
+  } else {
+    env->MakeWritable(&src1);
+  }
 
   const int src1_pitch = src1->GetPitch();
   const int src2_pitch = src2->GetPitch();
   const int src2_row_size = src2->GetRowSize();
   const int row_size = src1->GetRowSize();
   const int mylevel = levelB;
-  const int height = ycount;
+  const int height = constant_result ? 1 : ycount;
   const int width = xcount;
   BYTE* src1p = src1->GetWritePtr();
   const BYTE* src2p = src2->GetReadPtr();
@@ -2629,6 +2653,12 @@ PVideoFrame __stdcall Layer::GetFrame(int n, IScriptEnvironment* env)
       }
     }
   }
+
+  if (constant_result) {
+    BYTE* dstp = src1->GetWritePtr();
+    FillPlane(dstp + src1_pitch, src1_pitch, dstp, 4, row_size, vi.height - 1);
+    src1->SetConstant(4, src1->GetReadPtr());
+  }
   return src1;
 }
 
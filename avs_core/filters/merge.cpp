@@ -41,6 +41,7 @@
 
 #include "merge.h"
 #include "../core/internal.h"
+#include "../core/bitblt.h"
 #include <emmintrin.h>
 #include "avs/alignment.h"
 
@@ -534,6 +535,107 @@ void weighted_merge_planar_c(BYTE *p1, const BYTE *p2, int p1_pitch, int p2_pitc
 }
 
 
+/* -----------------------------------
+ *      average_plane_constant
+ * -----------------------------------
+ */
+static void average_plane_constant_sse2(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int width, int height, const BYTE* pattern) {
+  __m128i colour[3];
+  for (int i = 0; i < 3; ++i)
+    colour[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + i*16));
+
+  int mod16_width = width / 16 * 16;
+
+  for (int y = 0; y < height; y++) {
+    int phase = 0;
+    for (int x = 0; x < mod16_width; x += 16) {
+      __m128i src = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp+x));
+      _mm_store_si128(reinterpret_cast<__m128i*>(dstp+x), _mm_avg_epu8(src, colour[phase]));
+      phase = phase == 2 ? 0 : phase + 1;
+    }
+
+    for (int x = mod16_width; x < width; ++x) {
+      dstp[x] = (int(srcp[x]) + pattern[x % 48] + 1) >> 1;
+    }
+    dstp += dst_pitch;
+    srcp += src_pitch;
+  }
+}
+
+static void average_plane_constant_c(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int width, int height, const BYTE* pattern) {
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      dstp[x] = (int(srcp[x]) + pattern[x % 48] + 1) >> 1;
+    }
+    dstp += dst_pitch;
+    srcp += src_pitch;
+  }
+}
+
+
+/* -----------------------------------
+ *      weighted_merge_constant
+ * -----------------------------------
+ */
+// dstp = (srcp*src_weight + colour*colour_weight + round) >> shift, the same sum as
+// weighted_merge_planar, with the colour bytes repeating every 48 bytes of a row.
+void weighted_merge_constant_sse2(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int rowsize, int height,
+                                  const BYTE* pattern, int src_weight, int colour_weight) {
+  __m128i round_mask = _mm_set1_epi32(0x4000);
+  __m128i zero = _mm_setzero_si128();
+  __m128i mask = _mm_set_epi16(colour_weight, src_weight, colour_weight, src_weight, colour_weight, src_weight, colour_weight, src_weight);
+  __m128i colour[3];
+  for (int i = 0; i < 3; ++i)
+    colour[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + i*16));
+
+  int wMod16 = (rowsize/16) * 16;
+
+  for (int y = 0; y < height; y++) {
+    int phase = 0;
+    for (int x = 0; x < wMod16; x += 16) {
+      __m128i px = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp+x));
+
+      __m128i p0123 = _mm_unpacklo_epi8(px, colour[phase]);
+      __m128i p4567 = _mm_unpackhi_epi8(px, colour[phase]);
+
+      __m128i p01 = _mm_madd_epi16(_mm_unpacklo_epi8(p0123, zero), mask);
+      __m128i p23 = _mm_madd_epi16(_mm_unpackhi_epi8(p0123, zero), mask);
+      __m128i p45 = _mm_madd_epi16(_mm_unpacklo_epi8(p4567, zero), mask);
+      __m128i p67 = _mm_madd_epi16(_mm_unpackhi_epi8(p4567, zero), mask);
+
+      p01 = _mm_srli_epi32(_mm_add_epi32(p01, round_mask), 15);
+      p23 = _mm_srli_epi32(_mm_add_epi32(p23, round_mask), 15);
+      p45 = _mm_srli_epi32(_mm_add_epi32(p45, round_mask), 15);
+      p67 = _mm_srli_epi32(_mm_add_epi32(p67, round_mask), 15);
+
+      __m128i result = _mm_packus_epi16(_mm_packs_epi32(p01, p23), _mm_packs_epi32(p45, p67));
+      _mm_store_si128(reinterpret_cast<__m128i*>(dstp+x), result);
+
+      phase = phase == 2 ? 0 : phase + 1;
+    }
+
+    for (int x = wMod16; x < rowsize; x++) {
+      dstp[x] = (srcp[x]*src_weight + pattern[x % 48]*colour_weight + 16384) >> 15;
+    }
+
+    dstp += dst_pitch;
+    srcp += src_pitch;
+  }
+}
+
+void weighted_merge_constant_c(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int rowsize, int height,
+                               const BYTE* pattern, int src_weight, int colour_weight, int shift) {
+  const int round = 1 << (shift-1);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < rowsize; x++) {
+      dstp[x] = (srcp[x]*src_weight + pattern[x % 48]*colour_weight + round) >> shift;
+    }
+    dstp += dst_pitch;
+    srcp += src_pitch;
+  }
+}
+
+
 /********************************************************************
 ***** Declare index of new filters for Avisynth's filter engine *****
 ********************************************************************/
@@ -588,6 +690,42 @@ static void merge_plane(BYTE* srcp, const BYTE* otherp, int src_pitch, int other
   }
 }
 
+// merge_plane for a second input that is one colour, or a first one when colour_first.
+// dstp is where merge_plane would write and otherp where it would read the second clip,
+// so the same scale is picked and the output is identical.
+static void merge_plane_constant(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int width, int height,
+                                 const BYTE* pattern, bool colour_first, const BYTE* otherp, float weight, IScriptEnvironment *env) {
+  if ((weight>0.4961f) && (weight<0.5039f))
+  {
+    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(dstp, 16) && IsPtrAligned(srcp, 16))
+      average_plane_constant_sse2(dstp, srcp, dst_pitch, src_pitch, width, height, pattern);
+    else
+      average_plane_constant_c(dstp, srcp, dst_pitch, src_pitch, width, height, pattern);
+    return;
+  }
+
+  bool simd = (env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(dstp, 16) && IsPtrAligned(otherp, 16);
+#ifdef X86_32
+  simd = simd || !!(env->GetCPUFlags() & CPUF_MMX);
+#endif
+  const int scale = simd ? 32767 : 65535;
+  const int iweight = (int)(weight*(float)scale);
+  const int src_weight = colour_first ? iweight : scale - iweight;
+  const int colour_weight = scale - src_weight;
+
+  if (simd && (env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(dstp, 16) && IsPtrAligned(srcp, 16))
+    weighted_merge_constant_sse2(dstp, srcp, dst_pitch, src_pitch, width, height, pattern, src_weight, colour_weight);
+  else
+    weighted_merge_constant_c(dstp, srcp, dst_pitch, src_pitch, width, height, pattern, src_weight, colour_weight, simd ? 15 : 16);
+}
+
+static void expand_constant_pattern(BYTE* pattern48, const PVideoFrame& frame, int plane) {
+  const int period = frame->GetConstantPeriod();
+  const BYTE* pattern = frame->GetConstantPattern(plane);
+  for (int x = 0; x < 48; ++x)
+    pattern48[x] = pattern[x % period];
+}
+
 /****************************
 ******   Merge Chroma   *****
 ****************************/
@@ -690,19 +828,11 @@ PVideoFrame __stdcall MergeChroma::GetFrame(int n, IScriptEnvironment* env)
 
       return chroma;
     } else {
-      if (src->IsWritable()) {
-        src->GetWritePtr(PLANAR_Y); //Must be requested
-        env->BitBlt(src->GetWritePtr(PLANAR_U),src->GetPitch(PLANAR_U),chroma->GetReadPtr(PLANAR_U),chroma->GetPitch(PLANAR_U),chroma->GetRowSize(PLANAR_U),chroma->GetHeight(PLANAR_U));
-        env->BitBlt(src->GetWritePtr(PLANAR_V),src->GetPitch(PLANAR_V),chroma->GetReadPtr(PLANAR_V),chroma->GetPitch(PLANAR_V),chroma->GetRowSize(PLANAR_V),chroma->GetHeight(PLANAR_V));
-      }
-      else { // avoid the cost of 2 chroma blits
-        PVideoFrame dst = env->NewVideoFrame(vi);
-        
-        env->BitBlt(dst->GetWritePtr(PLANAR_Y),dst->GetPitch(PLANAR_Y),src->GetReadPtr(PLANAR_Y),src->GetPitch(PLANAR_Y),src->GetRowSize(PLANAR_Y),src->GetHeight(PLANAR_Y));
-        env->BitBlt(dst->GetWritePtr(PLANAR_U),dst->GetPitch(PLANAR_U),chroma->GetReadPtr(PLANAR_U),chroma->GetPitch(PLANAR_U),chroma->GetRowSize(PLANAR_U),chroma->GetHeight(PLANAR_U));
-        env->BitBlt(dst->GetWritePtr(PLANAR_V),dst->GetPitch(PLANAR_V),chroma->GetReadPtr(PLANAR_V),chroma->GetPitch(PLANAR_V),chroma->GetRowSize(PLANAR_V),chroma->GetHeight(PLANAR_V));
-        return dst;
-      }
+      // The chroma is replaced, a shared frame only needs its luma copied
+      static_cast<IScriptEnvironment2*>(env)->MakePlanesWritable(&src, PLANAR_Y);
+      src->GetWritePtr(PLANAR_Y); //Must be requested
+      env->BitBlt(src->GetWritePtr(PLANAR_U),src->GetPitch(PLANAR_U),chroma->GetReadPtr(PLANAR_U),chroma->GetPitch(PLANAR_U),chroma->GetRowSize(PLANAR_U),chroma->GetHeight(PLANAR_U));
+      env->BitBlt(src->GetWritePtr(PLANAR_V),src->GetPitch(PLANAR_V),chroma->GetReadPtr(PLANAR_V),chroma->GetPitch(PLANAR_V),chroma->GetRowSize(PLANAR_V),chroma->GetHeight(PLANAR_V));
     }
   }
   return src;
@@ -801,15 +931,17 @@ PVideoFrame __stdcall MergeLuma::GetFrame(int n, IScriptEnvironment* env)
   }  // Planar
   if (weight>0.9961f) {
     const VideoInfo& vi2 = clip->GetVideoInfo();
-    if (luma->IsWritable() && vi.IsSameColorspace(vi2)) {
+    if (vi.IsSameColorspace(vi2)) {
       if (luma->GetRowSize(PLANAR_U)) {
+        // The chroma is replaced, a shared frame only needs its luma copied
+        static_cast<IScriptEnvironment2*>(env)->MakePlanesWritable(&luma, PLANAR_Y);
         luma->GetWritePtr(PLANAR_Y); //Must be requested BUT only if we actually do something
         env->BitBlt(luma->GetWritePtr(PLANAR_U),luma->GetPitch(PLANAR_U),src->GetReadPtr(PLANAR_U),src->GetPitch(PLANAR_U),src->GetRowSize(PLANAR_U),src->GetHeight(PLANAR_U));
         env->BitBlt(luma->GetWritePtr(PLANAR_V),luma->GetPitch(PLANAR_V),src->GetReadPtr(PLANAR_V),src->GetPitch(PLANAR_V),src->GetRowSize(PLANAR_V),src->GetHeight(PLANAR_V));
       }
       return luma;
     }
-    else { // avoid the cost of 2 chroma blits
+    else { // different planar format, build the frame from both
       PVideoFrame dst = env->NewVideoFrame(vi);
       
       env->BitBlt(dst->GetWritePtr(PLANAR_Y),dst->GetPitch(PLANAR_Y),luma->GetReadPtr(PLANAR_Y),luma->GetPitch(PLANAR_Y),luma->GetRowSize(PLANAR_Y),luma->GetHeight(PLANAR_Y));
@@ -870,6 +1002,9 @@ PVideoFrame __stdcall MergeAll::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame src  = child->GetFrame(n, env);
   PVideoFrame src2 =  clip->GetFrame(n, env);
 
+  if (src->GetConstantPeriod() || src2->GetConstantPeriod())
+    return MergeConstant(src, src2, env);
+
   env->MakeWritable(&src);
   BYTE* srcp  = src->GetWritePtr();
   const BYTE* srcp2 = src2->GetReadPtr();
@@ -895,6 +1030,55 @@ PVideoFrame __stdcall MergeAll::GetFrame(int n, IScriptEnvironment* env)
 }
 
 
+// At least one frame is a solid colour (BlankClip, a fade colour): blend against its
+// pattern instead of reading it. A constant src is not copied first, and two constant
+// frames give a constant frame computed from a single row.
+PVideoFrame MergeAll::MergeConstant(PVideoFrame& src, const PVideoFrame& src2, IScriptEnvironment* env)
+{
+  const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+  const int plane_count = vi.IsPlanar() ? 3 : 1;
+  const bool colour_first = src->GetConstantPeriod() != 0;
+
+  if (colour_first && src2->GetConstantPeriod()) {
+    const int period = src->GetConstantPeriod();
+    PVideoFrame dst = env->NewVideoFrame(vi);
+    for (int p = 0; p < plane_count; ++p) {
+      const int plane = planes[p];
+      BYTE* dstp = dst->GetWritePtr(plane);
+      const int pitch = dst->GetPitch(plane);
+      const int row_size = dst->GetRowSize(plane);
+      BYTE pattern[48];
+      expand_constant_pattern(pattern, src2, plane);
+      // What MakeWritable and merge_plane would have done, for the first row
+      FillPlane(dstp, pitch, src->GetConstantPattern(plane), period, row_size, 1);
+      merge_plane_constant(dstp, dstp, pitch, pitch, row_size, 1, pattern, false, src2->GetReadPtr(plane), weight, env);
+      FillPlane(dstp + pitch, pitch, dstp, period, row_size, dst->GetHeight(plane) - 1);
+    }
+    dst->SetConstant(period, dst->GetReadPtr(PLANAR_Y),
+                     vi.IsPlanar() ? dst->GetReadPtr(PLANAR_U) : 0, vi.IsPlanar() ? dst->GetReadPtr(PLANAR_V) : 0);
+    return dst;
+  }
+
+  PVideoFrame dst;
+  if (colour_first)
+    dst = env->NewVideoFrame(vi);
+  else
+    env->MakeWritable(&src);
+  const PVideoFrame& out = colour_first ? dst : src;
+  const PVideoFrame& in = colour_first ? src2 : src;
+  const PVideoFrame& colour = colour_first ? src : src2;
+
+  for (int p = 0; p < plane_count; ++p) {
+    const int plane = planes[p];
+    BYTE pattern[48];
+    expand_constant_pattern(pattern, colour, plane);
+    merge_plane_constant(out->GetWritePtr(plane), in->GetReadPtr(plane), out->GetPitch(plane), in->GetPitch(plane),
+                         in->GetRowSize(plane), in->GetHeight(plane), pattern, colour_first, src2->GetReadPtr(plane), weight, env);
+  }
+  return out;
+}
+
+
 AVSValue __cdecl MergeAll::Create(AVSValue args, void* user_data, IScriptEnvironment* env)
 {
   return new MergeAll(args[0].AsClip(), args[1].AsClip(), (float)args[2].AsFloat(0.5f), env);
@@ -105,6 +105,8 @@ public:
   static AVSValue __cdecl Create(AVSValue args, void* user_data, IScriptEnvironment* env);
 
 private:
+  PVideoFrame MergeConstant(PVideoFrame& src, const PVideoFrame& src2, IScriptEnvironment* env);
+
   PClip clip;
   float weight;
 };
@@ -113,4 +115,10 @@ void weighted_merge_planar_sse2(BYTE *p1,const BYTE *p2, int p1_pitch, int p2_pi
 void weighted_merge_planar_mmx(BYTE *p1,const BYTE *p2, int p1_pitch, int p2_pitch,int rowsize, int height, int weight, int invweight);
 void weighted_merge_planar_c(BYTE *p1,const BYTE *p2, int p1_pitch, int p2_pitch,int rowsize, int height, int weight, int invweight);
 
+// Blend with a plane of one colour, pattern holds the first 48 bytes of each of its rows
+void weighted_merge_constant_sse2(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int rowsize, int height,
+                                  const BYTE* pattern, int src_weight, int colour_weight);
+void weighted_merge_constant_c(BYTE* dstp, const BYTE* srcp, int dst_pitch, int src_pitch, int rowsize, int height,
+                               const BYTE* pattern, int src_weight, int colour_weight, int shift);
+
 #endif  // __Merge_H__
@@ -195,14 +195,23 @@ PVideoFrame __stdcall Overlay::GetFrame(int n, IScriptEnvironment *env) {
 
   inputConv->ConvertImage(frame, img, env);
 
-  // Fetch current overlay and convert it
-  PVideoFrame Oframe = overlay->GetFrame(n, env);
-  overlayConv->ConvertImage(Oframe, overlayImg, env);
-
-  // Clip overlay to original image
-  ClipFrames(img, overlayImg, offset_x + con_x_offset, offset_y + con_y_offset);
+  // A solid black grey mask hides the overlay in every mode, so the
+  // overlay isn't even fetched then.
+  PVideoFrame Mframe;
+  if (mask && greymask)
+    Mframe = mask->GetFrame(n, env);
+  const bool transparent = Mframe && IsTransparentGreyMask(Mframe, maskVi);
+
+  if (!transparent) {
+    // Fetch current overlay and convert it
+    PVideoFrame Oframe = overlay->GetFrame(n, env);
+    overlayConv->ConvertImage(Oframe, overlayImg, env);
+
+    // Clip overlay to original image
+    ClipFrames(img, overlayImg, offset_x + con_x_offset, offset_y + con_y_offset);
+  }
 
-  if (overlayImg->IsSizeZero()) { // Nothing to overlay
+  if (transparent || overlayImg->IsSizeZero()) { // Nothing to overlay
     // Convert output image back
     img->ReturnOriginal(true);
     overlayImg->ReturnOriginal(true);
@@ -212,7 +221,8 @@ PVideoFrame __stdcall Overlay::GetFrame(int n, IScriptEnvironment *env) {
   } else {
     // fetch current mask (if given)
     if (mask) {
-        PVideoFrame Mframe = mask->GetFrame(n, env);
+        if (!Mframe)
+          Mframe = mask->GetFrame(n, env);
         if (greymask)
             maskConv->ConvertImageLumaOnly(Mframe, maskImg, env);
         else
@@ -426,6 +436,24 @@ ConvertTo444* Overlay::SelectInputCS(VideoInfo* VidI, IScriptEnvironment* env, b
 }
 
 
+// True if frame is a solid colour (see VideoFrame::SetConstant) which gives
+// a grey mask of 0 everywhere. ConvertImageLumaOnly reads every byte of a
+// planar Y plane, the Y bytes of YUY2 and the first byte of an RGB pixel.
+bool Overlay::IsTransparentGreyMask(const PVideoFrame& frame, const VideoInfo& vi) {
+  const int period = frame->GetConstantPeriod();
+  if (period == 0)
+    return false;
+
+  const int step = vi.IsYUY2() ? 2 : vi.IsRGB() ? vi.BytesFromPixels(1) : 1;
+  const BYTE* pattern = frame->GetConstantPattern(PLANAR_Y);
+  for (int x = 0; x < period * step; x += step) {
+    if (pattern[x % period] != 0)
+      return false;
+  }
+  return true;
+}
+
+
 void Overlay::ClipFrames(Image444* input, Image444* overlay, int x, int y) {
 
   input->ResetFake();
@@ -64,6 +64,7 @@ private:
   ConvertFrom444* SelectOutputCS(const char* name, IScriptEnvironment* env);
   static ConvertTo444* SelectInputCS(VideoInfo* VidI, IScriptEnvironment* env, bool full_range);
   static void ClipFrames(Image444* input, Image444* overlay, int x, int y);
+  static bool IsTransparentGreyMask(const PVideoFrame& frame, const VideoInfo& vi);
   static void FetchConditionals(IScriptEnvironment* env, int*, int*, int*, bool);
 
   VideoInfo overlayVi;
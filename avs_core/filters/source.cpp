@@ -98,11 +98,14 @@ static PVideoFrame CreateBlankFrame(const VideoInfo& vi, int color, int mode, IS
     {for (int i=0; i<size; i+=4)
       *(unsigned*)(p+i) = Cval;
     }
+    const BYTE pattern[3] = { BYTE(color_yuv>>16), BYTE(color_yuv>>8), BYTE(color_yuv) };
+    frame->SetConstant(1, &pattern[0], &pattern[1], &pattern[2]);
   } else if (vi.IsYUY2()) {
     int color_yuv =(mode == COLOR_MODE_YUV) ? color : RGB2YUV(color);
     unsigned d = ((color_yuv>>16)&255) * 0x010001 + ((color_yuv>>8)&255) * 0x0100 + (color_yuv&255) * 0x01000000;
     for (int i=0; i<size; i+=4)
       *(unsigned*)(p+i) = d;
+    frame->SetConstant(4, (const BYTE*)&d);
   } else if (vi.IsRGB24()) {
     const unsigned char clr0 = (color & 0xFF);
     const unsigned short clr1 = (color >> 8);
@@ -114,9 +117,11 @@ static PVideoFrame CreateBlankFrame(const VideoInfo& vi, int color, int mode, IS
       }
       p+=gp;
     }
+    frame->SetConstant(3, (const BYTE*)&color);
   } else if (vi.IsRGB32()) {
     for (int i=0; i<size; i+=4)
       *(unsigned*)(p+i) = color;
+    frame->SetConstant(4, (const BYTE*)&color);
   }
   return frame;
 }
@@ -279,7 +284,8 @@ static AVSValue __cdecl Create_BlankClip(AVSValue args, void*, IScriptEnvironmen
       env->ThrowError("BlankClip: color_yuv must be between 0 and %d($ffffff)", 0xffffff);
   }
 
-  return new StaticImage(vi, CreateBlankFrame(vi, color, mode, env), parity);
+  PVideoFrame frame = static_cast<IScriptEnvironment2*>(env)->InternFrame(CreateBlankFrame(vi, color, mode, env));
+  return new StaticImage(vi, frame, parity);
 }
 
 
@@ -319,6 +325,7 @@ PClip Create_MessageClip(const char* message, int width, int height, int pixel_t
 
   PVideoFrame frame = CreateBlankFrame(vi, bgcolor, COLOR_MODE_RGB, env);
   env->ApplyMessage(&frame, vi, message, size, textcolor, halocolor, bgcolor);
+  frame = static_cast<IScriptEnvironment2*>(env)->InternFrame(frame);
   return new StaticImage(vi, frame, false);
 };
 
@@ -733,6 +740,9 @@ public:
 		}
 	}
 
+	// Identical bars elsewhere in the graph share one buffer
+	frame = static_cast<IScriptEnvironment2*>(env)->InternFrame(frame);
+
 	// Generate Audio buffer
 	{
 	  unsigned x=vi.audio_samples_per_second, y=Hz;
@@ -846,6 +856,7 @@ AVSValue __cdecl Create_SegmentedSource(AVSValue args, void* use_directshow, ISc
   const char* fourCC = 0;
   int vtrack = 0;
   int atrack = 0;
+  bool indexcache = false;
   const int inv_args_count = args.ArraySize();
   AVSValue inv_args[9];
   if (!use_directshow) {
@@ -853,6 +864,7 @@ AVSValue __cdecl Create_SegmentedSource(AVSValue args, void* use_directshow, ISc
     fourCC = args[3].AsString("");
     vtrack = args[4].AsInt(0);
     atrack = args[5].AsInt(0);
+    indexcache = args[6].AsBool(false);
   }
   else {
     for (int i=1; i<inv_args_count ;i++)
@@ -879,7 +891,7 @@ AVSValue __cdecl Create_SegmentedSource(AVSValue args, void* use_directshow, ISc
             inv_args[0] = filename;
             clip = env->Invoke("DirectShowSource",AVSValue(inv_args, inv_args_count)).AsClip();
           } else {
-            clip =  (IClip*)(new AVISource(filename, bAudio, pixel_type, fourCC, 0, vtrack, atrack, env));
+            clip =  (IClip*)(new AVISource(filename, bAudio, pixel_type, fourCC, 0, vtrack, atrack, 0, indexcache, env));
           }
           result = !result ? clip : new_Splice(result, clip, false, env);
         } catch (const AvisynthError &e) {
@@ -1035,11 +1047,11 @@ AVSValue __cdecl Create_Version(AVSValue args, void*, IScriptEnvironment* env) {
 
 
 extern const AVSFunction Source_filters[] = {
-  { "AVISource",     BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", AVISource::Create, (void*) AVISource::MODE_NORMAL },
+  { "AVISource",     BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i[readahead]i[indexcache]b", AVISource::Create, (void*) AVISource::MODE_NORMAL },
   { "AVIFileSource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", AVISource::Create, (void*) AVISource::MODE_AVIFILE },
   { "WAVSource",     BUILTIN_FUNC_PREFIX, "s+", AVISource::Create, (void*) AVISource::MODE_WAV },
-  { "OpenDMLSource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", AVISource::Create, (void*) AVISource::MODE_OPENDML },
-  { "SegmentedAVISource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", Create_SegmentedSource, (void*)0 },
+  { "OpenDMLSource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i[readahead]i[indexcache]b", AVISource::Create, (void*) AVISource::MODE_OPENDML },
+  { "SegmentedAVISource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i[indexcache]b", Create_SegmentedSource, (void*)0 },
   { "SegmentedDirectShowSource", BUILTIN_FUNC_PREFIX, 
 // args               0      1      2       3       4            5          6         7            8
                      "s+[fps]f[seek]b[audio]b[video]b[convertfps]b[seekzero]b[timeout]i[pixel_type]s",
@@ -517,6 +517,7 @@ class VideoFrameBuffer {
 
 protected:
   VideoFrameBuffer(int size);
+  VideoFrameBuffer(BYTE* external_data, int size);  // does not take ownership
   VideoFrameBuffer();
   ~VideoFrameBuffer();
 
@@ -541,6 +542,13 @@ class VideoFrame {
   int offset, pitch, row_size, height, offsetU, offsetV, pitchUV;  // U&V offsets are from top of picture.
   int row_sizeUV, heightUV;
 
+  // Solid-colour metadata, see SetConstant. Only valid while the buffer's
+  // sequence number is still constant_sequence. Mutable, since writing to a
+  // chroma plane through the const GetWritePtr has to clear it.
+  mutable int constant_period;
+  int constant_sequence;
+  BYTE constant_pattern[3][4];
+
   friend class PVideoFrame;
   void AddRef();
   void Release();
@@ -574,6 +582,13 @@ public:
 #ifdef BUILDING_AVSCORE
 public:
   void DESTRUCTOR();  /* Damn compiler won't allow taking the address of reserved constructs, make a dummy interlude */
+
+  // Marks every row of every plane as the same pattern of period bytes (1, 3 or 4),
+  // starting at the row's first byte. Writing to the frame drops the mark.
+  void SetConstant(int period, const BYTE* patternY, const BYTE* patternU=0, const BYTE* patternV=0);
+  // 0 if the frame is not known to be constant.
+  int GetConstantPeriod() const;
+  const BYTE* GetConstantPattern(int plane=0) const;
 #endif
 }; // end class VideoFrame
 
@@ -1018,6 +1033,19 @@ public:
   virtual void* __stdcall Allocate(size_t nBytes, size_t alignment, AvsAllocType type) = 0;
   virtual void __stdcall Free(void* ptr) = 0;
 
+  // Returns the environment to the state of a new one so that it can run another script:
+  // drops all variables (including those of worker threads), the filter graph they hold,
+  // the script-defined functions and the MT modes set by the script.
+  // Loaded plugins stay loaded, with the MT modes they set themselves: a plugin's init
+  // function may have registered AtExit handlers and saved strings that must not outlive
+  // the DLL, so it cannot be unloaded before shutdown. LoadPlugin of such a plugin in a
+  // later script is a no-op. Worker threads and pooled frame buffers are kept too.
+  // The SetMemoryMax limit, the working directory and the autoload directory list go
+  // back to those of a new environment; a host that added autoload directories adds
+  // them again.
+  // The host must release every clip and value obtained from the previous script first.
+  virtual void __stdcall ResetEnvironment() = 0;
+
   // Strictly for Avisynth core only.
   // Neither host applications nor plugins should use
   // these interfaces.
@@ -1027,6 +1055,22 @@ public:
   virtual MtMode __stdcall GetFilterMTMode(const AVSFunction* filter, bool* is_forced) const = 0; // If filter is "", gets the default MT mode
   virtual void __stdcall SetPrefetcher(Prefetcher *p) = 0;
 
+  // Wraps memory the caller owns in a frame with the given layout. The frame is
+  // never writable, so MakeWritable copies it. release(user_data) is called once
+  // no frame refers to the memory any more, at the latest on shutdown.
+  virtual PVideoFrame __stdcall NewExternalVideoFrame(BYTE* data, int data_size, int pitch, int row_size, int height,
+                                                      int offsetU, int offsetV, int pitchUV, int row_sizeUV, int heightUV,
+                                                      ShutdownFunc release, void* user_data) = 0;
+
+  // Returns a frame with the same layout and visible content as frame, shared with
+  // every earlier caller that interned an identical one. The result must not be written.
+  virtual PVideoFrame __stdcall InternFrame(const PVideoFrame& frame) = 0;
+
+  // MakeWritable for filters that overwrite whole planes. A shared frame is copied with only
+  // the planes in keep_planes (PLANAR_Y, PLANAR_U, PLANAR_V or'ed together), the others hold
+  // garbage. Interleaved formats have just the one plane, PLANAR_Y.
+  virtual bool __stdcall MakePlanesWritable(PVideoFrame* pvf, int keep_planes) = 0;
+
   // These lines are needed so that we can overload the older functions from IScriptEnvironment.
   using IScriptEnvironment::Invoke;
   using IScriptEnvironment::AddFunction;
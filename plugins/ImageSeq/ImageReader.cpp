@@ -37,6 +37,8 @@
 #include <avisynth.h>
 #include "ImageSeq.h"
 #include <algorithm>
+#include <vector>
+#include <cctype>
 
 #define TEXT_COLOR 0xf0f080
 
@@ -56,9 +58,11 @@ ImageReader::ImageReader(const char * _base_name, const int _start, const int _e
   if (len > sizeof(base_name))
     env->ThrowError("Path to %s too long.", _base_name);
   (void)GetFullPathName(_base_name, len, base_name, NULL);
+  char filename[MAX_PATH + 1];
   _snprintf(filename, (sizeof filename)-1, base_name, start);
 
   memset(&vi, 0, sizeof(vi));
+  memset(&raster, 0, sizeof(raster));
 
   // Invariants
   vi.num_frames = -start + _end + 1;  // make sure each frame can be requested
@@ -140,7 +144,34 @@ ImageReader::ImageReader(const char * _base_name, const int _start, const int _e
       }
     }
     else {
-      use_DevIL = true; // Not a BMP, give it to DevIL
+      // Not a BMP, try the internal PNM/TGA parser before giving it to DevIL
+      RasterHeader::Format format = RasterHeader::NONE;
+      const char * ext = strrchr(base_name, '.');
+      if (fileHeader.bfType == ('5' << 8) + 'P' || fileHeader.bfType == ('6' << 8) + 'P')
+        format = RasterHeader::PNM;
+      else if (ext && !lstrcmpi(ext+1, "tga"))
+        format = RasterHeader::TGA;
+
+      if (format != RasterHeader::NONE) {
+        ifstream file(filename, ios::binary);
+        if (file.is_open() && parseRasterHeader(file, format, raster)) {
+          if (!lstrcmpi(_pixel, "rgb") || !lstrcmpi(_pixel, "rgb32"))
+            vi.pixel_type = VideoInfo::CS_BGR32;
+          else if (!lstrcmpi(_pixel, "rgb24"))
+            vi.pixel_type = VideoInfo::CS_BGR24;
+          else if (!lstrcmpi(_pixel, "y8") && raster.channels == 1)
+            vi.pixel_type = VideoInfo::CS_Y8;
+          else
+            raster.format = RasterHeader::NONE; // colour to Y8 conversion is left to DevIL
+
+          vi.width = raster.width;
+          vi.height = raster.height;
+        }
+        file.close();
+      }
+
+      if (raster.format == RasterHeader::NONE)
+        use_DevIL = true; // Not a type we know, give it to DevIL
     }
   }
 
@@ -273,6 +304,8 @@ PVideoFrame ImageReader::GetFrame(int n, IScriptEnvironment* env)
   const int height = frame->GetHeight();
   const int width = vi.width;
 
+  // Several threads may be in here at once, so don't share the name buffer
+  char filename[MAX_PATH + 1];
   _snprintf(filename, (sizeof filename)-1, base_name, n+start);
 
   if (use_DevIL)  /* read using DevIL */
@@ -412,6 +445,10 @@ PVideoFrame ImageReader::GetFrame(int n, IScriptEnvironment* env)
       return frame;
     }
   }
+  else if (raster.format != RasterHeader::NONE) {  /* PNM or TGA, no DevIL lock needed */
+    if (!readRaster(filename, frame, env))
+      return frame;
+  }
   else {  /* treat as ebmp  */
     // Open file, ensure it has the expected properties
     ifstream file(filename, ios::binary);
@@ -565,3 +602,200 @@ bool ImageReader::checkProperties(ifstream & file, PVideoFrame & frame, IScriptE
 
   return true;
 }
+
+
+bool ImageReader::readRaster(const char * filename, PVideoFrame & frame, IScriptEnvironment * env)
+{
+  ifstream file(filename, ios::binary);
+  if (!file.is_open())
+  {
+    if (info)
+      BlankApplyMessage(frame, "ImageReader: cannot open file", env);
+    else
+      BlankFrame(frame);
+
+    return false;
+  }
+
+  RasterHeader hdr;
+  if (!parseRasterHeader(file, raster.format, hdr))
+  {
+    BlankApplyMessage(frame, "ImageReader: invalid PNM/TGA file", env);
+    return false;
+  }
+
+  if (hdr.width != raster.width)
+  {
+    BlankApplyMessage(frame, "ImageReader: image widths must be identical", env);
+    return false;
+  }
+
+  if (hdr.height != raster.height)
+  {
+    BlankApplyMessage(frame, "ImageReader: image heights must be identical", env);
+    return false;
+  }
+
+  if (hdr.channels != raster.channels)
+  {
+    BlankApplyMessage(frame, "ImageReader: images must have identical bits per pixel", env);
+    return false;
+  }
+
+  file.seekg(hdr.offset, ios::beg);
+
+  // RGB frames are stored bottom-up, Y8 top-down
+  BYTE * dstPtr = frame->GetWritePtr();
+  int pitch = frame->GetPitch();
+  if (hdr.top_down != vi.IsY8()) {
+    dstPtr += pitch * (vi.height-1);
+    pitch = -pitch;
+  }
+
+  const int dst_channels = vi.BytesFromPixels(1);
+  const int src_row_size = vi.width * hdr.channels;
+
+  if (hdr.channels == dst_channels && !hdr.rgb_order)
+  {
+    // Same layout as the frame, read straight into it
+    for (int y=0; y<vi.height; ++y)
+    {
+      file.read( reinterpret_cast<char *> (dstPtr), src_row_size);
+      dstPtr += pitch;
+    }
+  }
+  else
+  {
+    vector<BYTE> row(src_row_size);
+    for (int y=0; y<vi.height; ++y)
+    {
+      file.read( reinterpret_cast<char *> (&row[0]), src_row_size);
+      convertRow(&row[0], dstPtr, vi.width, hdr, dst_channels);
+      dstPtr += pitch;
+    }
+  }
+
+  if (!file)
+  {
+    BlankApplyMessage(frame, "ImageReader: unexpected end of file", env);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool ImageReader::parseRasterHeader(istream & file, RasterHeader::Format format, RasterHeader & hdr)
+{
+  file.seekg(0, ios::beg);
+
+  if (format == RasterHeader::PNM)
+  {
+    // Binary PPM (P6) or PGM (P5), 8 bits per sample only
+    char magic[2];
+    file.read(magic, 2);
+    if (!file || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6'))
+      return false;
+
+    int fields[3]; // width, height, maxval
+    for (int i=0; i<3; ++i)
+    {
+      int c = file.get();
+      for (;;)  // skip whitespace and comments
+      {
+        if (c == '#') {
+          while (c != '\n' && c != EOF)
+            c = file.get();
+        }
+        else if (isspace(c))
+          c = file.get();
+        else
+          break;
+      }
+      if (!isdigit(c))
+        return false;
+
+      int value = 0;
+      while (isdigit(c) && value < 65536)
+      {
+        value = value*10 + (c - '0');
+        c = file.get();
+      }
+      if (!isspace(c)) // a single whitespace byte precedes the raster
+        return false;
+      fields[i] = value;
+    }
+
+    if (fields[2] != 255)
+      return false;
+
+    hdr.width = fields[0];
+    hdr.height = fields[1];
+    hdr.channels = magic[1] == '6' ? 3 : 1;
+    hdr.rgb_order = hdr.channels == 3;
+    hdr.top_down = true;
+    hdr.offset = file.tellg();
+  }
+  else if (format == RasterHeader::TGA)
+  {
+    // Uncompressed true colour (type 2) or greyscale (type 3) Targa
+    BYTE tga[18];
+    file.read( reinterpret_cast<char *> (tga), sizeof(tga) );
+    if (!file)
+      return false;
+
+    const int id_length = tga[0];
+    const int colormap_type = tga[1];
+    const int image_type = tga[2];
+    const int bpp = tga[16];
+    const int descriptor = tga[17];
+
+    if (colormap_type != 0 || (descriptor & 0x10)) // palette or right-to-left
+      return false;
+
+    if (image_type == 2 && (bpp == 24 || bpp == 32))
+      hdr.channels = bpp / 8;
+    else if (image_type == 3 && bpp == 8)
+      hdr.channels = 1;
+    else
+      return false;
+
+    hdr.width = tga[12] | (tga[13] << 8);
+    hdr.height = tga[14] | (tga[15] << 8);
+    hdr.rgb_order = false;
+    hdr.top_down = (descriptor & 0x20) != 0;
+    hdr.offset = sizeof(tga) + id_length;
+  }
+  else
+    return false;
+
+  if (hdr.width <= 0 || hdr.height <= 0)
+    return false;
+
+  hdr.format = format;
+  return true;
+}
+
+
+void ImageReader::convertRow(const BYTE * srcPtr, BYTE * dstPtr, const int width, const RasterHeader & hdr, const int dst_channels)
+{
+  const int r = hdr.rgb_order ? 0 : 2;
+  const int b = 2 - r;
+
+  for (int x=0; x<width; ++x)
+  {
+    if (hdr.channels == 1) {
+      dstPtr[0] = dstPtr[1] = dstPtr[2] = srcPtr[0];
+    }
+    else {
+      dstPtr[0] = srcPtr[b];
+      dstPtr[1] = srcPtr[1];
+      dstPtr[2] = srcPtr[r];
+    }
+    if (dst_channels == 4)
+      dstPtr[3] = hdr.channels == 4 ? srcPtr[3] : 255;
+
+    srcPtr += hdr.channels;
+    dstPtr += dst_channels;
+  }
+}
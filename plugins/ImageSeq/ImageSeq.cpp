@@ -49,7 +49,8 @@ AVSValue __cdecl Create_ImageWriter(AVSValue args, void* user_data, IScriptEnvir
                          args[2].AsInt(0),
                          args[3].AsInt(0),
                          env->SaveString(args[4].AsString("ebmp")),
-                         args[5].AsBool(false), env);
+                         args[5].AsBool(false),
+                         args[6].AsInt(0), env);
 }
 
 AVSValue __cdecl Create_ImageReader(AVSValue args, void*, IScriptEnvironment* env)
@@ -84,8 +85,8 @@ extern "C" __declspec(dllexport) const char* __stdcall AvisynthPluginInit3(IScri
 {
 	AVS_linkage = vectors;
   
-  // clip, base filename, start, end, image format/extension, info
-  env->AddFunction("ImageWriter", "c[file]s[start]i[end]i[type]s[info]b", Create_ImageWriter, 0);
+  // clip, base filename, start, end, image format/extension, info, write-behind queue length
+  env->AddFunction("ImageWriter", "c[file]s[start]i[end]i[type]s[info]b[queue]i", Create_ImageWriter, 0);
 
   // base filename (sprintf-style), start, end, frames per second, default reader to use, info, pixel_type
   env->AddFunction("ImageReader", "[file]s[start]i[end]i[fps]f[use_devil]b[info]b[pixel_type]s", Create_ImageReader, 0);
@@ -93,6 +94,14 @@ extern "C" __declspec(dllexport) const char* __stdcall AvisynthPluginInit3(IScri
 
   env->AddFunction("ImageSourceAnim", "[file]s[fps]f[info]b[pixel_type]s", Create_Animated, 0);
 
+  // DevIL reads are serialized by FramesCriticalSection, everything else is reentrant
+  if (env->FunctionExists("SetFilterMTMode"))
+  {
+      IScriptEnvironment2 *env2 = static_cast<IScriptEnvironment2*>(env);
+      env2->SetFilterMTMode("ImageReader", MtMode::MT_NICE_FILTER, false);
+      env2->SetFilterMTMode("ImageSource", MtMode::MT_NICE_FILTER, false);
+  }
+
   return "`ImageSeq' Methods for loading and writing still images.";
 }
 
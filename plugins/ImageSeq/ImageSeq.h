@@ -38,6 +38,12 @@
 #include <sstream>
 #include <fstream>
 #include <cassert>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "il.h"
 #include <avs/win.h>
@@ -49,12 +55,21 @@ class ImageWriter : public GenericVideoFilter
  **/
 {  
 public:
-  ImageWriter(PClip _child, const char * _base_name, const int _start, const int _end, const char * _ext, bool _info, IScriptEnvironment* env);
+  ImageWriter(PClip _child, const char * _base_name, const int _start, const int _end, const char * _ext, bool _info,
+              int _queue, IScriptEnvironment* env);
   ~ImageWriter();
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
 
 private:
+  bool writeFrame(const PVideoFrame & frame, const char * filename, std::string & error);
   void fileWrite(std::ostream & file, const BYTE * srcPtr, const int pitch, const int row_size, const int height);
+  void writeBehindThread();
+
+  struct WriteJob
+  {
+    PVideoFrame frame; // keeps the buffer alive until it is on disk
+    std::string filename;
+  };
 
   bool info;
   
@@ -65,6 +80,29 @@ private:
 
   BITMAPFILEHEADER fileHeader;
   BITMAPINFOHEADER infoHeader;
+
+  // Write-behind queue, frames are written by the worker threads
+  size_t queue_size;  // 0 = write synchronously in GetFrame
+  std::deque<WriteJob> jobs;
+  std::vector<std::thread> workers;
+  std::mutex queue_mutex;
+  std::condition_variable job_ready;
+  std::condition_variable job_done;
+  bool exiting;
+  std::string write_error; // first failure since the last GetFrame
+};
+
+
+// Header of an uncompressed raster decoded by ImageReader itself rather than DevIL
+struct RasterHeader
+{
+  enum Format { NONE, PNM, TGA } format;
+  int width;
+  int height;
+  int channels;   // 1 = grey, 3 = RGB/BGR, 4 = BGRA
+  bool rgb_order; // PNM stores red first, TGA stores blue first
+  bool top_down;
+  std::streamoff offset;
 };
 
 
@@ -93,6 +131,10 @@ private:
   void BlankFrame(PVideoFrame & frame);
   void BlankApplyMessage(PVideoFrame & frame, const char * text, IScriptEnvironment * env);
   bool checkProperties(std::ifstream & file, PVideoFrame & frame, IScriptEnvironment * env);
+  bool readRaster(const char * filename, PVideoFrame & frame, IScriptEnvironment * env);
+
+  static bool parseRasterHeader(std::istream & file, RasterHeader::Format format, RasterHeader & hdr);
+  static void convertRow(const BYTE * srcPtr, BYTE * dstPtr, const int width, const RasterHeader & hdr, const int dst_channels);
 
   char base_name[MAX_PATH + 1];
   const int start;
@@ -102,8 +144,8 @@ private:
 
   VideoInfo vi;
 
-  char filename[MAX_PATH + 1];
   bool should_flip;
+  RasterHeader raster;
       
   BITMAPFILEHEADER fileHeader;
   BITMAPINFOHEADER infoHeader;
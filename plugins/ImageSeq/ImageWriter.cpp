@@ -44,8 +44,8 @@ using namespace std;
 
 
 ImageWriter::ImageWriter(PClip _child, const char * _base_name, const int _start, const int _end,
-                         const char * _ext, bool _info, IScriptEnvironment* env)
- : GenericVideoFilter(_child), ext(_ext), info(_info)
+                         const char * _ext, bool _info, int _queue, IScriptEnvironment* env)
+ : GenericVideoFilter(_child), ext(_ext), info(_info), queue_size(max(_queue, 0)), exiting(false)
 {
   // Make sure we have an absolute path.
   DWORD len = GetFullPathName(_base_name, 0, base_name, NULL);
@@ -110,11 +110,30 @@ ImageWriter::ImageWriter(PClip _child, const char * _base_name, const int _start
     end = _end;
 
   end = max(end, start);
+
+  if (queue_size > 0) {
+    // DevIL serializes everything on FramesCriticalSection, so one writer is all it can use
+    size_t threads = 1;
+    if (!lstrcmpi(ext, "ebmp"))
+      threads = min(queue_size, (size_t)max(thread::hardware_concurrency(), 1u));
+
+    for (size_t i=0; i<threads; ++i)
+      workers.push_back(thread(&ImageWriter::writeBehindThread, this));
+  }
 }
 
 
 ImageWriter::~ImageWriter()
 {
+  // Flush: the workers drain the queue before they exit
+  {
+    lock_guard<mutex> lock(queue_mutex);
+    exiting = true;
+  }
+  job_ready.notify_all();
+  for (size_t i=0; i<workers.size(); ++i)
+    workers[i].join();
+
   if (!!lstrcmpi(ext, "ebmp")) {
     EnterCriticalSection(&FramesCriticalSection);
     ilShutDown();
@@ -148,6 +167,45 @@ PVideoFrame ImageWriter::GetFrame(int n, IScriptEnvironment* env)
   _snprintf(filename, MAX_PATH, base_name, n, ext, 0, 0);
   filename[MAX_PATH] = '\0';
 
+  string error;
+  if (queue_size == 0) {
+    writeFrame(frame, filename, error);
+  }
+  else {
+    WriteJob job;
+    job.frame = frame;
+    job.filename = filename;
+    {
+      unique_lock<mutex> lock(queue_mutex);
+      // Back-pressure: don't run ahead of the writers by more than queue_size frames
+      job_done.wait(lock, [this] { return jobs.size() < queue_size; });
+      jobs.push_back(job);
+      error.swap(write_error); // report failures of earlier frames on this one
+    }
+    job_ready.notify_one();
+  }
+
+  if (!error.empty())
+  {
+    env->MakeWritable(&frame);
+    env->ApplyMessage(&frame, vi, error.c_str(), vi.width/4, TEXT_COLOR, 0, 0);
+    return frame;
+  }
+
+  if (info) {
+    // overlay on video output: progress indicator
+    ostringstream text;
+    text << "Frame " << n << (queue_size ? " queued for: " : " written to: ") << filename;
+    env->MakeWritable(&frame);
+    env->ApplyMessage(&frame, vi, text.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
+  }
+
+  return frame;
+}
+
+
+bool ImageWriter::writeFrame(const PVideoFrame & frame, const char * filename, string & error)
+{
   if (!lstrcmpi(ext, "ebmp"))  /* Use internal 'ebmp' writer */
   {
     // initialize file object
@@ -156,9 +214,8 @@ PVideoFrame ImageWriter::GetFrame(int n, IScriptEnvironment* env)
     {
       ostringstream ss;
       ss << "ImageWriter: could not create file '" << filename << "'";
-      env->MakeWritable(&frame);
-      env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-      return frame;
+      error = ss.str();
+      return false;
     }
 
     // write headers
@@ -240,21 +297,37 @@ PVideoFrame ImageWriter::GetFrame(int n, IScriptEnvironment* env)
       ss << "ImageWriter: error '" << getErrStr(err) << "' in DevIL library\n"
 	        "writing file \"" << filename << "\"\n"
             "DevIL version " << DevIL_Version << ".";
-      env->MakeWritable(&frame);
-      env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-      return frame;
+      error = ss.str();
+      return false;
     }
   }
 
-  if (info) {
-    // overlay on video output: progress indicator
-    ostringstream text;
-    text << "Frame " << n << " written to: " << filename;
-    env->MakeWritable(&frame);
-    env->ApplyMessage(&frame, vi, text.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-  }
+  return true;
+}
 
-  return frame;
+
+void ImageWriter::writeBehindThread()
+{
+  unique_lock<mutex> lock(queue_mutex);
+  for (;;)
+  {
+    job_ready.wait(lock, [this] { return exiting || !jobs.empty(); });
+    if (jobs.empty())
+      return; // exiting and fully flushed
+
+    WriteJob job = jobs.front();
+    jobs.pop_front();
+    job_done.notify_one();
+
+    lock.unlock();
+    string error;
+    writeFrame(job.frame, job.filename.c_str(), error);
+    job.frame = 0; // release the buffer before taking the lock again
+    lock.lock();
+
+    if (!error.empty() && write_error.empty())
+      write_error = error;
+  }
 }
 
 
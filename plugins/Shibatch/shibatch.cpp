@@ -29,7 +29,7 @@ const AVS_Linkage * AVS_linkage = 0;
 extern "C" __declspec(dllexport) const char* __stdcall AvisynthPluginInit3(IScriptEnvironment* env, const AVS_Linkage* const vectors) {
   AVS_linkage = vectors;
 
-  env->AddFunction("SSRC", "ci[fast]b", Create_SSRC, 0);
+  env->AddFunction("SSRC", "ci[fast]b[seekable]b", Create_SSRC, 0);
 
   env->AddFunction("SuperEQ", "cs", Create_SuperEq, 0);
   env->AddFunction("SuperEQ", "cf+", Create_SuperEqCustom, 0);
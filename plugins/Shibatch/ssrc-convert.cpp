@@ -34,6 +34,21 @@
 
 #include "ssrc-convert.h"
 #include <avs/win.h>
+#include <avs/minmax.h>
+
+// Output length of one independently rendered block in seekable mode
+#define SEEKABLE_BLOCK_SECONDS 2
+
+
+static int gcd(int x, int y)
+{
+  while (y != 0) {
+    int t = x % y;
+    x = y;
+    y = t;
+  }
+  return x;
+}
 
 
 /******************************************
@@ -41,10 +56,11 @@
  *****************************************/
 
 
-SSRC::SSRC(PClip _child, int _target_rate, bool _fast, IScriptEnvironment* env)
-  : GenericVideoFilter(_child), target_rate(_target_rate), fast(_fast)
+SSRC::SSRC(PClip _child, int _target_rate, bool _fast, bool _seekable, IScriptEnvironment* env)
+  : GenericVideoFilter(_child), target_rate(_target_rate), fast(_fast), seekable(_seekable)
 {
   srcbuffer = 0;  // If constructor should return
+  res = 0;
 
   if ((target_rate==vi.audio_samples_per_second)||(vi.audio_samples_per_second==0)) {
 		skip_conversion=true;
@@ -64,6 +80,19 @@ SSRC::SSRC(PClip _child, int _target_rate, bool _fast, IScriptEnvironment* env)
 
   input_samples = source_rate;  // We convert one second of input per loop.
   vi.audio_samples_per_second = target_rate;
+
+  if (seekable) {
+    // Blocks are whole periods of the rate ratio, so the resampler is in
+    // the same phase at the start of each of them.
+    delete res;
+    res = 0;
+    const int g = gcd(source_rate, target_rate);
+    const int periods = max(1, (int)(((__int64)target_rate * SEEKABLE_BLOCK_SECONDS) / (target_rate / g)));
+    block_size = periods * (target_rate / g);
+    block_input = periods * (source_rate / g);
+    return;
+  }
+
   srcbuffer = new SFLOAT[vi.AudioChannels() * input_samples];
 
   for(int i=0; i<vi.AudioChannels() * input_samples; i++)  // We stuff one second into the input (preroll)
@@ -91,6 +120,11 @@ void __stdcall SSRC::GetAudio(void* buf, __int64 start, __int64 count, IScriptEn
 		return;
 	}
 
+  if (seekable) {
+    GetAudioSeekable((SFLOAT*)buf, start, count, env);
+    return;
+  }
+
   count *= vi.AudioChannels();   // This is how SSRC keeps count. We'll do the same
 
   if (start != next_sample) {  // Reset on seek
@@ -164,6 +198,179 @@ void __stdcall SSRC::GetAudio(void* buf, __int64 start, __int64 count, IScriptEn
 
 }
 
+
+/***************************************
+ * Seekable mode:
+ * - Each block is rendered by its own resampler, fed from one second
+ * before the block. That is far longer than the filters' impulse
+ * response, and also covers the click at the start (see above), so
+ * the preroll output is simply dropped.
+ * - Blocks don't depend on each other or on the order they are asked
+ * for, so missing blocks, plus a few ahead when playing on, are rendered
+ * in parallel on the thread pool. Reads from the child are serialized.
+ ****************************************/
+
+struct SSRC::RenderJob {
+  SSRC* self;
+  std::vector<__int64> blocks;
+  std::vector<std::vector<SFLOAT> > results;
+  std::atomic<size_t> next;
+  std::atomic<bool> stop;
+};
+
+
+void SSRC::ReadInput(SFLOAT* buf, __int64 start, int count, IScriptEnvironment* env)
+{
+  const int ch = vi.AudioChannels();
+
+  if (start < 0) {  // Silence before the clip, like the preroll of the streaming mode
+    const int zeros = (int)min<__int64>(-start, count);
+    memset(buf, 0, zeros * ch * sizeof(SFLOAT));
+    buf += zeros * ch;
+    start += zeros;
+    count -= zeros;
+  }
+
+  if (count > 0) {
+    std::lock_guard<std::mutex> lock(read_mutex);
+    child->GetAudio(buf, start, count, env);
+  }
+}
+
+
+void SSRC::RenderBlock(__int64 block, SFLOAT* out, IScriptEnvironment* env)
+{
+  const int ch = vi.AudioChannels();
+  const int skip = target_rate * ch;                // One second of preroll output
+  const int wanted = skip + block_size * ch;
+
+  std::vector<SFLOAT> input(input_samples * ch);
+  __int64 offset = block * block_input - input_samples;
+
+  Resampler_base* r = SSRC_create(source_rate, target_rate, ch, 2, 1, fast);
+  try {
+    int available;
+    r->GetBuffer(&available);
+    while (available < wanted) {
+      ReadInput(&input[0], offset, input_samples, env);
+      offset += input_samples;
+      r->Write(&input[0], input_samples * ch);
+      r->GetBuffer(&available);
+    }
+    memcpy(out, r->GetBuffer(&available) + skip, block_size * ch * sizeof(SFLOAT));
+  }
+  catch (...) {
+    delete r;
+    throw;
+  }
+  delete r;
+}
+
+
+void SSRC::RenderBlocks(RenderJob* job, IScriptEnvironment* env)
+{
+  for (;;) {
+    const size_t i = job->next++;
+    if (i >= job->blocks.size() || job->stop)
+      break;
+    job->self->RenderBlock(job->blocks[i], &job->results[i][0], env);
+  }
+}
+
+
+AVSValue SSRC::RenderBlocksJob(IScriptEnvironment2* env, void* data)
+{
+  RenderJob* job = static_cast<RenderJob*>(data);
+  try {
+    RenderBlocks(job, env);
+  }
+  catch (...) {
+    job->stop = true;
+    throw;
+  }
+  return AVSValue();
+}
+
+
+void SSRC::GetAudioSeekable(SFLOAT* buf, __int64 start, __int64 count, IScriptEnvironment* env)
+{
+  IScriptEnvironment2 *env2 = static_cast<IScriptEnvironment2*>(env);
+  const int ch = vi.AudioChannels();
+  if (count <= 0)
+    return;
+
+  const __int64 first = start / block_size - (start % block_size < 0 ? 1 : 0);
+  const __int64 last = (start + count - 1) / block_size - ((start + count - 1) % block_size < 0 ? 1 : 0);
+  const __int64 end_block = (vi.num_audio_samples + block_size - 1) / block_size;
+
+  // Pool threads help only when called from the main thread, a pool
+  // or prefetch thread waiting for the pool could starve it.
+  size_t helpers = 0;
+  if (env->FunctionExists("SetFilterMTMode") && env2->GetProperty(AEP_THREAD_ID) == 0)
+    helpers = env2->GetProperty(AEP_THREADPOOL_THREADS);
+
+  RenderJob job;
+  job.self = this;
+  job.next = 0;
+  job.stop = false;
+  for (__int64 b = first; b <= last || (b < last + 1 + (__int64)helpers && b < end_block); ++b) {
+    if (blocks.find(b) == blocks.end())
+      job.blocks.push_back(b);
+  }
+
+  if (!job.blocks.empty()) {
+    job.results.resize(job.blocks.size());
+    for (size_t i = 0; i < job.blocks.size(); ++i)
+      job.results[i].resize(block_size * ch);
+
+    helpers = min(helpers, job.blocks.size() - 1);
+    IJobCompletion* completion = NULL;
+    if (helpers > 0) {
+      completion = env2->NewCompletion(helpers);
+      for (size_t i = 0; i < helpers; ++i)
+        env2->ParallelJob(RenderBlocksJob, &job, completion);
+    }
+
+    try {
+      RenderBlocks(&job, env);
+      if (completion != NULL) {
+        completion->Wait();
+        for (size_t i = 0; i < completion->Size(); ++i)
+          completion->Get(i);   // Rethrows the errors of the helpers
+        completion->Destroy();
+      }
+    }
+    catch (...) {
+      job.stop = true;
+      if (completion != NULL) {
+        completion->Wait();
+        completion->Destroy();
+      }
+      throw;
+    }
+
+    for (size_t i = 0; i < job.blocks.size(); ++i)
+      blocks[job.blocks[i]].swap(job.results[i]);
+
+    // Keep what was just asked for and what lies ahead, drop the rest
+    const size_t keep = (size_t)(last - first + 1) + helpers + 2;
+    while (blocks.size() > keep) {
+      std::map<__int64, std::vector<SFLOAT> >::iterator oldest = blocks.begin();
+      if (oldest->first >= first)
+        oldest = --blocks.end();
+      blocks.erase(oldest);
+    }
+  }
+
+  for (__int64 b = first; b <= last; ++b) {
+    const __int64 block_start = b * block_size;
+    const __int64 from = max(start, block_start);
+    const __int64 to = min(start + count, block_start + block_size);
+    memcpy(buf + (from - start) * ch, &blocks[b][(size_t)(from - block_start) * ch], (size_t)(to - from) * ch * sizeof(SFLOAT));
+  }
+}
+
+
 AVSValue __cdecl Create_SSRC(AVSValue args, void*, IScriptEnvironment* env) {
 
   PClip clip = args[0].AsClip();
@@ -174,5 +381,5 @@ AVSValue __cdecl Create_SSRC(AVSValue args, void*, IScriptEnvironment* env) {
   if (!(clip->GetVideoInfo().SampleType()&SAMPLE_FLOAT))
     env->ThrowError("Input audio sample format to SSRC must be float.");
 
-  return new SSRC(args[0].AsClip(), args[1].AsInt(), args[2].AsBool(true), env);
+  return new SSRC(args[0].AsClip(), args[1].AsInt(), args[2].AsBool(true), args[3].AsBool(false), env);
 }
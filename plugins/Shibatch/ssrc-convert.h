@@ -38,6 +38,10 @@
 typedef float REAL;
 
 #include <avisynth.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
 #include "ssrc.h"
 
 
@@ -50,7 +54,7 @@ class SSRC : public GenericVideoFilter
  **/
 {
 public:
-  SSRC(PClip _child, int _target_rate, bool _fast, IScriptEnvironment* env);
+  SSRC(PClip _child, int _target_rate, bool _fast, bool _seekable, IScriptEnvironment* env);
   ~SSRC() {
      delete res;
      delete[] srcbuffer;
@@ -59,6 +63,14 @@ public:
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
 
 private:
+  void GetAudioSeekable(SFLOAT* buf, __int64 start, __int64 count, IScriptEnvironment* env);
+  void RenderBlock(__int64 block, SFLOAT* out, IScriptEnvironment* env);
+  void ReadInput(SFLOAT* buf, __int64 start, int count, IScriptEnvironment* env);
+
+  struct RenderJob;
+  static void RenderBlocks(RenderJob* job, IScriptEnvironment* env);
+  static AVSValue RenderBlocksJob(IScriptEnvironment2* env, void* data);
+
   const int target_rate;
   int source_rate;
   int srcbuffer_size;
@@ -73,6 +85,15 @@ private:
 
 	Resampler_base * res;
 
+  // Seekable mode: the output is cut into fixed blocks that each start on a
+  // whole period of the rate ratio, so every block can be rendered on its
+  // own by a fresh resampler and always comes out the same.
+  bool seekable;
+  int block_size;     // Output samples per block
+  int block_input;    // Input samples per block
+  std::map<__int64, std::vector<SFLOAT> > blocks;  // Rendered blocks
+  std::mutex read_mutex;
+
 };
 
 
@@ -261,6 +261,15 @@ void FIFOSampleBuffer::clear()
 }
 
 
+// Replaces the buffer contents with a copy of another buffer's samples
+void FIFOSampleBuffer::copyFrom(const FIFOSampleBuffer &other)
+{
+    assert(channels == other.channels);
+    clear();
+    putSamples(other.buffer + other.bufferPos * channels, other.samplesInBuffer);
+}
+
+
 /// allow trimming (downwards) amount of samples in pipeline.
 /// Returns adjusted amount of samples
 uint FIFOSampleBuffer::adjustAmountOfSamples(uint numSamples)
@@ -168,6 +168,10 @@ public:
     /// Clears all the samples.
     virtual void clear();
 
+    /// Replaces the contents of this buffer with a copy of the samples in 'other'.
+    /// Both buffers must have the same number of channels.
+    void copyFrom(const FIFOSampleBuffer &other);
+
     /// allow trimming (downwards) amount of samples in pipeline.
     /// Returns adjusted amount of samples
     uint adjustAmountOfSamples(uint numSamples);
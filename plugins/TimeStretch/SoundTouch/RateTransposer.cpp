@@ -74,6 +74,7 @@ public:
     /// rate, larger faster rates.
     virtual void setRate(float newRate);
 
+    virtual void copyState(const RateTransposer &other);
 };
 
 
@@ -97,6 +98,8 @@ protected:
 public:
     RateTransposerFloat();
     virtual ~RateTransposerFloat();
+
+    virtual void copyState(const RateTransposer &other);
 };
 
 
@@ -347,6 +350,15 @@ void RateTransposer::clear()
 }
 
 
+// Copies the buffered samples from another instance with identical settings
+void RateTransposer::copyState(const RateTransposer &other)
+{
+    storeBuffer.copyFrom(other.storeBuffer);
+    tempBuffer.copyFrom(other.tempBuffer);
+    outputBuffer.copyFrom(other.outputBuffer);
+}
+
+
 // Returns nonzero if there aren't any samples available for outputting.
 int RateTransposer::isEmpty() const
 {
@@ -501,6 +513,17 @@ void RateTransposerInteger::setRate(float newRate)
 }
 
 
+void RateTransposerInteger::copyState(const RateTransposer &other)
+{
+    const RateTransposerInteger &src = static_cast<const RateTransposerInteger &>(other);
+
+    RateTransposer::copyState(other);
+    iSlopeCount = src.iSlopeCount;
+    sPrevSampleL = src.sPrevSampleL;
+    sPrevSampleR = src.sPrevSampleR;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // RateTransposerFloat - floating point arithmetic implementation
@@ -530,6 +553,17 @@ void RateTransposerFloat::resetRegisters()
 }
 
 
+void RateTransposerFloat::copyState(const RateTransposer &other)
+{
+    const RateTransposerFloat &src = static_cast<const RateTransposerFloat &>(other);
+
+    RateTransposer::copyState(other);
+    fSlopeCount = src.fSlopeCount;
+    sPrevSampleL = src.sPrevSampleL;
+    sPrevSampleR = src.sPrevSampleR;
+}
+
+
 
 // Transposes the sample rate of the given samples using linear interpolation. 
 // 'Mono' version of the routine. Returns the number of samples returned in 
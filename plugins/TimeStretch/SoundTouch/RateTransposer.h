@@ -150,6 +150,10 @@ public:
     /// Clears all the samples in the object
     void clear();
 
+    /// Copies the buffered samples and interpolation state from another
+    /// instance that has identical settings.
+    virtual void copyState(const RateTransposer &other);
+
     /// Returns nonzero if there aren't any samples available for outputting.
     int isEmpty() const;
 };
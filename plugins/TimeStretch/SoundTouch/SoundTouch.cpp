@@ -484,6 +484,15 @@ void SoundTouch::clear()
 }
 
 
+// Copies the processing state of another instance that was set up with
+// identical settings, so that both produce the same output from now on.
+void SoundTouch::copyState(const SoundTouch &other)
+{
+    pRateTransposer->copyState(*other.pRateTransposer);
+    pTDStretch->copyState(*other.pTDStretch);
+}
+
+
 
 /// Returns number of samples currently unprocessed.
 uint SoundTouch::numUnprocessedSamples() const
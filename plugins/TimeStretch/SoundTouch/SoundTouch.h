@@ -244,6 +244,10 @@ public:
     /// buffers.
     virtual void clear();
 
+    /// Copies the processing state of 'other', which must have been set up with
+    /// identical rate, tempo, pitch, channel and setting values.
+    void copyState(const SoundTouch &other);
+
     /// Changes a setting controlling the processing system behaviour. See the
     /// 'SETTING_...' defines for available setting ID's.
     /// 
@@ -231,6 +231,18 @@ void TDStretch::clear()
 }
 
 
+// Copies the processing state from another instance with identical settings
+void TDStretch::copyState(const TDStretch &other)
+{
+    assert(channels == other.channels && overlapLength == other.overlapLength);
+
+    memcpy(pMidBuffer, other.pMidBuffer, 2 * sizeof(SAMPLETYPE) * overlapLength);
+    skipFract = other.skipFract;
+    inputBuffer.copyFrom(other.inputBuffer);
+    outputBuffer.copyFrom(other.outputBuffer);
+}
+
+
 
 // Enables/disables the quick position seeking algorithm. Zero to disable, nonzero
 // to enable
@@ -188,6 +188,10 @@ public:
     /// Clears the input buffer
     void clearInput();
 
+    /// Copies the processing state (buffered samples, overlap buffer and skip
+    /// fraction) from another instance that has identical settings.
+    void copyState(const TDStretch &other);
+
     /// Sets the number of channels, 1 = mono, 2 = stereo
     void setChannels(int numChannels);
 
@@ -35,13 +35,80 @@
 // AviSynth -> SoundTouch interface (c) 2004, Klaus Post.
 
 #include <vector>
+#include <map>
+#include <deque>
+#include <atomic>
+#include <xmmintrin.h>
 #include <avisynth.h>
 #include <avs/minmax.h>
 #include "SoundTouch/SoundTouch.h"
 
 #define BUFFERSIZE 8192
+#define CHECKPOINT_SECONDS 10  // Output between two seek checkpoints
+#define MAX_CHECKPOINTS 64
 using namespace soundtouch;
 
+
+// Splits interleaved samples into one plane per channel. Groups of four
+// channels are transposed four samples at a time.
+static void Deinterleave(const SFLOAT* src, SFLOAT* const* planes, int nch, int samples, bool sse)
+{
+  int c = 0;
+  if (sse) {
+    const int samples4 = samples & ~3;
+    for (; c+4 <= nch; c+=4) {
+      for (int s=0; s<samples4; s+=4) {
+        const SFLOAT* p = src + s*nch + c;
+        __m128 r0 = _mm_loadu_ps(p);
+        __m128 r1 = _mm_loadu_ps(p + nch);
+        __m128 r2 = _mm_loadu_ps(p + 2*nch);
+        __m128 r3 = _mm_loadu_ps(p + 3*nch);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(planes[c+0] + s, r0);
+        _mm_storeu_ps(planes[c+1] + s, r1);
+        _mm_storeu_ps(planes[c+2] + s, r2);
+        _mm_storeu_ps(planes[c+3] + s, r3);
+      }
+      for (int s=samples4; s<samples; s++)
+        for (int i=0; i<4; i++)
+          planes[c+i][s] = src[s*nch + c+i];
+    }
+  }
+  for (; c<nch; c++)
+    for (int s=0, r=c; s<samples; s++, r+=nch)
+      planes[c][s] = src[r];
+}
+
+// The reverse of Deinterleave.
+static void Interleave(const SFLOAT* const* planes, SFLOAT* dst, int nch, int samples, bool sse)
+{
+  int c = 0;
+  if (sse) {
+    const int samples4 = samples & ~3;
+    for (; c+4 <= nch; c+=4) {
+      for (int s=0; s<samples4; s+=4) {
+        __m128 r0 = _mm_loadu_ps(planes[c+0] + s);
+        __m128 r1 = _mm_loadu_ps(planes[c+1] + s);
+        __m128 r2 = _mm_loadu_ps(planes[c+2] + s);
+        __m128 r3 = _mm_loadu_ps(planes[c+3] + s);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        SFLOAT* p = dst + s*nch + c;
+        _mm_storeu_ps(p, r0);
+        _mm_storeu_ps(p + nch, r1);
+        _mm_storeu_ps(p + 2*nch, r2);
+        _mm_storeu_ps(p + 3*nch, r3);
+      }
+      for (int s=samples4; s<samples; s++)
+        for (int i=0; i<4; i++)
+          dst[s*nch + c+i] = planes[c+i][s];
+    }
+  }
+  for (; c<nch; c++)
+    for (int s=0, r=c; s<samples; s++, r+=nch)
+      dst[r] = planes[c][s];
+}
+
+
 class AVSsoundtouch : public GenericVideoFilter 
 {
 private:
@@ -51,13 +118,40 @@ private:
   int dst_samples_filled;
 
   SFLOAT* dstbuffer;
-  SFLOAT* passbuffer;
+  SFLOAT* passbuffer;  // One input and one output plane per channel
+  std::vector<SFLOAT*> inplanes;
+  std::vector<SFLOAT*> outplanes;
+  std::vector<int> gotsamples;
   __int64 next_sample;
   __int64 inputReadOffset;
   double sample_multiplier;
   float tempo;
   float rate;
   float pitch;
+  AVSValue settings[5];
+  bool sse;
+
+  // Channels are independent, so they are run on the environment thread pool
+  struct ChannelJob {
+    AVSsoundtouch* self;
+    bool feed;
+    std::atomic<unsigned> next_channel;
+  };
+  bool use_pool;
+  IJobCompletion* completion;
+
+  // Sampler states saved during playback, keyed by output sample. A seek
+  // resumes from the nearest one before it and renders forward from there.
+  // They are only taken while the output is known to be sample exact, ie.
+  // rendered continuously from the start or from another checkpoint.
+  struct Checkpoint {
+    __int64 inputReadOffset;
+    std::vector<SoundTouch*> samplers;
+  };
+  std::map<__int64, Checkpoint*> checkpoints;
+  std::deque<__int64> checkpoint_order;
+  __int64 checkpoint_interval;
+  bool exact;
 
 public:
 static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
@@ -65,36 +159,43 @@ static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
 
 AVSsoundtouch(PClip _child, float _tempo, float _rate, float _pitch, const AVSValue* args, IScriptEnvironment* env)
 : GenericVideoFilter(_child), 
-  tempo(_tempo/100.0f), rate(_rate/100.0f), pitch(_pitch/100.0f)
+  tempo(_tempo/100.0f), rate(_rate/100.0f), pitch(_pitch/100.0f), completion(0)
 {
 	try {	// HIDE DAMN SEH COMPILER BUG!!!
   last_nch = vi.AudioChannels();
   
   dstbuffer = new SFLOAT[BUFFERSIZE * vi.AudioChannels()];
-  passbuffer = new SFLOAT[BUFFERSIZE];  // One channel at the time.
+  passbuffer = new SFLOAT[BUFFERSIZE * 2 * vi.AudioChannels()];
+
+  {for(unsigned n=0; n<last_nch; n++) {
+    inplanes.push_back(passbuffer + BUFFERSIZE * n);
+    outplanes.push_back(passbuffer + BUFFERSIZE * (last_nch + n));
+  }}
+  gotsamples.resize(last_nch);
 
   sample_multiplier  = tempo / pitch;  // Do it the same way the library does it!
   sample_multiplier *= pitch * rate;
 
-  {for(unsigned n=0; n<last_nch; n++) 
-    samplers.push_back(new SoundTouch());
+  {for(int i=0; i<5; i++)
+    settings[i] = args[i];
   }
 
-  {for(unsigned n=0; n<last_nch; n++) {
-    samplers[n]->setRate(rate);
-    samplers[n]->setTempo(tempo);
-    samplers[n]->setPitch(pitch);
-    samplers[n]->setChannels(1);
-    samplers[n]->setSampleRate(vi.audio_samples_per_second);
-    setSettings(samplers[n], args, env);
-  }}
+  {for(unsigned n=0; n<last_nch; n++) 
+    samplers.push_back(newSampler(env));
+  }
 
   vi.num_audio_samples = (__int64)((long double)(vi.num_audio_samples) / sample_multiplier);
 
+  sse = !!(env->GetCPUFlags() & CPUF_SSE);
+  use_pool = env->FunctionExists("SetFilterMTMode");
+
   next_sample = 0;  // Next output sample
   inputReadOffset = 0;  // Next input sample
   dst_samples_filled = 0;
 
+  checkpoint_interval = (__int64)vi.audio_samples_per_second * CHECKPOINT_SECONDS;
+  exact = true;
+
 	}
 	catch (...) { throw; }
 }
@@ -121,32 +222,113 @@ static void setSettings(SoundTouch* sampler, const AVSValue* args, IScriptEnviro
   
 }
 
+SoundTouch* newSampler(IScriptEnvironment* env)
+{
+  SoundTouch* sampler = new SoundTouch();
+  sampler->setRate(rate);
+  sampler->setTempo(tempo);
+  sampler->setPitch(pitch);
+  sampler->setChannels(1);
+  sampler->setSampleRate(vi.audio_samples_per_second);
+  setSettings(sampler, settings, env);
+  return sampler;
+}
+
 void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env)
 {
+  if (start != next_sample)
+    seek(start, env);
 
-  if (start != next_sample) {  // Reset on seek
-    for(unsigned n=0; n<last_nch; n++)  // Clear all resamplers
-      samplers[n]->clear();
+  render((BYTE*)buf, count, env);
+}
 
-    next_sample = start;
-    inputReadOffset = (__int64)(sample_multiplier * (long double)start);  // Reset at new read position (NOT sample exact :( ).
-    dst_samples_filled=0;
+// Positions the samplers so that the next rendered sample is 'start'.
+void seek(__int64 start, IScriptEnvironment* env)
+{
+  const __int64 max_catchup = checkpoint_interval * 2;
+
+  std::map<__int64, Checkpoint*>::iterator cp = checkpoints.upper_bound(start);
+  Checkpoint* best = 0;
+  __int64 best_pos = 0;
+  if (cp != checkpoints.begin()) {
+    --cp;
+    best_pos = cp->first;
+    best = cp->second;
   }
 
-  bool buffer_full = false;
-  int samples_filled = 0;
+  if (exact && next_sample < start && start - next_sample <= max_catchup && (!best || next_sample >= best_pos)) {
+    // Short skip forward, just keep going
+    render(NULL, start - next_sample, env);
+    return;
+  }
 
-  do {
+  if (best && start - best_pos <= max_catchup) {
+    for(unsigned n=0; n<last_nch; n++)
+      samplers[n]->copyState(*best->samplers[n]);
+
+    inputReadOffset = best->inputReadOffset;
+    next_sample = best_pos;
+    dst_samples_filled = 0;
+    exact = true;
+
+    if (start > best_pos)
+      render(NULL, start - best_pos, env);
+    return;
+  }
+
+  for(unsigned n=0; n<last_nch; n++)  // Clear all resamplers
+    samplers[n]->clear();
+
+  next_sample = start;
+  inputReadOffset = (__int64)(sample_multiplier * (long double)start);  // Reset at new read position (NOT sample exact :( ).
+  dst_samples_filled=0;
+  exact = (start == 0);
+}
+
+void saveCheckpoint(__int64 position, IScriptEnvironment* env)
+{
+  Checkpoint* cp = new Checkpoint;
+  cp->inputReadOffset = inputReadOffset;
+  for(unsigned n=0; n<last_nch; n++) {
+    cp->samplers.push_back(newSampler(env));
+    cp->samplers[n]->copyState(*samplers[n]);
+  }
+  checkpoints[position] = cp;
+  checkpoint_order.push_back(position);
+
+  if (checkpoint_order.size() > MAX_CHECKPOINTS) {  // Drop the oldest
+    std::map<__int64, Checkpoint*>::iterator old = checkpoints.find(checkpoint_order.front());
+    checkpoint_order.pop_front();
+    freeCheckpoint(old->second);
+    checkpoints.erase(old);
+  }
+}
+
+static void freeCheckpoint(Checkpoint* cp)
+{
+  for (size_t i = 0; i < cp->samplers.size(); ++i)
+    delete cp->samplers[i];
+  delete cp;
+}
+
+// Renders count samples from next_sample on into buf, or throws them away if buf is NULL.
+void render(BYTE* buf, __int64 count, IScriptEnvironment* env)
+{
+  bool buffer_full = (count <= 0);
+  __int64 samples_filled = 0;
+
+  while (!buffer_full) {
     // Empty buffer if something is still left.
     if (dst_samples_filled) {
-      int copysamples = min((int)count-samples_filled, dst_samples_filled);
+      int copysamples = (int)min(count-samples_filled, (__int64)dst_samples_filled);
       // Copy finished samples
-      memcpy((BYTE*)buf+vi.BytesFromAudioSamples(samples_filled), (BYTE*)dstbuffer, (size_t)vi.BytesFromAudioSamples(copysamples));
+      if (buf)
+        memcpy(buf+vi.BytesFromAudioSamples(samples_filled), (BYTE*)dstbuffer, (size_t)vi.BytesFromAudioSamples(copysamples));
 
       dst_samples_filled -= copysamples;
 
       if (dst_samples_filled) { // Move non-used samples
-        memcpy(dstbuffer, &dstbuffer[copysamples*last_nch], dst_samples_filled*sizeof(SFLOAT)*last_nch);
+        memmove(dstbuffer, &dstbuffer[copysamples*last_nch], dst_samples_filled*sizeof(SFLOAT)*last_nch);
       }
       samples_filled += copysamples;
       if (samples_filled >= count)
@@ -154,46 +336,98 @@ void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironm
     }
 
     // If buffer empty - refill
-    if (dst_samples_filled==0) {
-      // Read back samples from filter
-      int samples_out = 0;
-      int gotsamples = 0;
-      do {
-        for(unsigned n=0; n<last_nch; n++) {  // Copies back samples from individual filters
-          int old_g = gotsamples;
-          gotsamples = samplers[n]->receiveSamples(passbuffer, BUFFERSIZE - samples_out);
-
-          if (n>0) {
-            if (old_g!=gotsamples) {
-              _RPT1(0,"SoundTouch: Got %d too few samples!!!\n", gotsamples-old_g);
-            }
-          }
-          for(int s=0, r=samples_out*last_nch + n; s<gotsamples; s++, r+=last_nch)
-            dstbuffer[r] = passbuffer[s];
-        }
-        samples_out += gotsamples;
-
-      } while (gotsamples > 0);
+    if (!buffer_full && dst_samples_filled==0) {
+      if (exact) {
+        const __int64 position = next_sample + samples_filled;
+        std::map<__int64, Checkpoint*>::iterator cp = checkpoints.upper_bound(position);
+        if (cp == checkpoints.begin() || position - (--cp)->first >= checkpoint_interval)
+          saveCheckpoint(position, env);
+      }
 
-      dst_samples_filled = samples_out;
+      // Read back samples from filter
+      runChannels(false, env);
 
-      if (!dst_samples_filled) {  // We didn't get any samples
+      if (!gotsamples[0]) {  // We didn't get any samples
           // Feed new samples to filter
         child->GetAudio(dstbuffer, inputReadOffset, BUFFERSIZE, env);
         inputReadOffset += BUFFERSIZE;
 
-        for(unsigned n=0; n<last_nch; n++) {  // Copies n channels to separate buffers to individual filters
-          for(unsigned s=0, r=n; s<BUFFERSIZE; s++, r+=last_nch)
-            passbuffer[s] = dstbuffer[r];
-          
-          samplers[n]->putSamples(passbuffer, BUFFERSIZE);
-        }
+        Deinterleave(dstbuffer, &inplanes[0], last_nch, BUFFERSIZE, sse);
+        runChannels(true, env);
       } // End if no samples
+
+      {for(unsigned n=1; n<last_nch; n++) {
+        if (gotsamples[n]!=gotsamples[0]) {
+          _RPT1(0,"SoundTouch: Got %d too few samples!!!\n", gotsamples[n]-gotsamples[0]);
+        }
+      }}
+
+      dst_samples_filled = gotsamples[0];
+      Interleave(&outplanes[0], dstbuffer, last_nch, dst_samples_filled, sse);
     } // end if empty buffer
-  } while (!buffer_full);
+  }
   next_sample += count;
 }
 
+// Feeds the input planes to the samplers if 'feed' is set, then reads back
+// what they have ready. When feeding, helpers from the thread pool take some
+// of the channels; only from the main thread, as for Normalize's peak scan,
+// since a pool or prefetch thread waiting for the pool could starve it.
+void runChannels(bool feed, IScriptEnvironment* env)
+{
+  ChannelJob job;
+  job.self = this;
+  job.feed = feed;
+  job.next_channel = 0;
+
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+  size_t helpers = 0;
+  if (feed && use_pool && last_nch > 1 && env2->GetProperty(AEP_THREAD_ID) == 0)
+    helpers = min<size_t>(env2->GetProperty(AEP_THREADPOOL_THREADS), last_nch - 1);
+
+  if (helpers > 0) {
+    if (!completion)
+      completion = env2->NewCompletion(last_nch);
+    completion->Reset();
+    for (size_t i = 0; i < helpers; ++i)
+      env2->ParallelJob(ChannelJobFunc, &job, completion);
+  }
+
+  try {
+    processChannels(&job);
+    if (helpers > 0) {
+      completion->Wait();
+      for (size_t i = 0; i < completion->Size(); ++i)
+        completion->Get(i);   // Rethrows the errors of the helpers
+    }
+  }
+  catch (...) {
+    if (helpers > 0)
+      completion->Wait();   // The helpers still use 'job'
+    throw;
+  }
+}
+
+static AVSValue ChannelJobFunc(IScriptEnvironment2* env, void* data)
+{
+  processChannels(static_cast<ChannelJob*>(data));
+  return AVSValue();
+}
+
+static void processChannels(ChannelJob* job)
+{
+  AVSsoundtouch* self = job->self;
+  for (;;) {
+    const unsigned n = job->next_channel++;
+    if (n >= self->last_nch)
+      break;
+
+    if (job->feed)
+      self->samplers[n]->putSamples(self->inplanes[n], BUFFERSIZE);
+    self->gotsamples[n] = self->samplers[n]->receiveSamples(self->outplanes[n], BUFFERSIZE);
+  }
+}
+
 ~AVSsoundtouch()
   {
     delete[] dstbuffer;
@@ -201,6 +435,12 @@ void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironm
 
     for (size_t i = 0; i < samplers.size(); ++i)
       delete samplers[i];
+
+    for (std::map<__int64, Checkpoint*>::iterator cp = checkpoints.begin(); cp != checkpoints.end(); ++cp)
+      freeCheckpoint(cp->second);
+
+    if (completion)
+      completion->Destroy();
   }
 };
 
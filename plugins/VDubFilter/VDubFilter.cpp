@@ -313,6 +313,7 @@ typedef struct FilterModule {
     IScriptEnvironment*   env;
     const char*       avisynth_function_name;
     int preroll;
+    bool zerocopy;
 } FilterModule;
 
 typedef struct FilterDefinition {
@@ -548,6 +549,7 @@ class VirtualdubFilterProxy : public GenericVideoFilter {
   FilterActivation fa;
   DummyFilterPreview fp;
   int expected_frame_number;
+  bool zero_copy;
 
   void CallStartProc() {
     if (fd->startProc) {
@@ -621,10 +623,22 @@ public:
       SetVFBitmap(dst, &vbDst);
     }
 
+    // The filter sees new buffer addresses on every call, so this is only
+    // done when asked for when loading the plugin.
+    zero_copy = fd->module->zerocopy && !vbSrc.hdc;
+
     CallStartProc();
     expected_frame_number = 0;
   }
 
+  // Points pvb at the frame if it has the layout the filter was set up with.
+  static bool BindVFBitmap(const PVideoFrame& pvf, VFBitmap* pvb, bool writable) {
+    if (pvf->GetPitch() != pvb->pitch || (pvf->GetRowSize() >> 2) != pvb->w || pvf->GetHeight() != pvb->h)
+      return false;
+    pvb->data = writable ? (Pixel*)pvf->GetWritePtr() : (Pixel*)pvf->GetReadPtr();
+    return pvb->data != 0;
+  }
+
   void SetVFBitmap(const PVideoFrame& pvf, VFBitmap* pvb) {
     pvb->data = (Pixel*)pvf->GetReadPtr();
     pvb->palette = 0;
@@ -640,6 +654,9 @@ public:
   }
 
   PVideoFrame FilterFrame(int n, IScriptEnvironment* env, bool in_preroll) {
+    if (zero_copy)
+      return FilterFrameZeroCopy(n, env, in_preroll);
+
     if (last) {
       env->BitBlt(last->GetWritePtr(), last->GetPitch(), src->GetReadPtr(), src->GetPitch(),
         last->GetRowSize(), last->GetHeight());
@@ -665,6 +682,51 @@ public:
     }
   }
 
+  // Like FilterFrame, but the bitmaps are bound straight to the frames that
+  // are passed along instead of copying into and out of fixed buffers. The
+  // child frame becomes src, the previous src becomes last, and dst is a
+  // fresh frame each time. Filters with their own dst only read src, so the
+  // child frame is used as is; only in-place filters need it writable,
+  // which usually means a copy because the child's cache shares it.
+  PVideoFrame FilterFrameZeroCopy(int n, IScriptEnvironment* env, bool in_preroll) {
+    if (last) {
+      last = src;
+      vbLast.data = (Pixel*)last->GetReadPtr();
+    }
+
+    const bool in_place = !dst;
+    src = child->GetFrame(n, env);
+    if (in_place)
+      env->MakeWritable(&src);
+    if (!BindVFBitmap(src, &vbSrc, in_place)) {
+      PVideoFrame _src = env->NewVideoFrame(child->GetVideoInfo());
+      env->BitBlt(_src->GetWritePtr(), _src->GetPitch(), src->GetReadPtr(), src->GetPitch(),
+        _src->GetRowSize(), _src->GetHeight());
+      src = _src;
+      _src = 0;
+      if (!BindVFBitmap(src, &vbSrc, true))
+        throw AvisynthError("VirtualdubFilterProxy: unexpected source frame layout");
+    }
+
+    if (dst) {
+      dst = env->NewVideoFrame(vi);
+      if (!BindVFBitmap(dst, &vbDst, true))
+        throw AvisynthError("VirtualdubFilterProxy: unexpected destination frame layout");
+    }
+    else {
+      vbDst.data = vbSrc.data;  // In-place filter, dst is the same buffer as src
+    }
+
+    fsi.lCurrentSourceFrame = fsi.lCurrentFrame = n;
+    fsi.lDestFrameMS = fsi.lSourceFrameMS = MulDiv(n, fsi.lMicrosecsPerFrame, 1000);
+
+    fd->runProc(&fa, &g_filterFuncs);
+
+    if (in_preroll)
+      return 0;
+    return dst ? dst : src;
+  }
+
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env) {
     if (n != expected_frame_number) {
       CallEndProc();
@@ -777,6 +839,7 @@ AVSValue LoadVirtualdubPlugin(AVSValue args, void*, IScriptEnvironment* env) {
   const char* const szModule = args[0].AsString();
   const char* const avisynth_function_name = args[1].AsString();
   const int preroll = args[2].AsInt(0);
+  const bool zerocopy = args[3].AsBool(false);
 
   HMODULE hmodule = LoadLibrary(szModule);
   if (!hmodule)
@@ -810,6 +873,7 @@ AVSValue LoadVirtualdubPlugin(AVSValue args, void*, IScriptEnvironment* env) {
   fm->env = env;
   fm->avisynth_function_name = avisynth_function_name;
   fm->preroll = preroll;
+  fm->zerocopy = zerocopy;
   fm->next = loaded_modules;
   fm->prev = 0;
 
@@ -835,7 +899,7 @@ extern "C" __declspec(dllexport) const char* __stdcall AvisynthPluginInit3(IScri
 	AVS_linkage = vectors;
 
   // clip, base filename, start, end, image format/extension, info
-  env->AddFunction("LoadVirtualdubPlugin", "ss[preroll]i", LoadVirtualdubPlugin, 0);
+  env->AddFunction("LoadVirtualdubPlugin", "ss[preroll]i[zerocopy]b", LoadVirtualdubPlugin, 0);
 
   return "`LoadVirtualdubPlugin' Allows to load and use filters written for VirtualDub.";
 }